@@ -77,6 +77,12 @@ typedef struct Esql_Res Esql_Res;
  * Esskyuehl row object for accessing result rows
  */
 typedef struct Esql_Row Esql_Row;
+/**
+ * @typedef Esql_Stmt
+ * Esskyuehl prepared statement object
+ * @see esql_prepare
+ */
+typedef struct Esql_Stmt Esql_Stmt;
 
 /**
  * @typedef Esql_Query_Id
@@ -87,6 +93,7 @@ typedef unsigned int Esql_Query_Id;
 /**
  * @typedef Esql_Query_Cb
  * Callback to use with a query
+ * @see esql_query_full
  * @see esql_query_callback_set
  */
 typedef void (*Esql_Query_Cb)(Esql_Res *, void *);
@@ -111,6 +118,75 @@ typedef enum
    ESQL_TYPE_SQLITE
 } Esql_Type;
 
+/**
+ * @typedef Esql_Column_Type
+ * Storage type of a column in a columnar result
+ * @see esql_columnar_set
+ */
+typedef enum
+{
+   ESQL_COLUMN_TYPE_NONE,
+   ESQL_COLUMN_TYPE_INT64, /**< int64_t array */
+   ESQL_COLUMN_TYPE_DOUBLE, /**< double array */
+   ESQL_COLUMN_TYPE_STRING /**< NUL terminated strings/blobs in one buffer, addressed by offset */
+} Esql_Column_Type;
+
+#define ESQL_HISTOGRAM_BUCKETS 128 /**< Number of buckets of an #Esql_Histogram */
+
+/**
+ * @typedef Esql_Histogram
+ * Distribution of durations, in buckets at most 25% wide from 1 microsecond to about 2 hours
+ * @see esql_histogram_quantile
+ */
+typedef struct Esql_Histogram
+{
+   unsigned long long count; /**< number of samples */
+   double             total; /**< sum of the samples, in seconds */
+   double             max; /**< longest sample, in seconds */
+   unsigned long long buckets[ESQL_HISTOGRAM_BUCKETS]; /**< samples per bucket, use esql_histogram_quantile() */
+} Esql_Histogram;
+
+/**
+ * @typedef Esql_Stats
+ * Counters and latency histograms of the queries made on a connection or pool
+ * @see esql_stats_get
+ */
+typedef struct Esql_Stats
+{
+   unsigned long long submitted; /**< queries made */
+   unsigned long long completed; /**< queries which returned a result */
+   unsigned long long failed; /**< queries which returned an error or were lost with their connection */
+   unsigned long long bytes_sent; /**< query strings and statement parameters sent */
+   unsigned long long bytes_received; /**< result data received, as buffered by the backend */
+   unsigned int       queue_max; /**< most queries waiting to be sent at once */
+   Esql_Histogram     queue_wait; /**< time from a query being made to its sending */
+   Esql_Histogram     exec; /**< time from a query being sent to its result */
+   Esql_Histogram     callback; /**< time spent in result callbacks */
+} Esql_Stats;
+
+/**
+ * @typedef Esql_Slow_Query
+ * A query which took longer than the slow query threshold
+ * @see esql_slow_query_threshold_set
+ */
+typedef struct Esql_Slow_Query
+{
+   Esql_Query_Id id; /**< id of the query */
+   const char   *query; /**< query string */
+   int           member; /**< id of the pool connection which ran the query, -1 outside of pools */
+   double        queue_wait; /**< seconds from the query being made to its sending */
+   double        exec; /**< seconds from the query being sent to its result */
+   int           rows; /**< rows returned */
+   const char   *error; /**< error of the query, NULL if it succeeded */
+} Esql_Slow_Query;
+
+/**
+ * @typedef Esql_Slow_Query_Cb
+ * Callback to pass slow queries to
+ * @see esql_slow_query_callback_set
+ */
+typedef void (*Esql_Slow_Query_Cb)(const Esql_Slow_Query *, void *);
+
 /** @} */
 /* lib */
 EAPI int             esql_init(void);
@@ -143,10 +219,40 @@ EAPI Eina_Bool       esql_reconnect_get(const Esql *e);
 /* query */
 EAPI char           *esql_string_escape(Eina_Bool   backslashes, const char *s);
 EAPI Esql_Query_Id   esql_query(Esql *e, void *data, const char *query);
+EAPI Esql_Query_Id   esql_query_full(Esql *e, const char *query, Esql_Query_Cb cb, void *data);
+EAPI Esql_Query_Id   esql_query_stream(Esql *e, const char *query, Esql_Query_Cb row_cb, Esql_Query_Cb done_cb, void *data);
 EAPI Esql_Query_Id   esql_query_args(Esql *e, void *data, const char *fmt, ...);
 EAPI Esql_Query_Id   esql_query_vargs(Esql *e, void *data, const char *fmt, va_list args);
+EAPI Esql_Query_Id   esql_query_args_full(Esql *e, Esql_Query_Cb cb, void *data, const char *fmt, ...);
+EAPI Esql_Query_Id   esql_query_vargs_full(Esql *e, Esql_Query_Cb cb, void *data, const char *fmt, va_list args);
 EAPI Eina_Bool       esql_query_callback_set(Esql_Query_Id id, Esql_Query_Cb callback);
 
+/* stmt */
+EAPI Esql_Stmt      *esql_prepare(Esql *e, const char *fmt);
+EAPI Esql_Query_Id   esql_execute(Esql_Stmt *stmt, Esql_Query_Cb cb, void *data, ...);
+EAPI Esql_Query_Id   esql_execute_vargs(Esql_Stmt *stmt, Esql_Query_Cb cb, void *data, va_list args);
+EAPI const char     *esql_stmt_query_get(const Esql_Stmt *stmt);
+EAPI void            esql_stmt_free(Esql_Stmt *stmt);
+EAPI void            esql_stmt_cache_size_set(Esql *e, unsigned int size);
+EAPI unsigned int    esql_stmt_cache_size_get(const Esql *e);
+EAPI void            esql_stmt_cache_stats_get(const Esql *e, unsigned long long *hits, unsigned long long *misses);
+
+/* pipeline */
+EAPI void            esql_pipeline_set(Esql *e, unsigned int depth);
+EAPI unsigned int    esql_pipeline_get(const Esql *e);
+
+/* stats */
+EAPI Eina_Bool       esql_stats_get(const Esql *e, Esql_Stats *stats);
+EAPI void            esql_stats_reset(Esql *e);
+EAPI double          esql_histogram_quantile(const Esql_Histogram *h, double q);
+
+/* slow query log */
+EAPI void            esql_slow_query_threshold_set(Esql *e, double threshold);
+EAPI double          esql_slow_query_threshold_get(const Esql *e);
+EAPI void            esql_slow_query_callback_set(Esql *e, Esql_Slow_Query_Cb cb, void *data);
+EAPI void            esql_slow_query_log_size_set(Esql *e, unsigned int size);
+EAPI Esql_Slow_Query *esql_slow_query_pop(Esql *e, unsigned long long *dropped);
+
 /* res */
 EAPI Esql           *esql_res_esql_get(const Esql_Res *res);
 EAPI const char     *esql_res_error_get(const Esql_Res *res);
@@ -165,6 +271,17 @@ EAPI long long int   esql_res_rows_affected(const Esql_Res *res);
 EAPI long long int   esql_res_id(const Esql_Res *res);
 EAPI Eina_Iterator  *esql_res_row_iterator_new(const Esql_Res *res);
 
+/* column */
+EAPI void            esql_columnar_set(Esql *e, Eina_Bool enable);
+EAPI Eina_Bool       esql_columnar_get(const Esql *e);
+EAPI Eina_Bool       esql_res_columnar_get(const Esql_Res *res);
+EAPI Esql_Column_Type esql_res_column_type_get(const Esql_Res *res, unsigned int column);
+EAPI Eina_Bool       esql_res_column_int64_get(const Esql_Res *res, unsigned int column, const int64_t **values, unsigned int *count);
+EAPI Eina_Bool       esql_res_column_double_get(const Esql_Res *res, unsigned int column, const double **values, unsigned int *count);
+EAPI Eina_Bool       esql_res_column_string_get(const Esql_Res *res, unsigned int column, const char **arena, const unsigned int **offsets, unsigned int *count);
+EAPI const unsigned char *esql_res_column_nulls_get(const Esql_Res *res, unsigned int column);
+EAPI Eina_Bool       esql_res_column_isnull(const Esql_Res *res, unsigned int column, unsigned int row);
+
 /* convert */
 EAPI const char     *esql_res_to_string(const Esql_Res *res);
 EAPI unsigned char  *esql_res_to_blob(const Esql_Res *res, unsigned int *size);
@@ -48,12 +48,20 @@ src_lib_libesskyuehl_la_SOURCES = \
 src/lib/esql_private.h \
 src/lib/esql.c \
 src/lib/esql_alloc.c \
+src/lib/esql_arena.c \
+src/lib/esql_call.c \
+src/lib/esql_column.c \
 src/lib/esql_connect.c \
 src/lib/esql_convert.c \
+src/lib/esql_escape.c \
 src/lib/esql_events.c \
 src/lib/esql_model.c \
 src/lib/esql_module.c \
 src/lib/esql_module.h \
+src/lib/esql_pipeline.c \
 src/lib/esql_pool.c \
 src/lib/esql_query.c \
-src/lib/esql_res.c
+src/lib/esql_res.c \
+src/lib/esql_slow.c \
+src/lib/esql_stats.c \
+src/lib/esql_stmt.c
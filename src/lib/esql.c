@@ -22,6 +22,8 @@
  * @brief Functions to control initialization of the library
  * @{*/
 int esql_log_dom = -1;
+/* level of esql_log_dom as of the last esql_log_level_update() */
+int esql_log_level = EINA_LOG_LEVEL_ERR;
 static int esql_init_count_ = 0;
 
 EAPI int ESQL_EVENT_ERROR = 0;
@@ -67,6 +69,14 @@ static Eina_Bool module_check(Eina_Module *m, void *d EINA_UNUSED)
    return EINA_TRUE;
 }
 
+/* caches the level of the log domain, which is looked up once per io event
+ * instead of for each message
+ */
+void
+esql_log_level_update(void)
+{
+   esql_log_level = eina_log_domain_registered_level_get(esql_log_dom);
+}
 
 void
 esql_fake_free(void *data EINA_UNUSED, Esql *e)
@@ -96,8 +106,11 @@ esql_init(void)
         ERR("Could not register 'esskyuehl' log domain!");
         goto eina_fail;
      }
+   esql_log_level_update();
    if (!ecore_init()) goto fail;
    if (!esql_mempool_init()) goto memfail;
+   if (!esql_module_desc_init()) goto desc_fail;
+   esql_escape_init();
    mods = eina_module_list_get(NULL, ESQL_MODULE_PATH, EINA_FALSE, (Eina_Module_Cb)module_check, NULL);
    if (!mods) goto module_fail;
    eina_array_free(mods);
@@ -110,6 +123,8 @@ esql_init(void)
    return esql_init_count_;
 
 module_fail:
+   esql_module_desc_shutdown();
+desc_fail:
    esql_mempool_shutdown();
 memfail:
    ecore_shutdown();
@@ -139,8 +154,6 @@ esql_shutdown(void)
 
    if (esql_query_callbacks) eina_hash_free(esql_query_callbacks);
    esql_query_callbacks = NULL;
-   if (esql_query_data) eina_hash_free(esql_query_data);
-   esql_query_data = NULL;
    EINA_INLIST_FOREACH_SAFE(esql_modules, ll, mod)
      {
         eina_module_free(mod->module);
@@ -149,9 +162,11 @@ esql_shutdown(void)
    esql_modules = NULL;
    eina_log_domain_unregister(esql_log_dom);
    ecore_shutdown();
+   esql_module_desc_shutdown();
    esql_mempool_shutdown();
    eina_shutdown();
    esql_log_dom = -1;
+   esql_log_level = EINA_LOG_LEVEL_ERR;
    return esql_init_count_;
 }
 
@@ -174,6 +189,8 @@ esql_new(Esql_Type type)
 
    e = calloc(1, sizeof(Esql));
    EINA_SAFETY_ON_NULL_RETURN_VAL(e, NULL);
+   e->stmts.max = ESQL_STMT_CACHE_SIZE;
+   e->pipeline.max = 1;
    esql_type_set(e, type);
 
    return e;
@@ -237,6 +254,8 @@ esql_type_set(Esql     *e,
    EINA_SAFETY_ON_NULL_RETURN_VAL(e, EINA_FALSE);
    if (e->pool) return esql_pool_type_set((Esql_Pool *)e, type);
 
+   /* handles belong to the old backend */
+   if (e->backend.stmt_free) esql_stmt_cache_clear(e);
    if ((type != e->type) && e->backend.db && e->backend.free)
      e->backend.free(e);
 
@@ -332,14 +351,18 @@ esql_free(Esql *e)
         esql_pool_free((Esql_Pool *)e);
         return;
      }
+   /* nothing is reported about an object being freed */
+   esql_pipeline_clear(e);
    if (esql_modules)
      {
         if (e->connected) esql_disconnect(e);
+        if (e->backend.stmt_free) esql_stmt_cache_clear(e);
         if (e->backend.free) e->backend.free(e);
      }
-   if (e->backend_ids) eina_list_free(e->backend_set_funcs);
-   if (e->backend_set_params) eina_list_free(e->backend_set_params);
-   if (e->backend_ids) eina_list_free(e->backend_ids);
+   esql_call_queue_clear(&e->pipeline.sent, &e->stats);
+   esql_call_queue_clear(&e->calls, &e->stats);
+   esql_slow_log_clear(&e->slow);
+   free(e->cur_params);
    free(e->cur_query);
    free(e);
 }
@@ -1,7 +1,5 @@
 #include "esql_private.h"
 
-static const char *mempool_type = NULL;
-
 typedef struct _Esql_Mempool Esql_Mempool;
 struct _Esql_Mempool
 {
@@ -25,19 +23,11 @@ struct _Esql_Mempool
   }
 
 ESQL_ALLOC_FREE(Esql_Res, esql_res);
-ESQL_ALLOC_FREE(Esql_Row, esql_row);
 
 static Esql_Mempool *mempool_array[] = {
-  &esql_res_mp,
-  &esql_row_mp
+  &esql_res_mp
 };
 
-Eina_Mempool *
-esql_mempool_new(unsigned int size)
-{
-   return eina_mempool_add(mempool_type, NULL, NULL, size, 64);
-}
-
 Eina_Bool
 esql_mempool_init(void)
 {
@@ -67,7 +57,6 @@ esql_mempool_init(void)
                }
           }
      }
-   mempool_type = eina_stringshare_add(choice);
    return EINA_TRUE;
 }
 
@@ -81,6 +70,5 @@ esql_mempool_shutdown(void)
         eina_mempool_del(mempool_array[i]->mp);
         mempool_array[i]->mp = NULL;
      }
-   eina_stringshare_replace(&mempool_type, NULL);
 }
 
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2011, 2012, 2013, 2014 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esql_private.h"
+
+/* chunk sizes start small so tiny results stay cheap, then double up to the max */
+#define ESQL_ARENA_CHUNK_MIN 4096
+#define ESQL_ARENA_CHUNK_MAX (1024 * 1024)
+/* enough for any member type a result can hold */
+#define ESQL_ARENA_ALIGN     (sizeof(void *) * 2)
+
+struct Esql_Arena_Chunk
+{
+   Esql_Arena_Chunk *next;
+   size_t            size; /* usable bytes after the header */
+   size_t            used;
+};
+
+#define ESQL_ARENA_CHUNK_HEADER \
+  ((sizeof(Esql_Arena_Chunk) + ESQL_ARENA_ALIGN - 1) & ~(ESQL_ARENA_ALIGN - 1))
+
+/*
+ * a bump allocator owned by a result: everything it hands out lives until
+ * the result is freed (or, while streaming, until the batch is flushed),
+ * so nothing is ever freed individually
+ */
+
+static Esql_Arena_Chunk *
+esql_arena_chunk_add(Esql_Arena *a, size_t need)
+{
+   Esql_Arena_Chunk *c;
+   size_t size;
+
+   size = a->chunks ? a->chunks->size * 2 : ESQL_ARENA_CHUNK_MIN;
+   if (size > ESQL_ARENA_CHUNK_MAX) size = ESQL_ARENA_CHUNK_MAX;
+   if (size < need) size = need;
+
+   c = malloc(ESQL_ARENA_CHUNK_HEADER + size);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(c, NULL);
+   c->size = size;
+   c->used = 0;
+   c->next = a->chunks;
+   a->chunks = c;
+   return c;
+}
+
+void *
+esql_arena_alloc(Esql_Arena *a, size_t size)
+{
+   Esql_Arena_Chunk *c;
+   void *ret;
+
+   size = (size + ESQL_ARENA_ALIGN - 1) & ~(ESQL_ARENA_ALIGN - 1);
+   c = a->chunks;
+   if ((!c) || (c->size - c->used < size))
+     {
+        c = esql_arena_chunk_add(a, size);
+        if (!c) return NULL;
+     }
+   ret = (char *)c + ESQL_ARENA_CHUNK_HEADER + c->used;
+   c->used += size;
+   return ret;
+}
+
+void *
+esql_arena_calloc(Esql_Arena *a, size_t size)
+{
+   void *ret;
+
+   ret = esql_arena_alloc(a, size);
+   if (ret) memset(ret, 0, size);
+   return ret;
+}
+
+/* copies @p len bytes of @p s and NUL terminates them */
+char *
+esql_arena_strndup(Esql_Arena *a, const char *s, size_t len)
+{
+   char *ret;
+
+   ret = esql_arena_alloc(a, len + 1);
+   if (!ret) return NULL;
+   if (len) memcpy(ret, s, len);
+   ret[len] = 0;
+   return ret;
+}
+
+/* drops everything allocated so far, keeping the newest (largest) chunk for reuse */
+void
+esql_arena_reset(Esql_Arena *a)
+{
+   Esql_Arena_Chunk *c, *next;
+
+   if (!a->chunks) return;
+   for (c = a->chunks->next; c; c = next)
+     {
+        next = c->next;
+        free(c);
+     }
+   a->chunks->next = NULL;
+   a->chunks->used = 0;
+}
+
+void
+esql_arena_free(Esql_Arena *a)
+{
+   Esql_Arena_Chunk *c, *next;
+
+   for (c = a->chunks; c; c = next)
+     {
+        next = c->next;
+        free(c);
+     }
+   a->chunks = NULL;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2011, 2012, 2013, 2014 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esql_private.h"
+
+/* initial number of call records, must be a power of 2 */
+#define ESQL_CALL_QUEUE_MIN 16
+
+/*
+ * the call queue is a growable ring of call records: the array is only
+ * ever grown (doubled), so once a connection has seen its peak queue depth
+ * enqueueing and dequeueing calls never allocates again
+ */
+
+static Eina_Bool
+esql_call_queue_grow(Esql_Call_Queue *q)
+{
+   Esql_Call *calls;
+   unsigned int size, first;
+
+   size = q->size ? q->size * 2 : ESQL_CALL_QUEUE_MIN;
+   calls = malloc(size * sizeof(Esql_Call));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(calls, EINA_FALSE);
+
+   if (q->count)
+     {
+        /* unwrap the ring so that the head ends up at index 0 */
+        first = q->size - q->head;
+        if (first > q->count) first = q->count;
+        memcpy(calls, q->calls + q->head, first * sizeof(Esql_Call));
+        memcpy(calls + first, q->calls, (q->count - first) * sizeof(Esql_Call));
+     }
+   free(q->calls);
+   q->calls = calls;
+   q->size = size;
+   q->head = 0;
+   return EINA_TRUE;
+}
+
+/* returns a zeroed record at the tail of @p q for the caller to fill in */
+Esql_Call *
+esql_call_push(Esql_Call_Queue *q)
+{
+   Esql_Call *call;
+
+   if ((q->count == q->size) && (!esql_call_queue_grow(q)))
+     return NULL;
+
+   call = q->calls + ((q->head + q->count) & (q->size - 1));
+   q->count++;
+   memset(call, 0, sizeof(Esql_Call));
+   return call;
+}
+
+/* returns the record at the head of @p q without removing it */
+Esql_Call *
+esql_call_peek(const Esql_Call_Queue *q)
+{
+   if (!q->count) return NULL;
+   return q->calls + q->head;
+}
+
+/* moves the record at the head of @p q into @p call, ownership of its strings included */
+Eina_Bool
+esql_call_shift(Esql_Call_Queue *q,
+                Esql_Call       *call)
+{
+   if (!q->count) return EINA_FALSE;
+
+   *call = q->calls[q->head];
+   q->head = (q->head + 1) & (q->size - 1);
+   q->count--;
+   return EINA_TRUE;
+}
+
+/* drops the record at the tail of @p q, which must not own anything yet */
+Eina_Bool
+esql_call_pop(Esql_Call_Queue *q)
+{
+   if (!q->count) return EINA_FALSE;
+
+   q->count--;
+   return EINA_TRUE;
+}
+
+/* drops the calls left in @p q, the queries among them are counted as failed in @p stats */
+void
+esql_call_queue_clear(Esql_Call_Queue *q,
+                      Esql_Stats      *stats)
+{
+   Esql_Call call;
+
+   while (esql_call_shift(q, &call))
+     {
+        if (call.type == ESQL_CONNECT_TYPE_QUERY) stats->failed++;
+        esql_call_callback_take(&call);
+        free(call.params);
+        free(call.query);
+     }
+   free(q->calls);
+   memset(q, 0, sizeof(Esql_Call_Queue));
+}
@@ -0,0 +1,490 @@
+/*
+ * Copyright 2011, 2012, 2013, 2014 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esql_private.h"
+#include <inttypes.h>
+
+/* initial number of cells in a column, grown by doubling */
+#define ESQL_COLUMN_MIN 64
+
+/*
+ * columnar results keep one typed array per column instead of one
+ * Eina_Value struct per row: integers and floats are stored as int64_t and
+ * double arrays, strings and blobs are copied back to back (NUL terminated)
+ * into a single arena per column and addressed by offset, and NULL cells are
+ * tracked in a bitmap which is only allocated once the first NULL shows up.
+ */
+
+static Esql_Column_Type
+esql_column_type_from_value(const Eina_Value_Type *type)
+{
+   if ((type == EINA_VALUE_TYPE_CHAR) || (type == EINA_VALUE_TYPE_UCHAR) ||
+       (type == EINA_VALUE_TYPE_SHORT) || (type == EINA_VALUE_TYPE_USHORT) ||
+       (type == EINA_VALUE_TYPE_INT) || (type == EINA_VALUE_TYPE_UINT) ||
+       (type == EINA_VALUE_TYPE_LONG) || (type == EINA_VALUE_TYPE_ULONG) ||
+       (type == EINA_VALUE_TYPE_INT64) || (type == EINA_VALUE_TYPE_UINT64) ||
+       (type == EINA_VALUE_TYPE_TIMESTAMP))
+     return ESQL_COLUMN_TYPE_INT64;
+   if ((type == EINA_VALUE_TYPE_FLOAT) || (type == EINA_VALUE_TYPE_DOUBLE))
+     return ESQL_COLUMN_TYPE_DOUBLE;
+   return ESQL_COLUMN_TYPE_STRING;
+}
+
+static Eina_Bool
+esql_column_grow(Esql_Column *c)
+{
+   unsigned int size;
+   void *tmp;
+
+   size = c->size ? c->size * 2 : ESQL_COLUMN_MIN;
+   switch (c->type)
+     {
+      case ESQL_COLUMN_TYPE_INT64:
+        tmp = realloc(c->v.i, size * sizeof(int64_t));
+        break;
+      case ESQL_COLUMN_TYPE_DOUBLE:
+        tmp = realloc(c->v.d, size * sizeof(double));
+        break;
+      default:
+        /* one extra offset for the end of the last cell */
+        tmp = realloc(c->v.offsets, (size + 1) * sizeof(unsigned int));
+        if (tmp && (!c->size)) ((unsigned int*)tmp)[0] = 0;
+        break;
+     }
+   EINA_SAFETY_ON_NULL_RETURN_VAL(tmp, EINA_FALSE);
+   c->v.i = tmp;
+
+   if (c->nulls)
+     {
+        tmp = realloc(c->nulls, size / 8);
+        EINA_SAFETY_ON_NULL_RETURN_VAL(tmp, EINA_FALSE);
+        c->nulls = tmp;
+        memset(c->nulls + c->size / 8, 0, (size - c->size) / 8);
+     }
+   c->size = size;
+   return EINA_TRUE;
+}
+
+static Esql_Column *
+esql_column_cell_add(Esql_Res *res, unsigned int column)
+{
+   Esql_Column *c;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(res->columns, NULL);
+   EINA_SAFETY_ON_FALSE_RETURN_VAL(column < res->desc->member_count, NULL);
+
+   c = res->columns + column;
+   if ((c->count == c->size) && (!esql_column_grow(c)))
+     return NULL;
+   return c;
+}
+
+static Eina_Bool
+esql_column_arena_add(Esql_Column *c, const char *str, unsigned int len)
+{
+   unsigned int need;
+
+   need = c->arena_len + len + 1;
+   if (need > c->arena_size)
+     {
+        unsigned int size;
+        char *tmp;
+
+        size = c->arena_size ? c->arena_size : 1024;
+        while (size < need) size *= 2;
+        tmp = realloc(c->arena, size);
+        EINA_SAFETY_ON_NULL_RETURN_VAL(tmp, EINA_FALSE);
+        c->arena = tmp;
+        c->arena_size = size;
+     }
+   if (len) memcpy(c->arena + c->arena_len, str, len);
+   c->arena[c->arena_len + len] = 0;
+   c->arena_len = need;
+   c->v.offsets[++c->count] = need;
+   return EINA_TRUE;
+}
+
+static const Esql_Column *
+esql_column_get(const Esql_Res *res, unsigned int column, Esql_Column_Type type)
+{
+   const Esql_Column *c;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(res, NULL);
+   if (!res->columns) return NULL;
+   EINA_SAFETY_ON_FALSE_RETURN_VAL(column < res->desc->member_count, NULL);
+
+   c = res->columns + column;
+   if ((type != ESQL_COLUMN_TYPE_NONE) && (c->type != type))
+     {
+        ERR("Column %u of res=%p is not of type %d", column, res, type);
+        return NULL;
+     }
+   return c;
+}
+
+/**
+ * @internal
+ * Switch @p res to columnar storage, using its desc for column count and types.
+ * Called by backends after res->desc has been created.
+ */
+Eina_Bool
+esql_res_columns_setup(Esql_Res *res)
+{
+   unsigned int i;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(res, EINA_FALSE);
+   if (!res->desc) return EINA_TRUE; /* nothing selected */
+
+   res->columns = calloc(res->desc->member_count, sizeof(Esql_Column));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(res->columns, EINA_FALSE);
+
+   for (i = 0; i < res->desc->member_count; i++)
+     res->columns[i].type = esql_column_type_from_value(res->desc->members[i].type);
+   return EINA_TRUE;
+}
+
+void
+esql_res_columns_free(Esql_Res *res)
+{
+   unsigned int i;
+
+   if (!res->columns) return;
+   for (i = 0; i < res->desc->member_count; i++)
+     {
+        free(res->columns[i].v.i);
+        free(res->columns[i].nulls);
+        free(res->columns[i].arena);
+     }
+   free(res->columns);
+   res->columns = NULL;
+}
+
+/* empties the columns of @p res, keeping their memory for the next batch of a stream */
+void
+esql_res_columns_reset(Esql_Res *res)
+{
+   unsigned int i;
+
+   if (!res->columns) return;
+   for (i = 0; i < res->desc->member_count; i++)
+     {
+        Esql_Column *c = res->columns + i;
+
+        if (c->nulls) memset(c->nulls, 0, c->size / 8);
+        c->count = 0;
+        c->arena_len = 0;
+     }
+}
+
+/* drops the cells of @p res after an append failed, so it is handed over as an error */
+void
+esql_res_columns_fail(Esql_Res *res)
+{
+   ERR("Could not store the cells of res=%p", res);
+   esql_res_columns_reset(res);
+   res->row_count = 0;
+   if (!res->error) res->error = "Out of memory";
+}
+
+Eina_Bool
+esql_res_column_int64_append(Esql_Res *res, unsigned int column, int64_t value)
+{
+   Esql_Column *c;
+
+   c = esql_column_cell_add(res, column);
+   if (!c) return EINA_FALSE;
+
+   switch (c->type)
+     {
+      case ESQL_COLUMN_TYPE_INT64:
+        c->v.i[c->count++] = value;
+        return EINA_TRUE;
+      case ESQL_COLUMN_TYPE_DOUBLE:
+        c->v.d[c->count++] = value;
+        return EINA_TRUE;
+      default:
+        {
+           char buf[32];
+           int len;
+
+           len = snprintf(buf, sizeof(buf), "%"PRId64, value);
+           return esql_column_arena_add(c, buf, len);
+        }
+     }
+}
+
+Eina_Bool
+esql_res_column_double_append(Esql_Res *res, unsigned int column, double value)
+{
+   Esql_Column *c;
+
+   c = esql_column_cell_add(res, column);
+   if (!c) return EINA_FALSE;
+
+   switch (c->type)
+     {
+      case ESQL_COLUMN_TYPE_INT64:
+        c->v.i[c->count++] = value;
+        return EINA_TRUE;
+      case ESQL_COLUMN_TYPE_DOUBLE:
+        c->v.d[c->count++] = value;
+        return EINA_TRUE;
+      default:
+        {
+           char buf[64];
+           int len;
+
+           len = snprintf(buf, sizeof(buf), "%.17g", value);
+           return esql_column_arena_add(c, buf, len);
+        }
+     }
+}
+
+Eina_Bool
+esql_res_column_string_append(Esql_Res *res, unsigned int column, const char *str, unsigned int len)
+{
+   Esql_Column *c;
+   char buf[64];
+
+   c = esql_column_cell_add(res, column);
+   if (!c) return EINA_FALSE;
+
+   switch (c->type)
+     {
+      case ESQL_COLUMN_TYPE_INT64:
+        c->v.i[c->count++] = strtoll(esql_cstr_copy(buf, sizeof(buf), str, len), NULL, 10);
+        return EINA_TRUE;
+      case ESQL_COLUMN_TYPE_DOUBLE:
+        c->v.d[c->count++] = strtod(esql_cstr_copy(buf, sizeof(buf), str, len), NULL);
+        return EINA_TRUE;
+      default:
+        return esql_column_arena_add(c, str, len);
+     }
+}
+
+Eina_Bool
+esql_res_column_null_append(Esql_Res *res, unsigned int column)
+{
+   Esql_Column *c;
+   unsigned int cell;
+
+   c = esql_column_cell_add(res, column);
+   if (!c) return EINA_FALSE;
+
+   if (!c->nulls)
+     {
+        c->nulls = calloc(1, c->size / 8);
+        EINA_SAFETY_ON_NULL_RETURN_VAL(c->nulls, EINA_FALSE);
+     }
+   cell = c->count;
+   c->nulls[cell / 8] |= 1 << (cell % 8);
+
+   switch (c->type)
+     {
+      case ESQL_COLUMN_TYPE_INT64:
+        c->v.i[c->count++] = 0;
+        return EINA_TRUE;
+      case ESQL_COLUMN_TYPE_DOUBLE:
+        c->v.d[c->count++] = 0.0;
+        return EINA_TRUE;
+      default:
+        return esql_column_arena_add(c, NULL, 0);
+     }
+}
+
+/**
+ * @defgroup Esql_Column Columnar results
+ * @brief Functions to use results stored one array per column
+ *
+ * When columnar mode is enabled with esql_columnar_set(), results do not
+ * carry #Esql_Row objects: esql_res_row_iterator_new() returns NULL and the
+ * esql_res_to_* conversions fail. Instead each column is stored as a single
+ * typed array which can be scanned directly. Every array has
+ * esql_res_rows_count() cells.
+ * @{
+ */
+
+/**
+ * @brief Enable or disable columnar results
+ * @param e The #Esql object (NOT NULL)
+ * @param enable If EINA_TRUE, results of subsequent queries are stored by column
+ *
+ * This setting applies to all members of a pool.
+ */
+void
+esql_columnar_set(Esql     *e,
+                  Eina_Bool enable)
+{
+   EINA_SAFETY_ON_NULL_RETURN(e);
+
+   e->columnar = !!enable;
+   if (e->pool) esql_pool_columnar_set((Esql_Pool*)e, enable);
+}
+
+/**
+ * @brief Return the columnar result mode
+ * @param e The #Esql object (NOT NULL)
+ * @return If EINA_TRUE, results are stored by column
+ */
+Eina_Bool
+esql_columnar_get(const Esql *e)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, EINA_FALSE);
+
+   return e->columnar;
+}
+
+/**
+ * @brief Return whether a result is stored by column
+ * @param res The result object (NOT NULL)
+ * @return EINA_TRUE if the esql_res_column_* functions can be used on @p res
+ */
+Eina_Bool
+esql_res_columnar_get(const Esql_Res *res)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(res, EINA_FALSE);
+
+   return !!res->columns;
+}
+
+/**
+ * @brief Retrieve the storage type of a column
+ * @param res The result object (NOT NULL)
+ * @param column column index, counting from zero and less than esql_res_cols_count()
+ * @return The column type, #ESQL_COLUMN_TYPE_NONE if @p res is not columnar
+ *
+ * Integer, boolean and timestamp columns are stored as #ESQL_COLUMN_TYPE_INT64,
+ * floating point columns as #ESQL_COLUMN_TYPE_DOUBLE, everything else
+ * (text, blobs, dates mysql sends as text...) as #ESQL_COLUMN_TYPE_STRING.
+ */
+Esql_Column_Type
+esql_res_column_type_get(const Esql_Res *res, unsigned int column)
+{
+   const Esql_Column *c;
+
+   c = esql_column_get(res, column, ESQL_COLUMN_TYPE_NONE);
+   if (!c) return ESQL_COLUMN_TYPE_NONE;
+   return c->type;
+}
+
+/**
+ * @brief Retrieve the values of an integer column
+ * @param res The result object (NOT NULL)
+ * @param column column index, counting from zero and less than esql_res_cols_count()
+ * @param values Pointer to store the array of values in (owned by @p res)
+ * @param count Pointer to store the number of values in
+ * @return EINA_TRUE on success, EINA_FALSE if @p column is not #ESQL_COLUMN_TYPE_INT64
+ *
+ * NULL cells are stored as 0, use esql_res_column_nulls_get() to tell them apart.
+ */
+Eina_Bool
+esql_res_column_int64_get(const Esql_Res *res, unsigned int column, const int64_t **values, unsigned int *count)
+{
+   const Esql_Column *c;
+
+   c = esql_column_get(res, column, ESQL_COLUMN_TYPE_INT64);
+   if (!c) return EINA_FALSE;
+   if (values) *values = c->v.i;
+   if (count) *count = c->count;
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Retrieve the values of a floating point column
+ * @param res The result object (NOT NULL)
+ * @param column column index, counting from zero and less than esql_res_cols_count()
+ * @param values Pointer to store the array of values in (owned by @p res)
+ * @param count Pointer to store the number of values in
+ * @return EINA_TRUE on success, EINA_FALSE if @p column is not #ESQL_COLUMN_TYPE_DOUBLE
+ *
+ * NULL cells are stored as 0.0, use esql_res_column_nulls_get() to tell them apart.
+ */
+Eina_Bool
+esql_res_column_double_get(const Esql_Res *res, unsigned int column, const double **values, unsigned int *count)
+{
+   const Esql_Column *c;
+
+   c = esql_column_get(res, column, ESQL_COLUMN_TYPE_DOUBLE);
+   if (!c) return EINA_FALSE;
+   if (values) *values = c->v.d;
+   if (count) *count = c->count;
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Retrieve the values of a string column
+ * @param res The result object (NOT NULL)
+ * @param column column index, counting from zero and less than esql_res_cols_count()
+ * @param arena Pointer to store the string data in (owned by @p res)
+ * @param offsets Pointer to store the array of @p count + 1 offsets in (owned by @p res)
+ * @param count Pointer to store the number of values in
+ * @return EINA_TRUE on success, EINA_FALSE if @p column is not #ESQL_COLUMN_TYPE_STRING
+ *
+ * Cell @c i starts at @c arena + @c offsets[i] and is NUL terminated, its length
+ * (useful for blobs) is @c offsets[i + 1] - @c offsets[i] - 1.
+ * NULL cells are stored as empty strings.
+ */
+Eina_Bool
+esql_res_column_string_get(const Esql_Res *res, unsigned int column, const char **arena, const unsigned int **offsets, unsigned int *count)
+{
+   const Esql_Column *c;
+
+   c = esql_column_get(res, column, ESQL_COLUMN_TYPE_STRING);
+   if (!c) return EINA_FALSE;
+   if (arena) *arena = c->arena;
+   if (offsets) *offsets = c->v.offsets;
+   if (count) *count = c->count;
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Retrieve the NULL bitmap of a column
+ * @param res The result object (NOT NULL)
+ * @param column column index, counting from zero and less than esql_res_cols_count()
+ * @return The bitmap (owned by @p res), or NULL if the column has no NULL cells
+ *
+ * Cell @c i is NULL if bit (@c i % 8) of byte (@c i / 8) is set.
+ */
+const unsigned char *
+esql_res_column_nulls_get(const Esql_Res *res, unsigned int column)
+{
+   const Esql_Column *c;
+
+   c = esql_column_get(res, column, ESQL_COLUMN_TYPE_NONE);
+   if (!c) return NULL;
+   return c->nulls;
+}
+
+/**
+ * @brief Check whether a cell of a column is NULL
+ * @param res The result object (NOT NULL)
+ * @param column column index, counting from zero and less than esql_res_cols_count()
+ * @param row row index, counting from zero and less than esql_res_rows_count()
+ * @return EINA_TRUE if the cell is NULL
+ */
+Eina_Bool
+esql_res_column_isnull(const Esql_Res *res, unsigned int column, unsigned int row)
+{
+   const Esql_Column *c;
+
+   c = esql_column_get(res, column, ESQL_COLUMN_TYPE_NONE);
+   if ((!c) || (!c->nulls)) return EINA_FALSE;
+   EINA_SAFETY_ON_FALSE_RETURN_VAL(row < c->count, EINA_FALSE);
+   return !!(c->nulls[row / 8] & (1 << (row % 8)));
+}
+
+/** @} */
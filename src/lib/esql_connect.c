@@ -53,6 +53,7 @@ esql_connect(Esql       *e,
         ERR("Connection error: already connected!");
         return EINA_FALSE;
      }
+   esql_log_level_update();
    e->backend.setup(e, addr, user, passwd);
    ret = e->backend.connect(e);
    if (ret == ECORE_FD_ERROR)
@@ -90,6 +91,8 @@ esql_disconnect(Esql *e)
      }
    EINA_SAFETY_ON_NULL_RETURN(e->backend.db);
 
+   /* server side statements do not outlive the connection */
+   esql_stmt_cache_clear(e);
    e->backend.disconnect(e);
    if (e->fdh) ecore_main_fd_handler_del(e->fdh);
    e->fdh = NULL;
@@ -108,6 +111,10 @@ esql_disconnect(Esql *e)
           }
      }
    e->connected = EINA_FALSE;
+   e->backend.broken = EINA_FALSE;
+   /* the results of the queries in flight will never be read */
+   esql_pipeline_fail(e, "Disconnected");
+   if (e->pool_member) esql_pool_member_update(e);
 }
 
 /**
@@ -164,10 +171,15 @@ esql_database_set(Esql       *e,
      }
    else
      {
-        e->backend_set_funcs = eina_list_append(e->backend_set_funcs, esql_database_set);
-        e->backend_set_params = eina_list_append(e->backend_set_params, strdup(database_name));
-        e->backend_ids = eina_list_append(e->backend_ids, e);
+        Esql_Call *call;
+
+        call = esql_call_push(&e->calls);
+        EINA_SAFETY_ON_NULL_RETURN_VAL(call, EINA_FALSE);
+        call->type = ESQL_CONNECT_TYPE_DATABASE_SET;
+        call->query = strdup(database_name);
+        call->len = strlen(database_name);
      }
+   if (e->pool_member) esql_pool_member_update(e);
 
    return EINA_TRUE;
 }
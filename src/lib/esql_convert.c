@@ -36,7 +36,7 @@ esql_res_to_string(const Esql_Res *res)
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(res, NULL);
    EINA_SAFETY_ON_TRUE_RETURN_VAL(res->row_count > 1, NULL);
-   if (!res->row_count) return NULL;
+   if ((!res->row_count) || (!res->rows)) return NULL;
    row = EINA_INLIST_CONTAINER_GET(res->rows, Esql_Row);
 
    member = row->res->desc->members;
@@ -72,7 +72,7 @@ esql_res_to_blob(const Esql_Res *res, unsigned int *size)
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(res, NULL);
    EINA_SAFETY_ON_TRUE_RETURN_VAL(res->row_count > 1, NULL);
-   if (!res->row_count) return NULL;
+   if ((!res->row_count) || (!res->rows)) return NULL;
    row = EINA_INLIST_CONTAINER_GET(res->rows, Esql_Row);
 
    member = row->res->desc->members;
@@ -111,7 +111,7 @@ esql_res_to_lli(const Esql_Res *res)
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(res, 0);
    EINA_SAFETY_ON_TRUE_RETURN_VAL(res->row_count > 1, 0);
-   if (!res->row_count) return 0;
+   if ((!res->row_count) || (!res->rows)) return 0;
    row = EINA_INLIST_CONTAINER_GET(res->rows, Esql_Row);
 
    member = row->res->desc->members;
@@ -147,7 +147,7 @@ esql_res_to_double(const Esql_Res *res)
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(res, 0.0);
    EINA_SAFETY_ON_TRUE_RETURN_VAL(res->row_count > 1, 0.0);
-   if (!res->row_count) return 0.0;
+   if ((!res->row_count) || (!res->rows)) return 0.0;
    row = EINA_INLIST_CONTAINER_GET(res->rows, Esql_Row);
 
    member = row->res->desc->members;
@@ -183,7 +183,7 @@ esql_res_to_ulong(const Esql_Res *res)
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(res, 0);
    EINA_SAFETY_ON_TRUE_RETURN_VAL(res->row_count > 1, 0);
-   if (!res->row_count) return 0;
+   if ((!res->row_count) || (!res->rows)) return 0;
    row = EINA_INLIST_CONTAINER_GET(res->rows, Esql_Row);
 
    member = row->res->desc->members;
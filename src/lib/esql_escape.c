@@ -0,0 +1,311 @@
+/*
+ * Copyright 2011, 2012, 2013, 2014 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esql_private.h"
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define ESQL_ESCAPE_X86 1
+# include <immintrin.h>
+#endif
+
+/*
+ * strings are mostly clean, so escaping is fastest when checking and copying
+ * 16 or 32 bytes at a time: a block with nothing to escape is stored as is,
+ * only the others are escaped byte by byte. the vector versions are picked at
+ * runtime, according to what the cpu supports.
+ */
+
+/* the character following the backslash for each byte which needs escaping */
+static const char esql_escape_table[256] =
+{
+   ['\''] = '\'',
+   ['\\'] = '\\',
+   ['"'] = '"',
+   ['\n'] = 'n',
+   ['\r'] = 'r'
+};
+
+typedef size_t (*Esql_Escape_Len)(Eina_Bool backslashes, const char *s);
+typedef char  *(*Esql_Escape_Write)(Eina_Bool backslashes, char *rp, const char *s);
+
+/* returns the character to put after the escape character for @p c, 0 if it is fine as is */
+static inline char
+esql_escape_char(Eina_Bool backslashes,
+                 char      c)
+{
+   if (backslashes) return esql_escape_table[(unsigned char)c];
+   /* no backslashes allowed, so just double up single quotes */
+   return (c == '\'') ? '\'' : 0;
+}
+
+/* escapes the @p len bytes at @p p */
+static inline char *
+esql_escape_bytes(Eina_Bool   backslashes,
+                  char       *rp,
+                  const char *p,
+                  size_t      len)
+{
+   const char *end = p + len;
+   char e;
+
+   for (; p < end; p++)
+     {
+        e = esql_escape_char(backslashes, *p);
+        if (e)
+          {
+             *rp++ = backslashes ? '\\' : '\'';
+             *rp++ = e;
+          }
+        else
+          *rp++ = *p;
+     }
+   return rp;
+}
+
+static size_t
+esql_escape_len_scalar(Eina_Bool   backslashes,
+                       const char *s)
+{
+   const char *p;
+   size_t n = 0;
+
+   for (p = s; *p; p++)
+     n += esql_escape_char(backslashes, *p) ? 2 : 1;
+   return n;
+}
+
+static char *
+esql_escape_write_scalar(Eina_Bool   backslashes,
+                         char       *rp,
+                         const char *s)
+{
+   return esql_escape_bytes(backslashes, rp, s, strlen(s));
+}
+
+#ifdef ESQL_ESCAPE_X86
+/* aligned loads never cross a page boundary, so reading past the nul is safe;
+ * the unaligned head of the string is handled byte by byte
+ */
+
+__attribute__((target("sse2")))
+static inline unsigned int
+esql_escape_mask_sse2(__m128i   v,
+                      Eina_Bool backslashes)
+{
+   __m128i m;
+
+   m = _mm_cmpeq_epi8(v, _mm_set1_epi8('\''));
+   if (backslashes)
+     m = _mm_or_si128(m, _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')),
+                                                   _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))),
+                                      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')))));
+   return _mm_movemask_epi8(m);
+}
+
+__attribute__((target("sse2"), no_sanitize_address))
+static size_t
+esql_escape_len_sse2(Eina_Bool   backslashes,
+                     const char *s)
+{
+   const char *p;
+   unsigned int z, m;
+   size_t n = 0;
+   __m128i v;
+
+   for (p = s; (uintptr_t)p & 15; p++)
+     {
+        if (!*p) return n;
+        n += esql_escape_char(backslashes, *p) ? 2 : 1;
+     }
+   for (;; p += 16)
+     {
+        v = _mm_load_si128((const __m128i *)p);
+        z = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        m = esql_escape_mask_sse2(v, backslashes);
+        if (z)
+          {
+             z = __builtin_ctz(z);
+             return n + z + __builtin_popcount(m & ((1U << z) - 1));
+          }
+        n += 16 + __builtin_popcount(m);
+     }
+}
+
+__attribute__((target("sse2"), no_sanitize_address))
+static char *
+esql_escape_write_sse2(Eina_Bool   backslashes,
+                       char       *rp,
+                       const char *s)
+{
+   const char *p;
+   unsigned int z, m;
+   __m128i v;
+
+   for (p = s; (uintptr_t)p & 15; p++)
+     {
+        if (!*p) return rp;
+        rp = esql_escape_bytes(backslashes, rp, p, 1);
+     }
+   for (;; p += 16)
+     {
+        v = _mm_load_si128((const __m128i *)p);
+        z = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        m = esql_escape_mask_sse2(v, backslashes);
+        if (!(z | m))
+          {
+             /* the escaped string is at least as long as what is left of the input */
+             _mm_storeu_si128((__m128i *)rp, v);
+             rp += 16;
+             continue;
+          }
+        if (z) return esql_escape_bytes(backslashes, rp, p, __builtin_ctz(z));
+        rp = esql_escape_bytes(backslashes, rp, p, 16);
+     }
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int
+esql_escape_mask_avx2(__m256i   v,
+                      Eina_Bool backslashes)
+{
+   __m256i m;
+
+   m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\''));
+   if (backslashes)
+     m = _mm256_or_si256(m, _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')),
+                                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))),
+                                            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')))));
+   return _mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static size_t
+esql_escape_len_avx2(Eina_Bool   backslashes,
+                     const char *s)
+{
+   const char *p;
+   unsigned int z, m;
+   size_t n = 0;
+   __m256i v;
+
+   for (p = s; (uintptr_t)p & 31; p++)
+     {
+        if (!*p) return n;
+        n += esql_escape_char(backslashes, *p) ? 2 : 1;
+     }
+   for (;; p += 32)
+     {
+        v = _mm256_load_si256((const __m256i *)p);
+        z = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        m = esql_escape_mask_avx2(v, backslashes);
+        if (z)
+          {
+             z = __builtin_ctz(z);
+             return n + z + __builtin_popcount(m & ((1U << z) - 1));
+          }
+        n += 32 + __builtin_popcount(m);
+     }
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static char *
+esql_escape_write_avx2(Eina_Bool   backslashes,
+                       char       *rp,
+                       const char *s)
+{
+   const char *p;
+   unsigned int z, m;
+   __m256i v;
+
+   for (p = s; (uintptr_t)p & 31; p++)
+     {
+        if (!*p) return rp;
+        rp = esql_escape_bytes(backslashes, rp, p, 1);
+     }
+   for (;; p += 32)
+     {
+        v = _mm256_load_si256((const __m256i *)p);
+        z = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        m = esql_escape_mask_avx2(v, backslashes);
+        if (!(z | m))
+          {
+             _mm256_storeu_si256((__m256i *)rp, v);
+             rp += 32;
+             continue;
+          }
+        if (z) return esql_escape_bytes(backslashes, rp, p, __builtin_ctz(z));
+        rp = esql_escape_bytes(backslashes, rp, p, 32);
+     }
+}
+#endif
+
+static Esql_Escape_Len esql_escape_len = esql_escape_len_scalar;
+static Esql_Escape_Write esql_escape_write = esql_escape_write_scalar;
+
+/* picks the fastest implementation the cpu supports */
+void
+esql_escape_init(void)
+{
+#ifdef ESQL_ESCAPE_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+     {
+        esql_escape_len = esql_escape_len_avx2;
+        esql_escape_write = esql_escape_write_avx2;
+        DBG("Escaping strings with AVX2");
+     }
+   else if (__builtin_cpu_supports("sse2"))
+     {
+        esql_escape_len = esql_escape_len_sse2;
+        esql_escape_write = esql_escape_write_sse2;
+        DBG("Escaping strings with SSE2");
+     }
+#endif
+}
+
+/* length of @p s once escaped */
+size_t
+esql_string_escape_len(Eina_Bool   backslashes,
+                       const char *s)
+{
+   return esql_escape_len(backslashes, s);
+}
+
+/* escapes @p s into @p rp, which must hold esql_string_escape_len() bytes, and returns the end of the copy */
+char *
+esql_string_escape_write(Eina_Bool   backslashes,
+                         char       *rp,
+                         const char *s)
+{
+   return esql_escape_write(backslashes, rp, s);
+}
+
+EAPI char *
+esql_string_escape(Eina_Bool   backslashes,
+                   const char *s)
+{
+   char *ret;
+
+   if (!s) return NULL;
+   ret = malloc(esql_string_escape_len(backslashes, s) + 1);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ret, NULL);
+   *esql_string_escape_write(backslashes, ret, s) = 0;
+   return ret;
+}
@@ -17,81 +17,105 @@
 
 #include "esql_private.h"
 
-#define UPDATE_LISTS(TYPE) do {                                                                          \
-       if (e->backend_set_funcs && (e->backend_set_funcs->data == esql_##TYPE))                          \
-         {                                                                                               \
-            free(e->backend_set_params->data);                          \
-            e->backend_set_funcs = eina_list_remove_list(e->backend_set_funcs, e->backend_set_funcs);    \
-            e->backend_set_params = eina_list_remove_list(e->backend_set_params, e->backend_set_params); \
-            e->backend_ids = eina_list_remove_list(e->backend_ids, e->backend_ids);                      \
-            if (e->pool_member) INFO("Pool member %u: %d calls queued", e->pool_id, eina_list_count(e->backend_ids)); \
-            else INFO("%d calls queued", eina_list_count(e->backend_ids));                               \
-         }                                                                                               \
-  } while (0)
-
 static void
-esql_next(Esql *e)
+esql_next_call(Esql *e)
 {
-   Esql_Set_Cb cb;
+   Esql_Call call;
+   Eina_Bool pooled = EINA_FALSE;
 
    e->current = ESQL_CONNECT_TYPE_NONE;
-   if (!e->backend_set_funcs)
+   /* a pipelined query was sent already, its results are next on the connection */
+   if (esql_call_shift(&e->pipeline.sent, &call))
      {
-        if (e->pool_member)
-          {
-             if (!esql_pool_rebalance(e->pool_struct, e))
-               {
-                  INFO("Pool member %u is now idle", e->pool_id);
-                  return;
-               }
-          }
-        else
+        DBG("(e=%p, qid=%u): next pipelined query", e, call.id);
+        e->query_start = call.sent;
+        e->query_wait = call.sent - call.queued;
+        e->cur_row_cb = NULL; /* only plain queries are pipelined */
+        e->cur_params = NULL;
+        e->current = ESQL_CONNECT_TYPE_QUERY;
+        e->cur_data = call.data;
+        e->cur_cb = call.callback;
+        e->cur_id = call.id;
+        e->cur_query = call.query;
+        esql_pipeline_fill(e);
+        esql_connect_handler(e, e->fdh);
+        return;
+     }
+   /* next call: own calls first, then whatever is waiting on the pool */
+   if (esql_call_shift(&e->calls, &call))
+     {
+        if (e->pool_member) INFO("Pool member %u: %u calls queued", e->pool_id, e->calls.count);
+        else INFO("%u calls queued", e->calls.count);
+     }
+   else if (e->pool_member)
+     {
+        if ((!e->connected) || (!esql_pool_call_take(e->pool_struct, &call)))
           {
-             INFO("No calls queued");
+             INFO("Pool member %u is now idle", e->pool_id);
              return;
           }
+        INFO("Pool member %u: took query (%u), %u calls queued on pool", e->pool_id, call.id, e->pool_struct->calls.count);
+        pooled = EINA_TRUE; /* its wait is accounted by the pool */
+     }
+   else
+     {
+        INFO("No calls queued");
+        return;
      }
-   /* next call */
-   cb = e->backend_set_funcs->data;
-   if (cb == (Esql_Set_Cb)esql_database_set)
+   if (call.type == ESQL_CONNECT_TYPE_DATABASE_SET)
      {
-        cb(e, e->backend_set_params->data);
-        UPDATE_LISTS(database_set);
+        esql_database_set(e, call.query);
+        free(call.query);
         if (e->pool_member)
           INFO("Pool member %u: next call: DB change", e->pool_id);
         else
           INFO("Next call: DB change");
      }
-   else if (cb == (Esql_Set_Cb)esql_query)
-     { /* don't use cb, leads to unnecessary calls and breakage */
-        void *data;
-
-        data = eina_hash_find(esql_query_data, &e->backend_ids->data);
-        DBG("(e=%p, query=\"%s\")", e, (char*)e->backend_set_params->data);
+   else
+     {
+        DBG("(e=%p, query=\"%s\")", e, call.query);
         e->query_start = ecore_time_get();
-        e->backend.query(e, e->backend_set_params->data, strlen((char*)e->backend_set_params->data));
+        e->query_wait = e->query_start - call.queued;
+        if (!pooled) esql_histogram_add(&e->stats.queue_wait, e->query_wait);
+        esql_stats_send(e, call.len, call.params);
+        e->cur_row_cb = call.row_callback; /* backends check it when sending */
+        e->cur_params = call.params;
+        if (call.params)
+          {
+             e->error = NULL;
+             if (!esql_stmt_send(e, call.query, call.len, call.params))
+               e->error = e->backend.error_get(e) ?: "Could not prepare statement";
+          }
+        else
+          e->backend.query(e, call.query, call.len);
         e->current = ESQL_CONNECT_TYPE_QUERY;
-        e->cur_data = data;
-        e->cur_id = (Esql_Query_Id)((uintptr_t)e->backend_ids->data);
-        e->cur_query = e->backend_set_params->data;
-        e->backend_set_params->data = NULL;
-        if (data) eina_hash_del_by_key(esql_query_data, &e->backend_ids->data);
-        UPDATE_LISTS(query);
+        e->cur_data = call.data;
+        e->cur_cb = call.callback;
+        e->cur_id = call.id;
+        e->cur_query = call.query;
         if (e->pool_member)
           INFO("Pool member %u: next call: query", e->pool_id);
         else
           INFO("Next call: query");
-        e->error = e->backend.error_get(e);
+        if (!call.params) e->error = e->backend.error_get(e);
         if (e->error)
           {
              ERR("%s", e->error);
              esql_event_error(e);
              return;
           }
+        esql_pipeline_fill(e);
      }
    esql_connect_handler(e, e->fdh); /* have to call again to start next call */
 }
 
+static void
+esql_next(Esql *e)
+{
+   esql_next_call(e);
+   if (e->pool_member) esql_pool_member_update(e);
+}
+
 void
 esql_call_complete(Esql *e)
 {
@@ -138,9 +162,13 @@ esql_call_complete(Esql *e)
       case ESQL_CONNECT_TYPE_QUERY:
         DBG("(ev=%p, qid=%u)", ev, e->cur_id);
         e->query_end = ecore_time_get();
+        free(e->cur_params); /* only needed until the query has been sent */
+        e->cur_params = NULL;
         {
            Esql_Res *res;
            Esql_Query_Cb qcb;
+           Esql_Slow_Log *slow;
+           double t;
 
            if (e->res)
              res = e->res;
@@ -151,20 +179,33 @@ esql_call_complete(Esql *e)
                 res->e = e;
                 e->backend.res(res);
              }
+           esql_stats_done(e, !!res->error);
+           if (e->cur_row_cb)
+             {
+                /* hand over the last batch, the final result only carries the totals */
+                esql_res_stream_flush(res);
+                res->row_count = res->streamed;
+                e->cur_row_cb = NULL;
+             }
            ev->res = res;
+           res->conn = e;
            res->e = ev;
            res->refcount = 1;
            res->query = e->cur_query;
            e->cur_query = NULL;
            res->data = e->cur_data;
            res->qid = e->cur_id;
-           qcb = eina_hash_find(esql_query_callbacks, &e->cur_id);
+           slow = e->pool_member ? &e->pool_struct->slow : &e->slow;
+           if ((slow->threshold > 0) && (e->query_end - e->query_start > slow->threshold))
+             esql_slow_query_record(slow, e, res->query, res->row_count, res->error);
+           qcb = esql_query_callback_take(e);
            if (qcb)
              {
                 INFO("Executing callback for current query (%u)", res->qid);
+                t = ecore_time_get();
                 qcb(res, e->cur_data);
+                esql_histogram_add(&e->stats.callback, ecore_time_get() - t);
                 e->query_start = e->query_end = 0.0;
-                eina_hash_del_by_key(esql_query_callbacks, &e->cur_id);
                 esql_res_free(NULL, res);
              }
            else
@@ -213,14 +254,16 @@ error:
    return EINA_FALSE;
 }
 
-void
-esql_event_error(Esql *e)
+/* fails the current operation of @p e with @p error */
+static void
+esql_event_fail(Esql       *e,
+                const char *error)
 {
    Esql *ev;
 
-   DBG("(e=%p)", e);
+   DBG("(e=%p, error=%s)", e, error);
    ev = e->pool_member ? (Esql *)e->pool_struct : e; /* use pool struct for events */
-   e->error = e->backend.error_get(e);
+   e->error = error;
    e->query_end = ecore_time_get();
    if (e->pool_member)
      {
@@ -230,16 +273,26 @@ esql_event_error(Esql *e)
      }
    if (e->current == ESQL_CONNECT_TYPE_QUERY)
      {
+        Esql_Slow_Log *slow;
         Esql_Query_Cb qcb;
 
-        qcb = eina_hash_find(esql_query_callbacks, &e->cur_id);
+        esql_stats_done(e, EINA_TRUE);
+        slow = e->pool_member ? &e->pool_struct->slow : &e->slow;
+        if ((slow->threshold > 0) && (e->query_end - e->query_start > slow->threshold))
+          esql_slow_query_record(slow, e, e->cur_query, 0, error);
+        e->cur_row_cb = NULL;
+        free(e->cur_params);
+        e->cur_params = NULL;
+        qcb = esql_query_callback_take(e);
         if (qcb)
           {
              Esql_Res *res;
+             double t;
 
              res = esql_res_calloc(1);
              EINA_SAFETY_ON_NULL_RETURN(res);
              res->refcount = 1;
+             res->conn = e;
              res->e = ev;
              res->data = e->cur_data;
              res->qid = e->cur_id;
@@ -255,35 +308,48 @@ esql_event_error(Esql *e)
                ERR("Connection error: %s", res->error);
 
              INFO("Executing callback for current query (%u)", res->qid);
+             t = ecore_time_get();
              qcb(res, e->cur_data);
+             esql_histogram_add(&e->stats.callback, ecore_time_get() - t);
 
              e->query_start = e->query_end = 0.0;
-             eina_hash_del_by_key(esql_query_callbacks, &e->cur_id);
              esql_res_free(NULL, res);
           }
-        if (!ecore_main_fd_handler_active_get(e->fdh, ECORE_FD_ERROR))
+        if ((!e->backend.broken) && (!ecore_main_fd_handler_active_get(e->fdh, ECORE_FD_ERROR)))
           {
              esql_next(e);
              return;
           }
+        ecore_event_add(ESQL_EVENT_ERROR, ev, (Ecore_End_Cb)esql_fake_free, NULL);
+        e->event_count++;
+        /* the connection is gone, and with it the results of everything pipelined */
+        esql_pipeline_fail(e, error);
      }
    else
      {
         if (ev->connect_cb)
           ev->connect_cb(ev, ev->connect_cb_data);
+        ecore_event_add(ESQL_EVENT_ERROR, ev, (Ecore_End_Cb)esql_fake_free, NULL);
+        e->event_count++;
      }
-   ecore_event_add(ESQL_EVENT_ERROR, ev, (Ecore_End_Cb)esql_fake_free, NULL);
-   e->event_count++;
 
    esql_disconnect(e);
    if (e->reconnect) e->reconnect_timer = ecore_timer_add(1.0, (Ecore_Task_Cb)esql_reconnect_handler, e);
 }
 
+void
+esql_event_error(Esql *e)
+{
+   esql_event_fail(e, e->backend.error_get(e));
+}
+
 Eina_Bool
 esql_connect_handler(Esql             *e,
                      Ecore_Fd_Handler *fdh)
 {
    int ret;
+
+   esql_log_level_update();
    DBG("(e=%p, fdh=%p, qid=%u)", e, fdh, e->cur_id);
 
    if (fdh)
@@ -325,6 +391,15 @@ Eina_Bool
 esql_timeout_cb(Esql *e)
 {
    e->timeout_timer = NULL;
+   /* the result will never be read: fail the query like any other error, and with it
+    * the connection
+    */
+   if (e->current == ESQL_CONNECT_TYPE_QUERY)
+     {
+        e->backend.broken = EINA_TRUE;
+        esql_event_fail(e, "Query timed out");
+        return EINA_FALSE;
+     }
    esql_disconnect(e);
    if (e->reconnect) e->reconnect_timer = ecore_timer_add(1.0, (Ecore_Task_Cb)esql_reconnect_handler, e);
    return EINA_FALSE;
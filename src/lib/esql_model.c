@@ -62,15 +62,12 @@ _esql_query_create_table_cb(Esql_Res *res EINA_UNUSED, void *data)
    snprintf(query, total_len, "ALTER TABLE %s ADD COLUMN %s %s",
             priv->table_name, priv->row.row_name, priv->row.type);
 
-   Esql_Query_Id id = esql_query(priv->e, data, (const char *)query);
+   Esql_Query_Id id = esql_query_full(priv->e, (const char *)query, _esql_query_alter_table_cb, data);
    ret = (id == 0) ? EINA_FALSE : EINA_TRUE;
    EINA_SAFETY_ON_FALSE_GOTO(ret, cleanup);
 
    fprintf(stdout, "Trying to execute query id %d: %s\n", id, query);
 
-   ret = esql_query_callback_set(id, _esql_query_alter_table_cb);
-   EINA_SAFETY_ON_FALSE_GOTO(ret, cleanup);
-
 cleanup:
    free(query);
 }
@@ -235,10 +232,9 @@ _esql_model_table_add(Eo *obj EINA_UNUSED, Esql_Model_Data *pd, const char *tabl
    priv->row.row_name = row.row_name;
    priv->row.type = row.type;
 
-   Esql_Query_Id id = esql_query(priv->e, priv, (const char *)query);
-   Eina_Bool ret = esql_query_callback_set(id, _esql_query_create_table_cb);
-   if(ret != EINA_TRUE)
-     ERR("Error: esql_query_callback_set()\n");
+   Esql_Query_Id id = esql_query_full(priv->e, (const char *)query, _esql_query_create_table_cb, priv);
+   if(!id)
+     ERR("Error: esql_query_full()\n");
 
    free(query);
 
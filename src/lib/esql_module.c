@@ -17,16 +17,42 @@
 
 #include "esql_module.h"
 
-static void esql_module_desc_free(const Eina_Value_Struct_Operations *ops, const Eina_Value_Struct_Desc *desc, void *memory);
+/* descs are shared by every result with the same backend and column layout */
+#define ESQL_DESC_CACHE_BUCKETS  64 /* must be a power of 2 */
+#define ESQL_DESC_CACHE_IDLE_MAX 128 /* unused descs kept for reuse */
+/* members set up on the stack before the cache lookup, more go to the heap */
+#define ESQL_DESC_STACK_COLS     32
+
+typedef struct Esql_Struct_Desc Esql_Struct_Desc;
+
+struct Esql_Struct_Desc
+{
+   Eina_Value_Struct_Desc   desc; /* must be first */
+   EINA_INLIST; /* idle list, only while refcount is 0 */
+   Esql_Struct_Desc        *next; /* hash bucket */
+   Esql_Type                type;
+   unsigned int             hash;
+   int                      refcount;
+   Eina_Value_Struct_Member members[];
+};
+
 static void *esql_module_desc_alloc(const Eina_Value_Struct_Operations *ops, const Eina_Value_Struct_Desc *desc);
+static void esql_module_desc_free(const Eina_Value_Struct_Operations *ops, const Eina_Value_Struct_Desc *desc, void *memory);
 static const Eina_Value_Struct_Member *esql_module_desc_find_member(const Eina_Value_Struct_Operations *ops, const Eina_Value_Struct_Desc *desc, const char *name);
 
-typedef struct Esql_Struct_Desc
-{
-   Eina_Value_Struct_Desc desc;
-   Esql_Res *res;
-} Esql_Struct_Desc;
+/* descs are built on the sqlite thread too, so the cache is locked */
+static Eina_Lock esql_desc_lock;
+static Esql_Struct_Desc *esql_desc_buckets[ESQL_DESC_CACHE_BUCKETS];
+static Eina_Inlist *esql_desc_idle = NULL; /* least recently used first */
+static unsigned int esql_desc_idle_count = 0;
+static unsigned int esql_desc_count = 0; /* cached descs, idle or not */
+/* set when descs were still referenced at shutdown: the last one to go frees the lock */
+static Eina_Bool esql_desc_orphaned = EINA_FALSE;
 
+/* row memory lives in the result arena and is never allocated through the desc,
+ * so only copies made by users (eina_value_copy()) go through these, and they
+ * hold a reference on the desc for as long as the copy lives
+ */
 static Eina_Value_Struct_Operations esql_module_desc_ops = {
   EINA_VALUE_STRUCT_OPERATIONS_VERSION,
   esql_module_desc_alloc,
@@ -36,26 +62,116 @@ static Eina_Value_Struct_Operations esql_module_desc_ops = {
   esql_module_desc_find_member
 };
 
+static unsigned int
+esql_module_desc_hash(Esql_Type type, const Eina_Value_Struct_Member *members, unsigned int count)
+{
+   unsigned int hash = 5381 + type, i;
+
+   /* names are stringshared and types are static, so pointers identify them */
+   for (i = 0; i < count; i++)
+     {
+        hash = (hash * 33) ^ (unsigned int)((uintptr_t)members[i].name >> 3);
+        hash = (hash * 33) ^ (unsigned int)((uintptr_t)members[i].type >> 3);
+     }
+   return hash;
+}
+
+static Eina_Bool
+esql_module_desc_match(const Esql_Struct_Desc *sd, Esql_Type type, unsigned int hash, const Eina_Value_Struct_Member *members, unsigned int count)
+{
+   unsigned int i;
+
+   if ((sd->hash != hash) || (sd->type != type) || (sd->desc.member_count != count))
+     return EINA_FALSE;
+   for (i = 0; i < count; i++)
+     if ((sd->members[i].name != members[i].name) || (sd->members[i].type != members[i].type))
+       return EINA_FALSE;
+   return EINA_TRUE;
+}
+
+/* must be called with the lock held */
+static void
+esql_module_desc_del(Esql_Struct_Desc *sd)
+{
+   Esql_Struct_Desc **p;
+   unsigned int i;
+
+   for (p = &esql_desc_buckets[sd->hash & (ESQL_DESC_CACHE_BUCKETS - 1)]; *p; p = &(*p)->next)
+     if (*p == sd)
+       {
+          *p = sd->next;
+          break;
+       }
+   for (i = 0; i < sd->desc.member_count; i++)
+     eina_stringshare_del(sd->members[i].name);
+   free(sd);
+   esql_desc_count--;
+}
+
+static void
+esql_module_desc_ref(const Eina_Value_Struct_Desc *desc)
+{
+   Esql_Struct_Desc *sd = (Esql_Struct_Desc *)desc;
+
+   eina_lock_take(&esql_desc_lock);
+   if (!sd->refcount++)
+     {
+        esql_desc_idle = eina_inlist_remove(esql_desc_idle, EINA_INLIST_GET(sd));
+        esql_desc_idle_count--;
+     }
+   eina_lock_release(&esql_desc_lock);
+}
+
+void
+esql_module_desc_unref(Eina_Value_Struct_Desc *desc)
+{
+   Esql_Struct_Desc *sd = (Esql_Struct_Desc *)desc;
+
+   if (!desc) return;
+   eina_lock_take(&esql_desc_lock);
+   if ((!--sd->refcount) && esql_desc_orphaned)
+     {
+        esql_module_desc_del(sd);
+        if (!esql_desc_count)
+          {
+             esql_desc_orphaned = EINA_FALSE;
+             eina_lock_release(&esql_desc_lock);
+             eina_lock_free(&esql_desc_lock);
+             /* drop the eina reference taken by esql_module_desc_shutdown() */
+             eina_shutdown();
+             return;
+          }
+     }
+   else if (!sd->refcount)
+     {
+        esql_desc_idle = eina_inlist_append(esql_desc_idle, EINA_INLIST_GET(sd));
+        if (++esql_desc_idle_count > ESQL_DESC_CACHE_IDLE_MAX)
+          {
+             Esql_Struct_Desc *old = EINA_INLIST_CONTAINER_GET(esql_desc_idle, Esql_Struct_Desc);
+
+             esql_desc_idle = eina_inlist_remove(esql_desc_idle, esql_desc_idle);
+             esql_desc_idle_count--;
+             esql_module_desc_del(old);
+          }
+     }
+   eina_lock_release(&esql_desc_lock);
+}
+
 static void *
 esql_module_desc_alloc(const Eina_Value_Struct_Operations *ops EINA_UNUSED, const Eina_Value_Struct_Desc *desc)
 {
-   Esql_Res *res;
+   void *memory;
 
-   res = *(Esql_Res**)(((char*)desc) + desc->member_count * sizeof(Eina_Value_Struct_Member) + offsetof(Esql_Struct_Desc, res));
-   if (res->mempool)
-     return eina_mempool_malloc(res->mempool, desc->size);
-   return malloc(desc->size);
+   memory = malloc(desc->size);
+   if (memory) esql_module_desc_ref(desc);
+   return memory;
 }
 
 static void
 esql_module_desc_free(const Eina_Value_Struct_Operations *ops EINA_UNUSED, const Eina_Value_Struct_Desc *desc, void *memory)
 {
-   Esql_Res *res;
-
-   res = *(Esql_Res**)(((char*)desc) + desc->member_count * sizeof(Eina_Value_Struct_Member) + offsetof(Esql_Struct_Desc, res));
-   if (res->mempool)
-     return eina_mempool_free(res->mempool, memory);
    free(memory);
+   esql_module_desc_unref((Eina_Value_Struct_Desc *)desc);
 }
 
 static const Eina_Value_Struct_Member *
@@ -86,43 +202,131 @@ esql_module_desc_find_member(const Eina_Value_Struct_Operations *ops EINA_UNUSED
    return NULL;
 }
 
+/* returns a referenced desc for the columns of @p res, shared with earlier results of the same layout */
 Eina_Value_Struct_Desc *
 esql_module_desc_get(int cols, Esql_Module_Setup_Cb setup_cb, Esql_Res *res)
 {
-   Eina_Value_Struct_Desc *desc;
+   Eina_Value_Struct_Member stack[ESQL_DESC_STACK_COLS], *members;
+   Esql_Struct_Desc *sd;
+   Esql_Type type;
+   unsigned int offset, hash;
    int i;
-   unsigned int offset;
 
    if (cols < 1) return NULL;
    if ((!setup_cb) || (!res)) return NULL;
 
-   desc = malloc(sizeof(Esql_Struct_Desc) + cols * sizeof(Eina_Value_Struct_Member));
-   EINA_SAFETY_ON_NULL_RETURN_VAL(desc, NULL);
-
-   desc->version = EINA_VALUE_STRUCT_DESC_VERSION;
-   desc->ops = &esql_module_desc_ops;
-   desc->members = (void *)((char *)desc + sizeof(*desc));
-   desc->member_count = cols;
-   desc->size = 0;
-   *(Esql_Res**)(((char*)desc) + cols * sizeof(Eina_Value_Struct_Member) + offsetof(Esql_Struct_Desc, res)) = res;
+   members = (cols <= ESQL_DESC_STACK_COLS) ? stack : malloc(cols * sizeof(Eina_Value_Struct_Member));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(members, NULL);
 
    offset = 0;
    for (i = 0; i < cols; i++)
      {
-        Eina_Value_Struct_Member *m = (Eina_Value_Struct_Member *)desc->members + i;
+        Eina_Value_Struct_Member *m = members + i;
         unsigned int size;
 
         m->offset = offset;
         setup_cb(res->backend.res, i, m);
 
+        /* keep every member pointer aligned, cells are written in place */
         size = m->type->value_size;
         if (size % sizeof(void *) != 0)
-          size += size - (size % sizeof(void *));
+          size += sizeof(void *) - (size % sizeof(void *));
 
         offset += size;
      }
 
-   desc->size = offset;
-   res->mempool = esql_mempool_new(desc->size);
-   return desc;
+   type = res->e->type;
+   hash = esql_module_desc_hash(type, members, cols);
+
+   eina_lock_take(&esql_desc_lock);
+   for (sd = esql_desc_buckets[hash & (ESQL_DESC_CACHE_BUCKETS - 1)]; sd; sd = sd->next)
+     if (esql_module_desc_match(sd, type, hash, members, cols)) break;
+
+   if (sd)
+     {
+        if (!sd->refcount++)
+          {
+             esql_desc_idle = eina_inlist_remove(esql_desc_idle, EINA_INLIST_GET(sd));
+             esql_desc_idle_count--;
+          }
+        eina_lock_release(&esql_desc_lock);
+        /* the cached desc already holds these names */
+        for (i = 0; i < cols; i++)
+          eina_stringshare_del(members[i].name);
+     }
+   else
+     {
+        sd = malloc(sizeof(Esql_Struct_Desc) + cols * sizeof(Eina_Value_Struct_Member));
+        if (sd)
+          {
+             sd->desc.version = EINA_VALUE_STRUCT_DESC_VERSION;
+             sd->desc.ops = &esql_module_desc_ops;
+             sd->desc.members = sd->members;
+             sd->desc.member_count = cols;
+             sd->desc.size = offset;
+             memcpy(sd->members, members, cols * sizeof(Eina_Value_Struct_Member));
+             sd->type = type;
+             sd->hash = hash;
+             sd->refcount = 1;
+             esql_desc_count++;
+             sd->next = esql_desc_buckets[hash & (ESQL_DESC_CACHE_BUCKETS - 1)];
+             esql_desc_buckets[hash & (ESQL_DESC_CACHE_BUCKETS - 1)] = sd;
+          }
+        eina_lock_release(&esql_desc_lock);
+        if (!sd)
+          {
+             ERR("Could not allocate desc for %d columns", cols);
+             for (i = 0; i < cols; i++)
+               eina_stringshare_del(members[i].name);
+          }
+     }
+
+   if (members != stack) free(members);
+   return sd ? &sd->desc : NULL;
+}
+
+Eina_Bool
+esql_module_desc_init(void)
+{
+   /* descs of the previous init are still referenced, and so is the lock;
+    * init and shutdown run on the main loop, where results are released too.
+    * esql_init() holds its own eina reference again, so drop the orphans' one.
+    */
+   if (esql_desc_orphaned)
+     {
+        eina_lock_take(&esql_desc_lock);
+        esql_desc_orphaned = EINA_FALSE;
+        eina_lock_release(&esql_desc_lock);
+        eina_shutdown();
+        return EINA_TRUE;
+     }
+   return eina_lock_new(&esql_desc_lock);
+}
+
+void
+esql_module_desc_shutdown(void)
+{
+   Esql_Struct_Desc *sd;
+
+   eina_lock_take(&esql_desc_lock);
+   while (esql_desc_idle)
+     {
+        sd = EINA_INLIST_CONTAINER_GET(esql_desc_idle, Esql_Struct_Desc);
+        esql_desc_idle = eina_inlist_remove(esql_desc_idle, esql_desc_idle);
+        esql_module_desc_del(sd);
+     }
+   esql_desc_idle_count = 0;
+   if (esql_desc_count)
+     {
+        /* copies of row values may outlive the lib, the last of them frees the lock;
+         * keep eina up until then since freeing a desc needs stringshare
+         */
+        WARN("%u result descs still referenced at shutdown", esql_desc_count);
+        esql_desc_orphaned = EINA_TRUE;
+        eina_init();
+        eina_lock_release(&esql_desc_lock);
+        return;
+     }
+   eina_lock_release(&esql_desc_lock);
+   eina_lock_free(&esql_desc_lock);
 }
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2011, 2012, 2013, 2014 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esql_private.h"
+#include <ctype.h>
+#include <string.h>
+
+/*
+ * with a pipeline, queries queued behind the current one are handed to the
+ * backend right away instead of waiting for the current result: they move
+ * from the call queue to the sent queue, and when the current query completes
+ * the head of the sent queue becomes current without anything being sent.
+ * results are still delivered strictly in order, one query at a time.
+ * only plain queries are sent ahead: streams and prepared statements need
+ * the connection to themselves, so they wait until it is drained.
+ */
+
+/* returns EINA_TRUE if @p query holds a single statement; a semicolon anywhere but
+ * at its end, even quoted, rules it out
+ */
+static Eina_Bool
+esql_pipeline_single(const char  *query,
+                     unsigned int len)
+{
+   while (len && ((query[len - 1] == ';') || isspace((unsigned char)query[len - 1])))
+     len--;
+   return !memchr(query, ';', len);
+}
+
+/* returns EINA_TRUE if the call queued first on @p e may be sent behind its current query,
+ * which lets backends send the current query the way pipelined ones need
+ */
+Eina_Bool
+esql_pipeline_next_ok(const Esql *e)
+{
+   const Esql_Call *call;
+
+   if ((e->pipeline.max < 2) || (!e->backend.pipeline)) return EINA_FALSE;
+   call = esql_call_peek(&e->calls);
+   if ((!call) || (call->type != ESQL_CONNECT_TYPE_QUERY)) return EINA_FALSE;
+   if (call->row_callback || call->params) return EINA_FALSE;
+   return esql_pipeline_single(call->query, call->len);
+}
+
+/* tops up the pipeline of @p e from its call queue */
+void
+esql_pipeline_fill(Esql *e)
+{
+   Esql_Call *call, *sent;
+   double now;
+
+   if ((e->current != ESQL_CONNECT_TYPE_QUERY) || e->cur_row_cb || e->cur_params) return;
+
+   while ((e->pipeline.sent.count + 1 < e->pipeline.max) && esql_pipeline_next_ok(e))
+     {
+        call = esql_call_peek(&e->calls);
+        sent = esql_call_push(&e->pipeline.sent);
+        if (!sent) return;
+        if (!e->backend.pipeline(e, call->query, call->len))
+          {
+             /* the call stays queued until the connection is idle */
+             esql_call_pop(&e->pipeline.sent);
+             return;
+          }
+        esql_call_shift(&e->calls, sent);
+        now = ecore_time_get();
+        esql_histogram_add(&e->stats.queue_wait, now - sent->queued);
+        esql_stats_send(e, sent->len, NULL);
+        sent->sent = now;
+        DBG("(e=%p, qid=%u): pipelined, %u queries in flight", e, sent->id, e->pipeline.sent.count + 1);
+     }
+}
+
+/* the connection was lost: fails every query sent behind the current one,
+ * like esql_event_error() fails the current one
+ */
+void
+esql_pipeline_fail(Esql       *e,
+                   const char *error)
+{
+   Esql *ev;
+   Esql_Call call;
+   Esql_Query_Cb qcb;
+   Esql_Res *res;
+
+   ev = e->pool_member ? (Esql *)e->pool_struct : e;
+   while (esql_call_shift(&e->pipeline.sent, &call))
+     {
+        e->stats.failed++;
+        free(call.params);
+        ERR("Pipelined query (%u) failed: %s", call.id, error);
+        qcb = esql_call_callback_take(&call);
+        res = qcb ? esql_res_calloc(1) : NULL;
+        if (!res)
+          {
+             free(call.query);
+             ev->error = error;
+             ecore_event_add(ESQL_EVENT_ERROR, ev, (Ecore_End_Cb)esql_fake_free, NULL);
+             e->event_count++;
+             continue;
+          }
+        res->refcount = 1;
+        res->conn = e;
+        res->e = ev;
+        res->data = call.data;
+        res->qid = call.id;
+        res->query = call.query;
+        res->error = error;
+        INFO("Executing callback for pipelined query (%u)", res->qid);
+        qcb(res, call.data);
+        esql_res_free(NULL, res);
+     }
+}
+
+/* forgets the queries in flight, their results will never be read */
+void
+esql_pipeline_clear(Esql *e)
+{
+   Esql_Call call;
+
+   while (esql_call_shift(&e->pipeline.sent, &call))
+     {
+        e->stats.failed++;
+        esql_call_callback_take(&call);
+        free(call.params);
+        free(call.query);
+     }
+}
+
+/**
+ * @defgroup Esql_Pipeline Pipelining
+ * @brief Functions to keep several queries in flight on a connection
+ * @{*/
+
+/**
+ * @brief Set how many queries a connection may have in flight
+ * By default a connection sends a query only once the result of the previous one
+ * has been received, so every query pays a full round trip to the server.
+ * With a depth above 1, plain queries made while the connection is busy are sent
+ * right away, up to @p depth queries in flight, and their results are delivered in order.
+ * Streamed queries, prepared statements and queries holding several statements are never
+ * sent ahead, they wait until the queries in flight have completed.
+ * Backends without support for pipelining ignore this setting.
+ * If the connection is lost, the queries in flight fail with their callbacks, or with
+ * #ESQL_EVENT_ERROR for those without one.
+ * @note With PostgreSQL, libpq's pipeline mode is used (each query being its own transaction,
+ * as usual); versions of libpq without it ignore this setting.
+ * @note With MySQL, the queries are written back-to-back and their responses decoded in order;
+ * a failed query does not affect the others.
+ * @param e The #Esql object (NOT NULL), pools are not supported
+ * @param depth The number of queries, 0 and 1 disable pipelining (default: 1)
+ */
+void
+esql_pipeline_set(Esql        *e,
+                  unsigned int depth)
+{
+   EINA_SAFETY_ON_NULL_RETURN(e);
+   /* pool members are only handed queries while they are idle */
+   EINA_SAFETY_ON_TRUE_RETURN(e->pool);
+
+   e->pipeline.max = depth ? depth : 1;
+   esql_pipeline_fill(e);
+}
+
+/**
+ * @brief Return how many queries a connection may have in flight
+ * @param e The #Esql object (NOT NULL)
+ * @return The pipeline depth, 1 if pipelining is disabled
+ */
+unsigned int
+esql_pipeline_get(const Esql *e)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(e->pool, 0);
+
+   return e->pipeline.max;
+}
+
+/** @} */
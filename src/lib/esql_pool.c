@@ -20,50 +20,80 @@
 static Esql *
 esql_pool_idle_find_(Esql_Pool *ep)
 {
-   Esql *e, *use = NULL;
-   double ti, cur = 0.0;
+   /* most recently idled connection first */
+   if (ep->idle_count) return ep->idle[ep->idle_count - 1];
+   return NULL;
+}
 
-   EINA_INLIST_FOREACH(ep->esqls, e)
+/* takes ownership of @p query and @p params */
+static Esql_Query_Id
+esql_pool_query_queue_(Esql_Pool    *ep,
+                       char         *query,
+                       unsigned int  len,
+                       Esql_Params  *params,
+                       Esql_Query_Cb row_cb,
+                       Esql_Query_Cb cb,
+                       void         *data)
+{
+   Esql_Call *call;
+
+   if (!query)
      {
-        if (!e->current) /* idle! */
-          return e;
+        free(params);
+        return 0;
      }
-   /* no free connections :( */
-   ti = ecore_time_get();
-   EINA_INLIST_FOREACH(ep->esqls, e)
+   call = esql_call_push(&ep->calls);
+   if (!call)
      {
-        if (ti - e->query_start > cur) /* assume older query start ti means faster return (obviously not always true) */
-          {
-             cur = ti - e->query_start;
-             use = e;
-          }
+        free(params);
+        free(query);
+        return 0;
      }
-   if (!use) /* this should never happen in a reasonable setting */
-     use = EINA_INLIST_CONTAINER_GET(ep->esqls, Esql);  /* use first one */
-   return use;
+   call->type = ESQL_CONNECT_TYPE_QUERY;
+   call->id = esql_query_id_new();
+   call->query = query;
+   call->len = len;
+   call->data = data;
+   call->callback = cb;
+   call->row_callback = row_cb;
+   call->params = params;
+   call->queued = ecore_time_get();
+   esql_stats_submit(&ep->stats, ep->calls.count);
+   INFO("No idle connections: %u calls queued on pool", ep->calls.count);
+   return call->id;
 }
 
-Eina_Bool
-esql_pool_rebalance(Esql_Pool *ep, Esql *e /* idle connection */)
+/* must be called whenever the connection state or queue depth of pool member @p e changes */
+void
+esql_pool_member_update(Esql *e)
 {
-   Esql *it;
+   Esql_Pool *ep = e->pool_struct;
+   Eina_Bool idle;
 
-   DBG("(ep=%p, e=%p)", ep, e);
-   EINA_INLIST_FOREACH(ep->esqls, it)
+   idle = e->connected && (!e->current) && (!e->calls.count);
+   if (idle && (e->pool_idle < 0))
      {
-        if (it->backend_set_funcs && (it->backend_set_funcs->data == (Esql_Set_Cb)esql_query)) /* queued call */
-          {
-             INFO("Load balancing: moving query (%u) from %u to %u", (Esql_Query_Id)((uintptr_t)it->backend_ids->data), it->pool_id, e->pool_id);
-             eina_list_move_list(&e->backend_set_funcs, &it->backend_set_funcs, it->backend_set_funcs);
-             eina_list_move_list(&e->backend_set_params, &it->backend_set_params, it->backend_set_params);
-             eina_list_move_list(&e->backend_ids, &it->backend_ids, it->backend_ids);
-             INFO("Current queue:  #%u:(%u):%i | #%u:(%u):%i", e->pool_id, (Esql_Query_Id)((uintptr_t)e->backend_ids->data), eina_list_count(e->backend_ids),
-               it->pool_id, it->backend_ids ? (Esql_Query_Id)((uintptr_t)it->backend_ids->data) : 0, eina_list_count(it->backend_ids));
-             return EINA_TRUE;
-          }
+        e->pool_idle = ep->idle_count;
+        ep->idle[ep->idle_count++] = e;
      }
-   INFO("No rebalancing necessary");
-   return EINA_FALSE;
+   else if ((!idle) && (e->pool_idle >= 0))
+     {
+        Esql *top = ep->idle[--ep->idle_count];
+
+        ep->idle[e->pool_idle] = top;
+        top->pool_idle = e->pool_idle;
+        e->pool_idle = -1;
+     }
+}
+
+/* moves the oldest query waiting on the pool into @p call for a member which has run out of work */
+Eina_Bool
+esql_pool_call_take(Esql_Pool *ep,
+                    Esql_Call *call)
+{
+   if (!esql_call_shift(&ep->calls, call)) return EINA_FALSE;
+   esql_histogram_add(&ep->stats.queue_wait, ecore_time_get() - call->queued);
+   return EINA_TRUE;
 }
 
 void
@@ -76,6 +106,9 @@ esql_pool_free(Esql_Pool *ep)
      esql_free(e);
 
    eina_stringshare_del(ep->database);
+   esql_call_queue_clear(&ep->calls, &ep->stats);
+   esql_slow_log_clear(&ep->slow);
+   free(ep->idle);
    free(ep);
 }
 
@@ -139,28 +172,52 @@ esql_pool_disconnect(Esql_Pool *ep)
 }
 
 Esql_Query_Id
-esql_pool_query_args(Esql_Pool  *ep,
-                     void       *data,
-                     const char *fmt,
-                     va_list     args)
+esql_pool_query_args(Esql_Pool    *ep,
+                     Esql_Query_Cb cb,
+                     void         *data,
+                     const char   *fmt,
+                     va_list       args)
+{
+   Esql *e;
+   char *query;
+   unsigned int len;
+
+   e = esql_pool_idle_find_(ep);
+   if (e) return esql_query_vargs_full(e, cb, data, fmt, args);
+   /* all members share a backend type, so any of them can do the escaping */
+   e = EINA_INLIST_CONTAINER_GET(ep->esqls, Esql);
+   query = e->backend.escape(e, &len, fmt, args);
+   return esql_pool_query_queue_(ep, query, len, NULL, NULL, cb, data);
+}
+
+Esql_Query_Id
+esql_pool_query(Esql_Pool    *ep,
+                const char   *query,
+                Esql_Query_Cb row_cb,
+                Esql_Query_Cb cb,
+                void         *data)
 {
    Esql *e;
 
    e = esql_pool_idle_find_(ep);
-   EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
-   return esql_query_vargs(e, data, fmt, args);
+   if (e) return esql_query_stream(e, query, row_cb, cb, data);
+   return esql_pool_query_queue_(ep, strdup(query), strlen(query), NULL, row_cb, cb, data);
 }
 
+/* takes ownership of @p params */
 Esql_Query_Id
-esql_pool_query(Esql_Pool  *ep,
-                void       *data,
-                const char *query)
+esql_pool_execute(Esql_Pool       *ep,
+                  const Esql_Stmt *stmt,
+                  Esql_Params     *params,
+                  Esql_Query_Cb    cb,
+                  void            *data)
 {
    Esql *e;
 
+   /* members prepare the statement in their own cache the first time they run it */
    e = esql_pool_idle_find_(ep);
-   EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
-   return esql_query(e, data, query);
+   if (e) return esql_query_send(e, strdup(stmt->sql), stmt->len, params, NULL, cb, data);
+   return esql_pool_query_queue_(ep, strdup(stmt->sql), stmt->len, params, NULL, cb, data);
 }
 
 void
@@ -200,6 +257,26 @@ esql_pool_reconnect_set(Esql_Pool *ep,
      e->reconnect = enable;
 }
 
+void
+esql_pool_columnar_set(Esql_Pool *ep,
+                       Eina_Bool  enable)
+{
+   Esql *e;
+
+   EINA_INLIST_FOREACH(ep->esqls, e)
+     e->columnar = !!enable;
+}
+
+void
+esql_pool_stmt_cache_size_set(Esql_Pool   *ep,
+                              unsigned int size)
+{
+   Esql *e;
+
+   EINA_INLIST_FOREACH(ep->esqls, e)
+     esql_stmt_cache_size_set(e, size);
+}
+
 /* API */
 
 /**
@@ -227,6 +304,8 @@ esql_pool_new(int       size,
    EINA_SAFETY_ON_TRUE_RETURN_VAL(type == ESQL_TYPE_NONE, NULL);
    ep = calloc(1, sizeof(Esql_Pool));
    EINA_SAFETY_ON_NULL_RETURN_VAL(ep, NULL);
+   ep->idle = malloc(size * sizeof(Esql *));
+   EINA_SAFETY_ON_NULL_GOTO(ep->idle, error);
 
    for (i = 0; i < size; i++)
      {
@@ -235,6 +314,7 @@ esql_pool_new(int       size,
         e->pool_member = EINA_TRUE;
         e->pool_struct = ep;
         e->pool_id = i;
+        e->pool_idle = -1;
         ep->esqls = eina_inlist_append(ep->esqls, EINA_INLIST_GET(e));
      }
    ep->pool = EINA_TRUE;
@@ -245,7 +325,7 @@ esql_pool_new(int       size,
 error:
    EINA_INLIST_FOREACH(ep->esqls, e)
      esql_free(e);
+   free(ep->idle);
    free(ep);
    return NULL;
 }
-
@@ -39,11 +39,34 @@ void *alloca(size_t);
 #endif
 
 extern EAPI int esql_log_dom;
+extern EAPI int esql_log_level;
 extern Eina_Hash *esql_query_callbacks;
-extern Eina_Hash *esql_query_data;
 
-#define DBG(...)            EINA_LOG_DOM_DBG(esql_log_dom, __VA_ARGS__)
-#define INFO(...)           EINA_LOG_DOM_INFO(esql_log_dom, __VA_ARGS__)
+/* default number of prepared statements kept by each connection */
+#define ESQL_STMT_CACHE_SIZE 32
+
+/* number of rows decoded before they are handed to a stream callback */
+#define ESQL_STREAM_BATCH 256
+#define ESQL_RES_STREAM_FULL(RES) ((RES)->e->cur_row_cb && ((RES)->row_count >= ESQL_STREAM_BATCH))
+
+/* the most verbose level built in, see --with-maximum-log-level */
+#ifndef ESQL_LOG_LEVEL_MAXIMUM
+# define ESQL_LOG_LEVEL_MAXIMUM EINA_LOG_LEVEL_DBG
+#endif
+
+/*
+ * DBG() and INFO() run several times per query: they compare against the level
+ * cached in esql_log_level before evaluating their arguments, and disappear
+ * entirely when built out
+ */
+#define ESQL_LOG(LEVEL, ...) \
+  do { \
+       if (((LEVEL) <= ESQL_LOG_LEVEL_MAXIMUM) && ((LEVEL) <= esql_log_level)) \
+         EINA_LOG(esql_log_dom, LEVEL, __VA_ARGS__); \
+  } while (0)
+
+#define DBG(...)            ESQL_LOG(EINA_LOG_LEVEL_DBG, __VA_ARGS__)
+#define INFO(...)           ESQL_LOG(EINA_LOG_LEVEL_INFO, __VA_ARGS__)
 #define WARN(...)           EINA_LOG_DOM_WARN(esql_log_dom, __VA_ARGS__)
 #define ERR(...)            EINA_LOG_DOM_ERR(esql_log_dom, __VA_ARGS__)
 #define CRI(...)            EINA_LOG_DOM_CRIT(esql_log_dom, __VA_ARGS__)
@@ -71,6 +94,67 @@ typedef enum
    ESQL_CONNECT_TYPE_QUERY
 } Esql_Connect_Type;
 
+typedef enum
+{
+   ESQL_PARAM_NULL,
+   ESQL_PARAM_INT64,
+   ESQL_PARAM_DOUBLE,
+   ESQL_PARAM_STRING
+} Esql_Param_Type;
+
+typedef struct Esql_Param
+{
+   Esql_Param_Type type;
+   unsigned int    len; /* string length */
+   union
+   {
+      int64_t     i;
+      double      d;
+      const char *s; /* NUL terminated */
+   } v;
+} Esql_Param;
+
+/* parameters of one prepared statement execution, a single allocation */
+typedef struct Esql_Params
+{
+   unsigned int count;
+   Esql_Param   params[]; /* followed by the string data */
+} Esql_Params;
+
+typedef struct Esql_Call
+{
+   Esql_Connect_Type type; /* ESQL_CONNECT_TYPE_DATABASE_SET or ESQL_CONNECT_TYPE_QUERY */
+   Esql_Query_Id     id;
+   char             *query; /* query string or database name, owned by the call */
+   unsigned int      len;
+   void             *data;
+   Esql_Query_Cb     callback; /* overrides the result event, NULL to use it */
+   Esql_Query_Cb     row_callback; /* streaming: called for each batch of rows */
+   Esql_Params      *params; /* query is a prepared statement, owned by the call */
+   double            queued; /* time the call was queued */
+   double            sent; /* time the call was sent on a pipeline */
+} Esql_Call;
+
+typedef struct Esql_Call_Queue
+{
+   Esql_Call   *calls; /* ring of queued calls */
+   unsigned int head;
+   unsigned int count;
+   unsigned int size; /* always a power of 2 */
+} Esql_Call_Queue;
+
+typedef struct Esql_Slow_Log
+{
+   double             threshold; /* 0 when disabled */
+   Esql_Slow_Query_Cb cb;
+   void              *cb_data;
+   Esql_Slow_Query  **ring; /* allocated on the first slow query */
+   unsigned int       head;
+   unsigned int       count;
+   unsigned int       size;
+   unsigned long long dropped; /* since the last pop */
+} Esql_Slow_Log;
+
 typedef const char           * (*Esql_Error_Cb)(Esql *);
 typedef void                   (*Esql_Cb)(Esql *);
 typedef int                    (*Esql_Connection_Cb)(Esql *);
@@ -81,6 +165,11 @@ typedef char                 * (*Esql_Escape_Cb)(Esql *, unsigned int *, const c
 typedef void                   (*Esql_Res_Cb)(Esql_Res *);
 typedef Esql_Row             * (*Esql_Row_Cb)(Esql_Res *);
 
+typedef void                 * (*Esql_Prepare_Cb)(Esql *, const char *, unsigned int);
+typedef Eina_Bool              (*Esql_Execute_Cb)(Esql *, void *, const Esql_Params *);
+typedef void                   (*Esql_Stmt_Free_Cb)(Esql *, void *);
+typedef Eina_Bool              (*Esql_Pipeline_Cb)(Esql *, const char *, unsigned int);
+
 typedef const char           * (*Esql_Row_Col_Name_Cb)(Esql_Row *);
 
 typedef Esql_Type              (*Esql_Module_Cb)(Esql *);
@@ -111,10 +200,16 @@ typedef struct Esql_Pool
    Eina_Bool       reconnect : 1;
    Eina_Bool       pool_member : 1;
    Eina_Bool       dead : 1;
+   Eina_Bool       columnar : 1;
    /* non-esql */
    int             size;
    int             e_connected;
    Eina_Inlist    *esqls;
+   Esql          **idle; /* stack of idle members */
+   unsigned int    idle_count;
+   Esql_Call_Queue calls; /* queries waiting for an idle member */
+   Esql_Stats      stats; /* queries made on the shared queue, the members keep their own */
+   Esql_Slow_Log   slow; /* shared by the members */
 } Esql_Pool;
 
 struct Esql
@@ -135,6 +230,7 @@ struct Esql
    Eina_Bool       reconnect : 1;
    Eina_Bool       pool_member : 1;
    Eina_Bool       dead : 1;
+   Eina_Bool       columnar : 1;
 
    struct
    {
@@ -156,10 +252,34 @@ struct Esql
       Esql_Escape_Cb     escape;
       Esql_Res_Cb        res;
       Esql_Res_Cb        res_free;
+      Esql_Prepare_Cb    prepare; /* creates a handle, may defer the server round trip to execute */
+      Esql_Execute_Cb    execute; /* sends a handle with its params, like query */
+      Esql_Stmt_Free_Cb  stmt_free;
+      Eina_List         *stmt_closed; /* evicted handles still allocated on the server */
+      Esql_Pipeline_Cb   pipeline; /* sends a query behind those in flight, EINA_FALSE if not taken; NULL if unsupported */
+      void              *pipeline_data; /* backend state of the pipeline */
+      Eina_Bool          broken; /* set by the backend when an io error must drop the connection */
    } backend;
 
+   struct
+   {
+      Eina_Hash   *handles; /* sql -> Esql_Stmt_Handle */
+      Eina_Inlist *lru; /* least recently used first */
+      unsigned int count;
+      unsigned int max;
+      unsigned long long hits; /* including backend caches of plain queries */
+      unsigned long long misses;
+   } stmts; /* prepared statement cache */
+
+   struct
+   {
+      unsigned int    max; /* queries in flight, including the current one */
+      Esql_Call_Queue sent; /* sent behind the current query, results pending */
+   } pipeline;
+
    Esql_Pool        *pool_struct;
    unsigned int      pool_id;
+   int               pool_idle; /* index in pool idle stack, -1 if busy */
 
    Ecore_Fd_Handler *fdh;
    Esql_Res         *res; /* current working result */
@@ -170,20 +290,72 @@ struct Esql
    Esql_Connect_Type current;
    double            query_start;
    double            query_end;
-   Eina_List        *backend_set_funcs; /* Esql_Set_Cb */
-   Eina_List        *backend_set_params; /* char * */
-   Eina_List        *backend_ids; /* Esql_Query_Id * */
+   double            query_wait; /* time the current query spent queued */
+   Esql_Call_Queue   calls; /* queued calls */
    void             *cur_data;
+   Esql_Query_Cb     cur_cb;
+   Esql_Query_Cb     cur_row_cb; /* set while streaming the current query */
+   Esql_Params      *cur_params; /* set while executing a prepared statement */
+   Esql_Stats        stats;
+   Esql_Slow_Log     slow; /* unused by pool members */
 };
 
+typedef enum
+{
+   ESQL_STMT_ARG_INT,
+   ESQL_STMT_ARG_LONG,
+   ESQL_STMT_ARG_LLONG,
+   ESQL_STMT_ARG_UINT,
+   ESQL_STMT_ARG_ULONG,
+   ESQL_STMT_ARG_ULLONG,
+   ESQL_STMT_ARG_DOUBLE,
+   ESQL_STMT_ARG_STRING,
+   ESQL_STMT_ARG_CHAR
+} Esql_Stmt_Arg;
+
+struct Esql_Stmt
+{
+   Esql          *e; /* connection or pool */
+   char          *sql; /* with backend placeholders, also the cache key */
+   unsigned int   len;
+   unsigned int   count; /* number of parameters */
+   unsigned char *args; /* Esql_Stmt_Arg of each parameter */
+};
+
+typedef struct Esql_Arena_Chunk Esql_Arena_Chunk;
+
+typedef struct Esql_Arena
+{
+   Esql_Arena_Chunk *chunks; /* newest first */
+} Esql_Arena;
+
+typedef struct Esql_Column
+{
+   Esql_Column_Type type;
+   unsigned int     count; /* cells stored */
+   unsigned int     size; /* cells allocated, multiple of 8 */
+   unsigned char   *nulls; /* NULL bitmap, allocated on the first NULL cell */
+   union
+   {
+      int64_t      *i;
+      double       *d;
+      unsigned int *offsets; /* count + 1 offsets into arena */
+   } v;
+   char            *arena; /* string cells, NUL terminated */
+   unsigned int     arena_len;
+   unsigned int     arena_size;
+} Esql_Column;
+
 struct Esql_Res
 {
    const char   *error;
    Esql         *e; /* parent object */
+   Esql         *conn; /* connection which produced it, not its pool; NULL if e is */
    void         *data;
 
    Eina_Inlist  *rows;
    int           row_count;
+   int           streamed; /* rows already handed to the stream callback */
    long long int affected;
    long long int id;
    Esql_Query_Id qid;
@@ -191,7 +363,8 @@ struct Esql_Res
    char         *query;
 
    Eina_Value_Struct_Desc *desc;
-   Eina_Mempool *mempool;
+   Esql_Arena    arena; /* rows, their struct memory and string cells */
+   Esql_Column  *columns; /* columnar storage, NULL for row results */
 
    struct
    {
@@ -210,25 +383,83 @@ struct Esql_Row
 void esql_fake_free(void *data EINA_UNUSED, Esql *e);
 
 void esql_res_free(void *data, Esql_Res * res);
+EAPI void esql_res_stream_flush(Esql_Res *res);
 Eina_Bool esql_connect_handler(Esql *e, Ecore_Fd_Handler *fdh);
 
 EAPI char         *esql_query_escape(Eina_Bool backslashes, unsigned int *len, const char *fmt, va_list args);
+EAPI char         *esql_query_escape_buf(Eina_Bool backslashes, char *buf, unsigned int size, unsigned int *len, const char *fmt, va_list args);
 
 char         *esql_string_escape(Eina_Bool backslashes, const char *s);
+size_t        esql_string_escape_len(Eina_Bool backslashes, const char *s);
+char         *esql_string_escape_write(Eina_Bool backslashes, char *rp, const char *s);
+void          esql_escape_init(void);
+void          esql_log_level_update(void);
+void          esql_histogram_add(Esql_Histogram *h, double t);
+void          esql_stats_submit(Esql_Stats *stats, unsigned int queued);
+void          esql_stats_send(Esql *e, unsigned int len, const Esql_Params *params);
+void          esql_stats_done(Esql *e, Eina_Bool failed);
+void          esql_slow_query_record(Esql_Slow_Log *log, Esql *e, const char *query, int rows, const char *error);
+void          esql_slow_log_clear(Esql_Slow_Log *log);
 Eina_Bool     esql_timeout_cb(Esql *e);
 
-Eina_Bool     esql_pool_rebalance(Esql_Pool *ep, Esql *e);
-Esql_Query_Id esql_pool_query(Esql_Pool *ep, void *data, const char *query);
-Esql_Query_Id esql_pool_query_args(Esql_Pool *ep, void *data, const char *fmt, va_list args);
+Esql_Call    *esql_call_push(Esql_Call_Queue *q);
+Esql_Call    *esql_call_peek(const Esql_Call_Queue *q);
+Eina_Bool     esql_call_shift(Esql_Call_Queue *q, Esql_Call *call);
+Eina_Bool     esql_call_pop(Esql_Call_Queue *q);
+void          esql_call_queue_clear(Esql_Call_Queue *q, Esql_Stats *stats);
+
+Esql_Query_Id esql_query_id_new(void);
+Esql_Query_Id esql_query_send(Esql *e, char *query, unsigned int len, Esql_Params *params, Esql_Query_Cb row_cb, Esql_Query_Cb cb, void *data);
+
+Eina_Bool     esql_stmt_send(Esql *e, const char *sql, unsigned int len, const Esql_Params *params);
+void          esql_stmt_cache_clear(Esql *e);
+
+EAPI Eina_Bool esql_pipeline_next_ok(const Esql *e);
+void          esql_pipeline_fill(Esql *e);
+void          esql_pipeline_fail(Esql *e, const char *error);
+void          esql_pipeline_clear(Esql *e);
+
+Eina_Bool     esql_pool_call_take(Esql_Pool *ep, Esql_Call *call);
+void          esql_pool_member_update(Esql *e);
+Esql_Query_Id esql_pool_query(Esql_Pool *ep, const char *query, Esql_Query_Cb row_cb, Esql_Query_Cb cb, void *data);
+Esql_Query_Id esql_pool_query_args(Esql_Pool *ep, Esql_Query_Cb cb, void *data, const char *fmt, va_list args);
+Esql_Query_Id esql_pool_execute(Esql_Pool *ep, const Esql_Stmt *stmt, Esql_Params *params, Esql_Query_Cb cb, void *data);
+void          esql_pool_stmt_cache_size_set(Esql_Pool *ep, unsigned int size);
 void          esql_pool_disconnect(Esql_Pool *ep);
 Eina_Bool     esql_pool_connect(Esql_Pool *ep, const char *addr, const char *user, const char *passwd);
 Eina_Bool     esql_pool_database_set(Esql_Pool *ep, const char *database_name);
 Eina_Bool     esql_pool_type_set(Esql_Pool *ep, Esql_Type type);
 void          esql_pool_connect_timeout_set(Esql_Pool *ep, double timeout);
 void          esql_pool_reconnect_set(Esql_Pool *ep, Eina_Bool enable);
+void          esql_pool_columnar_set(Esql_Pool *ep, Eina_Bool enable);
 void          esql_pool_free(Esql_Pool *ep);
 Eina_Bool    esql_reconnect_handler(Esql *e);
 
+Esql_Query_Cb esql_query_callback_take(Esql *e);
+Esql_Query_Cb esql_call_callback_take(Esql_Call *call);
+
+void          *esql_arena_alloc(Esql_Arena *a, size_t size);
+void          *esql_arena_calloc(Esql_Arena *a, size_t size);
+char          *esql_arena_strndup(Esql_Arena *a, const char *s, size_t len);
+void           esql_arena_reset(Esql_Arena *a);
+void           esql_arena_free(Esql_Arena *a);
+
+const char    *esql_cstr_copy(char *buf, unsigned int size, const char *str, unsigned int len);
+EAPI Esql_Row *esql_res_row_add(Esql_Res *res);
+EAPI void      esql_row_cell_int64_set(Esql_Row *r, unsigned int column, int64_t value);
+EAPI void      esql_row_cell_double_set(Esql_Row *r, unsigned int column, double value);
+EAPI void      esql_row_cell_string_set(Esql_Row *r, unsigned int column, const char *str, unsigned int len);
+EAPI void      esql_row_cell_string_ref(Esql_Row *r, unsigned int column, const char *str, unsigned int len);
+
+EAPI Eina_Bool esql_res_columns_setup(Esql_Res *res);
+void           esql_res_columns_free(Esql_Res *res);
+void           esql_res_columns_reset(Esql_Res *res);
+EAPI void      esql_res_columns_fail(Esql_Res *res);
+EAPI Eina_Bool esql_res_column_int64_append(Esql_Res *res, unsigned int column, int64_t value);
+EAPI Eina_Bool esql_res_column_double_append(Esql_Res *res, unsigned int column, double value);
+EAPI Eina_Bool esql_res_column_string_append(Esql_Res *res, unsigned int column, const char *str, unsigned int len);
+EAPI Eina_Bool esql_res_column_null_append(Esql_Res *res, unsigned int column);
+
 EAPI void     esql_event_error(Esql *e);
 EAPI void     esql_fd_handler(Esql *e);
 EAPI void     esql_call_complete(Esql *e);
@@ -236,10 +467,13 @@ EAPI void     esql_call_complete(Esql *e);
 Eina_Bool esql_mempool_init(void);
 void esql_mempool_shutdown(void);
 
+Eina_Bool esql_module_desc_init(void);
+void esql_module_desc_shutdown(void);
+void esql_module_desc_unref(Eina_Value_Struct_Desc *desc);
+
 #define ESQL_ALLOC_FREE_HEADER(TYPE, Type) \
   EAPI TYPE *Type##_calloc(unsigned int);  \
   EAPI void Type##_mp_free(TYPE *e);
 
 ESQL_ALLOC_FREE_HEADER(Esql_Res, esql_res);
-ESQL_ALLOC_FREE_HEADER(Esql_Row, esql_row);
 #endif
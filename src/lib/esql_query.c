@@ -17,108 +17,87 @@
 
 #include "esql_private.h"
 #include <stdarg.h>
+#include <limits.h>
+#include <stdio.h>
 
 static Esql_Query_Id esql_id = 0;
 Eina_Hash *esql_query_callbacks = NULL;
-Eina_Hash *esql_query_data = NULL;
 
-EAPI char *
-esql_string_escape(Eina_Bool   backslashes,
-                   const char *s)
+static unsigned int
+esql_uint_len(unsigned long long int u)
 {
-   char *ret, *rp;
-   const char *p;
+   unsigned int n = 1;
 
-   if (!s) return NULL;
-   ret = malloc(sizeof(char) * strlen(s) * 2 + 1);
-   EINA_SAFETY_ON_NULL_RETURN_VAL(ret, NULL);
-   if (!backslashes) /* no backslashes allowed, so just double up single quotes */
+   while (u >= 10)
      {
-        for (p = s, rp = ret; *p; p++, rp++)
-          {
-             if (*p == '\'')
-               {
-                  *rp = '\'';
-                  rp++;
-               }
-
-             *rp = *p;
-          }
+        u /= 10;
+        n++;
      }
-   else
-     {
-        for (p = s, rp = ret; *p; p++, rp++)
-          {
-             char e = 0;
+   return n;
+}
 
-             switch (*p)
-               {
-                case '\'':
-                case '\\':
-                case '"':
-                  e = *p;
-                  break;
-
-                case '\n':
-                  e = 'n';
-                  break;
-
-                case '\r':
-                  e = 'r';
-                  break;
-
-                case '\0':
-                  e = '0';
-                  break;
-
-                default:
-                  *rp = *p;
-                  continue;
-               }
+/* writes the @p n digits of @p u at @p rp and returns the end of the number */
+static char *
+esql_uint_write(char                  *rp,
+                unsigned long long int u,
+                unsigned int           n)
+{
+   char *end = rp + n;
 
-             *rp++ = '\\';
-             *rp = e;
-          }
-     }
-   *rp = 0;
-   return ret;
+   do
+     {
+        *--end = '0' + (u % 10);
+        u /= 10;
+     } while (u);
+   return rp + n;
 }
 
-char *
-esql_query_escape(Eina_Bool     backslashes,
-                  unsigned int *len,
-                  const char   *fmt,
-                  va_list       args)
+/* returned by esql_query_format() when the query does not fit before the end of the buffer */
+#define ESQL_QUERY_FORMAT_FULL -2
+
+/* formats @p fmt into @p buf, up to @p end, or only measures the query if @p buf is NULL:
+ * returns the length of the query, -1 if @p fmt is invalid, ESQL_QUERY_FORMAT_FULL
+ * if @p end was reached; nothing is written at @p end itself
+ */
+static ssize_t
+esql_query_format(Eina_Bool   backslashes,
+                  char       *buf,
+                  const char *end,
+                  const char *fmt,
+                  va_list     args)
 {
-   Eina_Strbuf *buf;
    const char *p, *pp;
-   char *ret = NULL;
-   size_t fmtlen;
+   char *rp = buf;
+   size_t n = 0, size;
+   int written;
 
-   buf = eina_strbuf_new();
-   *len = 0;
-   fmtlen = strlen(fmt);
-   pp = strchr(fmt, '%');
-   if (!pp) pp = fmt + fmtlen;
-   for (p = fmt; p && *p; pp = strchr(p, '%'))
+   for (p = fmt; *p; p = pp + 2)
      {
         Eina_Bool l = EINA_FALSE;
         Eina_Bool ll = EINA_FALSE;
-        Eina_Bool error;
+        Eina_Bool neg;
         long long int i;
         unsigned long long int u;
         double d;
-        char *s;
+        const char *s;
+        char c[2];
 
-        if (!pp) pp = fmt + fmtlen;
-        EINA_SAFETY_ON_FALSE_GOTO(eina_strbuf_append_length(buf, p, ((pp - p > 1) ? pp - p : 1)), err);
-        if (*pp != '%') break;  /* no more fmt strings */
+        pp = strchr(p, '%');
+        size = pp ? (size_t)(pp - p) : strlen(p);
+        if (rp)
+          {
+             if ((size_t)(end - rp) < size) return ESQL_QUERY_FORMAT_FULL;
+             memcpy(rp, p, size);
+             rp += size;
+          }
+        n += size;
+        if (!pp) break;  /* no more fmt strings */
 top:
         switch (pp[1])
           {
            case 0:
              ERR("Invalid format string!");
-             goto err;
+             return -1;
 
            case 'l':
              if (!l)
@@ -128,7 +107,7 @@ top:
              else
                {
                   ERR("Invalid format string!");
-                  goto err;
+                  return -1;
                }
              pp++;
              goto top;
@@ -137,10 +116,19 @@ top:
              if (l && ll)
                {
                   ERR("Invalid format string!");
-                  goto err;
+                  return -1;
                }
              d = va_arg(args, double);
-             EINA_SAFETY_ON_FALSE_GOTO(eina_strbuf_append_printf(buf, "%lf", d), err);
+             /* the only conversion which is not worth doing by hand */
+             if (rp)
+               {
+                  /* its nul lands at @p end at most */
+                  written = snprintf(rp, end - rp + 1, "%lf", d);
+                  if ((written < 0) || (written > end - rp)) return ESQL_QUERY_FORMAT_FULL;
+                  rp += written;
+               }
+             else
+               n += snprintf(NULL, 0, "%lf", d);
              break;
 
            case 'i':
@@ -151,7 +139,16 @@ top:
                i = va_arg(args, long int);
              else
                i = va_arg(args, int);
-             EINA_SAFETY_ON_FALSE_GOTO(eina_strbuf_append_printf(buf, "%lli", i), err);
+             neg = (i < 0);
+             u = neg ? 0ULL - (unsigned long long int)i : (unsigned long long int)i;
+             size = esql_uint_len(u);
+             if (rp)
+               {
+                  if ((size_t)(end - rp) < size + neg) return ESQL_QUERY_FORMAT_FULL;
+                  if (neg) *rp++ = '-';
+                  rp = esql_uint_write(rp, u, size);
+               }
+             n += size + neg;
              break;
 
            case 'u':
@@ -161,126 +158,293 @@ top:
                u = va_arg(args, unsigned long int);
              else
                u = va_arg(args, unsigned int);
-             EINA_SAFETY_ON_FALSE_GOTO(eina_strbuf_append_printf(buf, "%llu", u), err);
+             size = esql_uint_len(u);
+             if (rp)
+               {
+                  if ((size_t)(end - rp) < size) return ESQL_QUERY_FORMAT_FULL;
+                  rp = esql_uint_write(rp, u, size);
+               }
+             n += size;
              break;
 
            case 's':
+           case 'c':
              if (l)
                {
                   ERR("Invalid format string!");
-                  goto err;
+                  return -1;
+               }
+             if (pp[1] == 's')
+               s = va_arg(args, const char *);
+             else
+               {
+                  c[0] = va_arg(args, int);
+                  c[1] = 0;
+                  s = c;
                }
-             s = va_arg(args, char *);
              if (!s) break;
-             s = esql_string_escape(backslashes, s);
-             EINA_SAFETY_ON_NULL_GOTO(s, err);
-             error = eina_strbuf_append(buf, s);
-             free(s);
-             EINA_SAFETY_ON_TRUE_GOTO(error, err);
-             break;
-
-           case 'c':
-             if (l)
+             if (rp)
                {
-                  ERR("Invalid format string!");
-                  goto err;
+                  /* escaping at most doubles the string, only count when that may not fit */
+                  size = strlen(s);
+                  if (((size_t)(end - rp) < size * 2) &&
+                      ((size_t)(end - rp) < esql_string_escape_len(backslashes, s)))
+                    return ESQL_QUERY_FORMAT_FULL;
+                  rp = esql_string_escape_write(backslashes, rp, s);
                }
-             {
-                char c[3];
-
-                c[0] = va_arg(args, int);
-                c[1] = c[2] = 0;
-                s = esql_string_escape(backslashes, c);
-                EINA_SAFETY_ON_NULL_GOTO(s, err);
-                error = !eina_strbuf_append(buf, s);
-                free(s);
-                EINA_SAFETY_ON_TRUE_GOTO(error, err);
-             }
+             else
+               n += esql_string_escape_len(backslashes, s);
              break;
 
            case '%':
-             EINA_SAFETY_ON_FALSE_GOTO(eina_strbuf_append_char(buf, '%'), err);
+             if (rp)
+               {
+                  if (rp == end) return ESQL_QUERY_FORMAT_FULL;
+                  *rp++ = '%';
+               }
+             n++;
              break;
 
            default:
              ERR("Unsupported format string: '%s'!", pp);
-             goto err;
+             return -1;
           }
+     }
+   if (n >= UINT_MAX)
+     {
+        ERR("Query too long!");
+        return -1;
+     }
+   return rp ? rp - buf : (ssize_t)n;
+}
+
+/* builds the query in @p buf in a single pass if it can hold it, with its nul,
+ * in a new allocation of the exact size otherwise
+ */
+char *
+esql_query_escape_buf(Eina_Bool     backslashes,
+                      char         *buf,
+                      unsigned int  size,
+                      unsigned int *len,
+                      const char   *fmt,
+                      va_list       args)
+{
+   va_list measure;
+   ssize_t n;
+   char *ret;
 
-        p = pp + ((pp[1]) ? 2 : 1);
+   *len = 0;
+   if (buf && size)
+     {
+        va_copy(measure, args);
+        n = esql_query_format(backslashes, buf, buf + size - 1, fmt, measure);
+        va_end(measure);
+        if (n == -1) return NULL;
+        if (n >= 0)
+          {
+             buf[n] = 0;
+             *len = n;
+             return buf;
+          }
      }
-   *len = eina_strbuf_length_get(buf);
-   ret = eina_strbuf_string_steal(buf);
-err:
-   eina_strbuf_free(buf);
+   va_copy(measure, args);
+   n = esql_query_format(backslashes, NULL, NULL, fmt, measure);
+   va_end(measure);
+   if (n < 0) return NULL;
+   ret = malloc(n + 1);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ret, NULL);
+   esql_query_format(backslashes, ret, ret + n, fmt, args);
+   ret[n] = 0;
+   *len = n;
    return ret;
 }
 
-/**
- * @defgroup Esql_Query Query
- * @brief Functions to manage/setup queries to databases
- * @{*/
+/* builds the query in a new allocation of the exact size */
+char *
+esql_query_escape(Eina_Bool     backslashes,
+                  unsigned int *len,
+                  const char   *fmt,
+                  va_list       args)
+{
+   return esql_query_escape_buf(backslashes, NULL, 0, len, fmt, args);
+}
 
-/**
- * @brief Make a basic query
- * Use this function to make a query which does not use printf-style arguments.
- * @param e The #Esql object to query with (NOT NULL)
- * @param query The query SQL (NOT NULL)
- * @param data Data to associate with the result
- * @return Query identifier or 0 on failure.
- */
 Esql_Query_Id
-esql_query(Esql       *e,
-           void       *data,
-           const char *query)
+esql_query_id_new(void)
 {
-   DBG("(e=%p, query='%s')", e, query);
+   while (++esql_id < 1) ;
+   return esql_id;
+}
 
-   EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
-   EINA_SAFETY_ON_NULL_RETURN_VAL(query, 0);
-   if (!e->connected)
+/* takes ownership of @p query and @p params, a prepared statement is sent if @p params is set */
+Esql_Query_Id
+esql_query_send(Esql         *e,
+                char         *query,
+                unsigned int  len,
+                Esql_Params  *params,
+                Esql_Query_Cb row_cb,
+                Esql_Query_Cb cb,
+                void         *data)
+{
+   if (!query)
      {
-        ERR("Esql object must be connected!");
+        free(params);
         return 0;
      }
-   if (e->pool) return esql_pool_query((Esql_Pool *)e, data, query);
-   EINA_SAFETY_ON_NULL_RETURN_VAL(e->backend.db, 0);
-
    while (++esql_id < 1) ;
    if (!e->current)
      {
+        esql_stats_submit(&e->stats, 0);
+        esql_histogram_add(&e->stats.queue_wait, 0);
+        esql_stats_send(e, len, params);
         e->query_start = ecore_time_get();
-        e->backend.query(e, query, strlen(query));
-        e->error = e->backend.error_get(e);
+        e->query_wait = 0.0;
+        e->cur_row_cb = row_cb; /* backends check it when sending */
+        if (params)
+          {
+             DBG("(e=%p, stmt=\"%s\")", e, query);
+             e->cur_params = params;
+             e->error = NULL;
+             if (!esql_stmt_send(e, query, len, params))
+               e->error = e->backend.error_get(e) ?: "Could not prepare statement";
+          }
+        else
+          {
+             e->backend.query(e, query, len);
+             DBG("(e=%p, query=\"%s\")", e, query);
+             e->error = e->backend.error_get(e);
+          }
         if (e->error)
           {
              ERR("%s", e->error);
+             e->stats.failed++;
              while (!(--esql_id));
+             e->cur_row_cb = NULL;
+             e->cur_params = NULL;
+             free(params);
+             free(query);
              return 0;
           }
         e->current = ESQL_CONNECT_TYPE_QUERY;
         e->cur_data = data;
+        e->cur_cb = cb;
         e->cur_id = esql_id;
-        e->cur_query = strdup(query);
+        e->cur_query = query;
 
         if (!e->fd_job)
           e->fd_job = ecore_job_add((Ecore_Cb)esql_fd_handler, e);
      }
    else
      {
-        e->backend_set_funcs = eina_list_append(e->backend_set_funcs, esql_query);
-        e->backend_set_params = eina_list_append(e->backend_set_params, strdup(query));
-        e->backend_ids = eina_list_append(e->backend_ids, (void *)(uintptr_t)esql_id);
-        if (data)
+        Esql_Call *call;
+
+        call = esql_call_push(&e->calls);
+        if (!call)
           {
-             if (!esql_query_data) esql_query_data = eina_hash_int32_new(NULL);
-             eina_hash_add(esql_query_data, &esql_id, data);
+             while (!(--esql_id));
+             free(params);
+             free(query);
+             return 0;
           }
+        call->type = ESQL_CONNECT_TYPE_QUERY;
+        call->id = esql_id;
+        call->query = query;
+        call->len = len;
+        call->data = data;
+        call->callback = cb;
+        call->row_callback = row_cb;
+        call->params = params;
+        call->queued = ecore_time_get();
+        esql_stats_submit(&e->stats, e->calls.count);
+        esql_pipeline_fill(e);
      }
-
+   if (e->pool_member) esql_pool_member_update(e);
    return esql_id;
 }
 
+/**
+ * @defgroup Esql_Query Query
+ * @brief Functions to manage/setup queries to databases
+ * @{*/
+
+/**
+ * @brief Make a basic query
+ * Use this function to make a query which does not use printf-style arguments.
+ * @param e The #Esql object to query with (NOT NULL)
+ * @param query The query SQL (NOT NULL)
+ * @param data Data to associate with the result
+ * @return Query identifier or 0 on failure.
+ */
+Esql_Query_Id
+esql_query(Esql       *e,
+           void       *data,
+           const char *query)
+{
+   return esql_query_full(e, query, NULL, data);
+}
+
+/**
+ * @brief Make a basic query with a result callback
+ * Use this function to make a query which does not use printf-style arguments and
+ * which calls @p cb with the result instead of emitting ESQL_EVENT_RESULT.
+ * The callback is stored with the query, so this is cheaper than calling
+ * esql_query_callback_set() on the returned id.
+ * @param e The #Esql object to query with (NOT NULL)
+ * @param query The query SQL (NOT NULL)
+ * @param cb The callback to call with the result, or NULL to emit ESQL_EVENT_RESULT
+ * @param data Data to associate with the result
+ * @return Query identifier or 0 on failure.
+ */
+Esql_Query_Id
+esql_query_full(Esql         *e,
+                const char   *query,
+                Esql_Query_Cb cb,
+                void         *data)
+{
+   return esql_query_stream(e, query, NULL, cb, data);
+}
+
+/**
+ * @brief Make a query which delivers its rows in batches
+ * Use this function for SELECTs whose results are too large to be held in memory at once.
+ * Instead of building the full result set, @p row_cb is called each time a batch of rows
+ * has been decoded, with a result object holding only that batch: iterate it with
+ * esql_res_row_iterator_new() (or the esql_res_column_* functions in columnar mode).
+ * The rows are freed as soon as @p row_cb returns, so keep no pointers to them.
+ * Once all rows have been delivered, @p done_cb (or ESQL_EVENT_RESULT if it is NULL) is
+ * called with a result which holds no rows, carries any error, and for which
+ * esql_res_rows_count() returns the total number of rows streamed.
+ * @param e The #Esql object to query with (NOT NULL)
+ * @param query The query SQL (NOT NULL)
+ * @param row_cb The callback to call for each batch of rows, or NULL to build a regular result
+ * @param done_cb The callback to call once the query has completed, or NULL to emit ESQL_EVENT_RESULT
+ * @param data Data to associate with the result
+ * @return Query identifier or 0 on failure.
+ * @note The mysql backend receives the whole result before decoding it, so streaming only
+ * bounds the memory used by decoded rows there.
+ */
+Esql_Query_Id
+esql_query_stream(Esql         *e,
+                  const char   *query,
+                  Esql_Query_Cb row_cb,
+                  Esql_Query_Cb done_cb,
+                  void         *data)
+{
+   DBG("(e=%p, query='%s')", e, query);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(query, 0);
+   if (!e->connected)
+     {
+        ERR("Esql object must be connected!");
+        return 0;
+     }
+   if (e->pool) return esql_pool_query((Esql_Pool *)e, query, row_cb, done_cb, data);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e->backend.db, 0);
+
+   return esql_query_send(e, strdup(query), strlen(query), NULL, row_cb, done_cb, data);
+}
+
 /**
  * @brief Make a query using a format string and arguments
  * Use this function to make a query which uses printf-style arguments.
@@ -305,7 +469,39 @@ esql_query_args(Esql       *e,
    EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
    EINA_SAFETY_ON_NULL_RETURN_VAL(fmt, 0);
    va_start(args, fmt);
-   ret = esql_query_vargs(e, data, fmt, args);
+   ret = esql_query_vargs_full(e, NULL, data, fmt, args);
+   va_end(args);
+   return ret;
+}
+
+/**
+ * @brief Make a query using a format string and arguments, with a result callback
+ * Use this function to make a query which uses printf-style arguments and which
+ * calls @p cb with the result instead of emitting ESQL_EVENT_RESULT.
+ * @param e The #Esql object to query with (NOT NULL)
+ * @param cb The callback to call with the result, or NULL to emit ESQL_EVENT_RESULT
+ * @param data Data to associate with the result
+ * @param fmt The format string for the query
+ * @return Query identifier or 0 on failure.
+ * @note This function automatically does all necessary escaping of the args required by
+ * @p e 's backend database.
+ */
+Esql_Query_Id
+esql_query_args_full(Esql         *e,
+                     Esql_Query_Cb cb,
+                     void         *data,
+                     const char   *fmt,
+                     ...)
+{
+   va_list args;
+   Esql_Query_Id ret;
+
+   DBG("(e=%p, fmt='%s')", e, fmt);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(fmt, 0);
+   va_start(args, fmt);
+   ret = esql_query_vargs_full(e, cb, data, fmt, args);
    va_end(args);
    return ret;
 }
@@ -326,6 +522,26 @@ esql_query_vargs(Esql       *e,
                  void       *data,
                  const char *fmt,
                  va_list     args)
+{
+   return esql_query_vargs_full(e, NULL, data, fmt, args);
+}
+
+/**
+ * @brief Make a query using a format string and a va_list, with a result callback
+ * @see esql_query_args_full
+ * @param e The #Esql object to query with (NOT NULL)
+ * @param cb The callback to call with the result, or NULL to emit ESQL_EVENT_RESULT
+ * @param data Data to associate with the result
+ * @param fmt The format string for the query
+ * @param args The arg list for @p fmt
+ * @return Query identifier or 0 on failure.
+ */
+Esql_Query_Id
+esql_query_vargs_full(Esql         *e,
+                      Esql_Query_Cb cb,
+                      void         *data,
+                      const char   *fmt,
+                      va_list       args)
 {
    char *query;
    unsigned int len;
@@ -340,45 +556,13 @@ esql_query_vargs(Esql       *e,
         return 0;
      }
    if (e->pool)
-     return esql_pool_query_args((Esql_Pool *)e, data, fmt, args);
+     return esql_pool_query_args((Esql_Pool *)e, cb, data, fmt, args);
    EINA_SAFETY_ON_NULL_RETURN_VAL(e->backend.db, 0);
 
    query = e->backend.escape(e, &len, fmt, args);
 
    EINA_SAFETY_ON_NULL_RETURN_VAL(query, 0);
-   while (++esql_id < 1) ;
-   if (!e->current)
-     {
-        e->query_start = ecore_time_get();
-        e->backend.query(e, query, len);
-        DBG("(e=%p, query=\"%s\")", e, query);
-        e->error = e->backend.error_get(e);
-        if (e->error)
-          {
-             ERR("%s", e->error);
-             while (!(--esql_id));
-             return 0;
-          }
-        e->current = ESQL_CONNECT_TYPE_QUERY;
-        e->cur_data = data;
-        e->cur_id = esql_id;
-        e->cur_query = query;
-
-        if (!e->fd_job)
-          e->fd_job = ecore_job_add((Ecore_Cb)esql_fd_handler, e);
-     }
-   else
-     {
-        e->backend_set_funcs = eina_list_append(e->backend_set_funcs, esql_query);
-        e->backend_set_params = eina_list_append(e->backend_set_params, query);
-        e->backend_ids = eina_list_append(e->backend_ids, (void *)(uintptr_t)esql_id);
-        if (data)
-          {
-             if (!esql_query_data) esql_query_data = eina_hash_int32_new(NULL);
-             eina_hash_add(esql_query_data, &esql_id, data);
-          }
-     }
-   return esql_id;
+   return esql_query_send(e, query, len, NULL, NULL, cb, data);
 }
 
 /**
@@ -387,6 +571,9 @@ esql_query_vargs(Esql       *e,
  * This function is used to setup a callback to be called for the response of
  * a query with @p id, overriding (disabling) the ESQL_EVENT_RESULT event
  * for that call.  If a previous callback was set for @p id, this will overwrite it.
+ * @note This looks the callback up in a global table when the query completes;
+ * esql_query_full(), esql_query_args_full() and esql_execute() store the callback with the
+ * query and should be preferred.
  * @param id The query id (> 0)
  * @param callback The callback to use (NOT NULL)
  * @return #EINA_TRUE on success, or #EINA_FALSE on failure
@@ -408,3 +595,31 @@ esql_query_callback_set(Esql_Query_Id id,
 }
 
 /** @} */
+
+/* returns the callback for the current query of @p e, consuming any callback set by id */
+Esql_Query_Cb
+esql_query_callback_take(Esql *e)
+{
+   Esql_Query_Cb cb;
+
+   cb = e->cur_cb;
+   e->cur_cb = NULL;
+   if (cb || (!esql_query_callbacks)) return cb;
+   cb = eina_hash_find(esql_query_callbacks, &e->cur_id);
+   if (cb) eina_hash_del_by_key(esql_query_callbacks, &e->cur_id);
+   return cb;
+}
+
+/* same as esql_query_callback_take(), for a call which is not current */
+Esql_Query_Cb
+esql_call_callback_take(Esql_Call *call)
+{
+   Esql_Query_Cb cb;
+
+   cb = call->callback;
+   call->callback = NULL;
+   if (cb || (!esql_query_callbacks)) return cb;
+   cb = eina_hash_find(esql_query_callbacks, &call->id);
+   if (cb) eina_hash_del_by_key(esql_query_callbacks, &call->id);
+   return cb;
+}
@@ -16,6 +16,7 @@
  */
 
 #include "esql_private.h"
+#include <inttypes.h>
 
 typedef struct Esql_Row_Iterator
 {
@@ -53,54 +54,195 @@ eina_row_iterator_free(Esql_Row_Iterator *it)
    free(it);
 }
 
-static void
-esql_row_free(Esql_Row *r)
+/* numeric cells coming in as text are not necessarily NUL terminated */
+const char *
+esql_cstr_copy(char *buf, unsigned int size, const char *str, unsigned int len)
 {
-   eina_value_flush(&(r->value));
-   esql_row_mp_free(r);
+   if (len >= size) len = size - 1;
+   memcpy(buf, str, len);
+   buf[len] = 0;
+   return buf;
 }
 
-static void
-_esql_res_free(Esql_Res *res)
+/* returns a row with all cells zeroed (NULL), allocated from the result arena */
+Esql_Row *
+esql_res_row_add(Esql_Res *res)
 {
-   Esql_Row *r = NULL;
-   Eina_Inlist *l;
+   Esql_Row *r;
+   Eina_Value_Struct *st;
 
-   DBG("res=%p (refcount=%d)", res, res->refcount);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(res->desc, NULL);
+
+   /* row, struct header and cell memory in a single block */
+   r = esql_arena_alloc(&res->arena, sizeof(Esql_Row) + sizeof(Eina_Value_Struct) + res->desc->size);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(r, NULL);
+   st = (Eina_Value_Struct *)(r + 1);
+   st->desc = res->desc;
+   st->memory = st + 1;
+   memset(st->memory, 0, res->desc->size);
+
+   /* set up by hand: the value must never be flushed, the arena owns it */
+   r->res = res;
+   r->value.type = EINA_VALUE_TYPE_STRUCT;
+   r->value.value.ptr = st;
+   res->rows = eina_inlist_append(res->rows, EINA_INLIST_GET(r));
+   return r;
+}
+
+static void *
+esql_row_cell_get(Esql_Row *r, unsigned int column, const Eina_Value_Type **type)
+{
+   const Eina_Value_Struct_Member *m;
+   Eina_Value_Struct *st;
+
+   m = r->res->desc->members + column;
+   st = r->value.value.ptr;
+   *type = m->type;
+   return (char *)st->memory + m->offset;
+}
+
+/* cell setters write straight into the row memory, converting to the member type if needed */
+void
+esql_row_cell_int64_set(Esql_Row *r, unsigned int column, int64_t value)
+{
+   const Eina_Value_Type *type;
+   void *mem;
+
+   EINA_SAFETY_ON_FALSE_RETURN(column < r->res->desc->member_count);
+   mem = esql_row_cell_get(r, column, &type);
+
+   if (type == EINA_VALUE_TYPE_INT64)
+     *(int64_t *)mem = value;
+   else if (type == EINA_VALUE_TYPE_UINT64)
+     *(uint64_t *)mem = value;
+   else if ((type == EINA_VALUE_TYPE_LONG) || (type == EINA_VALUE_TYPE_TIMESTAMP))
+     *(long *)mem = value;
+   else if (type == EINA_VALUE_TYPE_ULONG)
+     *(unsigned long *)mem = value;
+   else if (type == EINA_VALUE_TYPE_INT)
+     *(int *)mem = value;
+   else if (type == EINA_VALUE_TYPE_UINT)
+     *(unsigned int *)mem = value;
+   else if (type == EINA_VALUE_TYPE_SHORT)
+     *(short *)mem = value;
+   else if (type == EINA_VALUE_TYPE_USHORT)
+     *(unsigned short *)mem = value;
+   else if (type == EINA_VALUE_TYPE_CHAR)
+     *(char *)mem = value;
+   else if (type == EINA_VALUE_TYPE_UCHAR)
+     *(unsigned char *)mem = value;
+   else if (type == EINA_VALUE_TYPE_DOUBLE)
+     *(double *)mem = value;
+   else if (type == EINA_VALUE_TYPE_FLOAT)
+     *(float *)mem = value;
+   else if ((type == EINA_VALUE_TYPE_STRING) || (type == EINA_VALUE_TYPE_BLOB))
+     {
+        char buf[32];
+        int len;
+
+        len = snprintf(buf, sizeof(buf), "%"PRId64, value);
+        esql_row_cell_string_set(r, column, buf, len);
+     }
+   else
+     ERR("Cannot store an integer in a %s cell", eina_value_type_name_get(type));
+}
+
+void
+esql_row_cell_double_set(Esql_Row *r, unsigned int column, double value)
+{
+   const Eina_Value_Type *type;
+   void *mem;
+
+   EINA_SAFETY_ON_FALSE_RETURN(column < r->res->desc->member_count);
+   mem = esql_row_cell_get(r, column, &type);
+
+   if (type == EINA_VALUE_TYPE_DOUBLE)
+     *(double *)mem = value;
+   else if (type == EINA_VALUE_TYPE_FLOAT)
+     *(float *)mem = value;
+   else if ((type == EINA_VALUE_TYPE_STRING) || (type == EINA_VALUE_TYPE_BLOB))
+     {
+        char buf[64];
+        int len;
+
+        len = snprintf(buf, sizeof(buf), "%.17g", value);
+        esql_row_cell_string_set(r, column, buf, len);
+     }
+   else
+     esql_row_cell_int64_set(r, column, value);
+}
 
-   if (res->rows)
-     EINA_INLIST_FOREACH_SAFE(res->rows, l, r)
-       esql_row_free(r);
+/* strings and blobs are copied into the arena and NUL terminated */
+void
+esql_row_cell_string_set(Esql_Row *r, unsigned int column, const char *str, unsigned int len)
+{
+   const Eina_Value_Type *type;
+   void *mem;
+   char buf[64];
 
-   if (res->desc)
+   EINA_SAFETY_ON_FALSE_RETURN(column < r->res->desc->member_count);
+   mem = esql_row_cell_get(r, column, &type);
+
+   if (type == EINA_VALUE_TYPE_STRING)
+     *(const char **)mem = esql_arena_strndup(&r->res->arena, str, len);
+   else if (type == EINA_VALUE_TYPE_BLOB)
      {
-        /* memset is not needed, but leave it here to find if people
-         * kept reference to values after row is removed, see below.
-         */
-        memset(res->desc, 0, sizeof(*res->desc));
-        free(res->desc);
-
-        /* NOTE: after this point, if users are still holding 'desc' they will
-         * have problems. This can be done if user calls eina_value_copy()
-         * on some esql_row_value_struct_get()
-         *
-         * If this is an use case, add Eina_Value_Struct_Desc to some other
-         * struct and do reference counting on it, increment on
-         * alloc/copy, decrement on free.
-         *
-         * Remember that struct is created/ref on thread, and it is free'd
-         * on main thread, then needs locking!
-         */
+        Eina_Value_Blob *blob = mem;
+
+        blob->ops = NULL;
+        blob->memory = esql_arena_strndup(&r->res->arena, str, len);
+        blob->size = blob->memory ? len : 0;
      }
+   else if ((type == EINA_VALUE_TYPE_DOUBLE) || (type == EINA_VALUE_TYPE_FLOAT))
+     esql_row_cell_double_set(r, column, strtod(esql_cstr_copy(buf, sizeof(buf), str, len), NULL));
+   else
+     esql_row_cell_int64_set(r, column, strtoll(esql_cstr_copy(buf, sizeof(buf), str, len), NULL, 10));
+}
 
-   if (res->e->pool)
+/* like esql_row_cell_string_set(), without the copy: @p str must be NUL terminated
+ * and stay valid as long as the result, as the backend buffers it was received in do
+ */
+void
+esql_row_cell_string_ref(Esql_Row *r, unsigned int column, const char *str, unsigned int len)
+{
+   const Eina_Value_Type *type;
+   void *mem;
+
+   EINA_SAFETY_ON_FALSE_RETURN(column < r->res->desc->member_count);
+   mem = esql_row_cell_get(r, column, &type);
+
+   if (type == EINA_VALUE_TYPE_STRING)
+     *(const char **)mem = str;
+   else if (type == EINA_VALUE_TYPE_BLOB)
      {
-        Esql_Pool *ep = (Esql_Pool*)res->e;
-        res->e = EINA_INLIST_CONTAINER_GET(ep->esqls, Esql);
+        Eina_Value_Blob *blob = mem;
+
+        blob->ops = NULL;
+        blob->memory = str;
+        blob->size = len;
      }
+   else
+     esql_row_cell_string_set(r, column, str, len);
+}
+
+static void
+_esql_res_free(Esql_Res *res)
+{
+   DBG("res=%p (refcount=%d)", res, res->refcount);
+
+   /* rows and their cells all live in the arena */
+   esql_arena_free(&res->arena);
+   esql_res_columns_free(res);
+
+   /* the desc is shared through the desc cache, and copies of row values
+    * made with eina_value_copy() hold their own reference on it
+    */
+   esql_module_desc_unref(res->desc);
+
+   /* backend data goes back to the pool member which allocated it */
+   if (res->conn) res->e = res->conn;
    res->e->backend.res_free(res);
    free(res->query);
-   if (res->mempool) eina_mempool_del(res->mempool);
    esql_res_mp_free(res);
 }
 
@@ -111,6 +253,32 @@ esql_res_free(void *data EINA_UNUSED,
    esql_res_unref(res);
 }
 
+/* hands the rows decoded so far to the stream callback of the current query, then drops them */
+void
+esql_res_stream_flush(Esql_Res *res)
+{
+   Esql *e = res->e;
+
+   if (!res->row_count) return;
+   DBG("res=%p (%d rows, %d streamed)", res, res->row_count, res->streamed);
+
+   res->data = e->cur_data;
+   res->qid = e->cur_id;
+   /* callers may ref/unref the batch, it must outlive the callback */
+   res->refcount++;
+   /* like the final result, batches of a pool member belong to the pool */
+   if (e->pool_member) res->e = (Esql *)e->pool_struct;
+   e->cur_row_cb(res, e->cur_data);
+   res->e = e;
+   res->refcount--;
+
+   res->rows = NULL;
+   esql_arena_reset(&res->arena);
+   esql_res_columns_reset(res);
+   res->streamed += res->row_count;
+   res->row_count = 0;
+}
+
 /**
  * @defgroup Esql_Res Results
  * @brief Functions to use result objects
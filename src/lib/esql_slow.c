@@ -0,0 +1,213 @@
+/*
+ * Copyright 2011, 2012, 2013, 2014 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esql_private.h"
+
+/* records kept when no callback is set */
+#define ESQL_SLOW_LOG_SIZE_DEFAULT 64
+
+/*
+ * queries only cost a comparison with the threshold: the record is only built,
+ * and the ring only allocated, once a query has been slow
+ */
+
+static Esql_Slow_Log *
+esql_slow_log_get(Esql *e)
+{
+   if (e->pool) return &((Esql_Pool *)e)->slow;
+   if (e->pool_member) return &e->pool_struct->slow;
+   return &e->slow;
+}
+
+static Esql_Slow_Query *
+esql_slow_log_shift(Esql_Slow_Log *log)
+{
+   Esql_Slow_Query *sq;
+
+   if (!log->count) return NULL;
+   sq = log->ring[log->head];
+   log->head = (log->head + 1) % log->size;
+   log->count--;
+   return sq;
+}
+
+/* the current query of @p e took longer than the threshold of @p log */
+void
+esql_slow_query_record(Esql_Slow_Log *log,
+                       Esql          *e,
+                       const char    *query,
+                       int            rows,
+                       const char    *error)
+{
+   Esql_Slow_Query sq, *copy;
+   size_t len, error_len;
+
+   sq.id = e->cur_id;
+   sq.query = query;
+   sq.member = e->pool_member ? (int)e->pool_id : -1;
+   sq.queue_wait = e->query_wait;
+   sq.exec = e->query_end - e->query_start;
+   sq.rows = rows;
+   sq.error = error;
+   if (log->cb)
+     {
+        log->cb(&sq, log->cb_data);
+        return;
+     }
+
+   if (!log->ring)
+     {
+        if (!log->size) log->size = ESQL_SLOW_LOG_SIZE_DEFAULT;
+        log->ring = calloc(log->size, sizeof(Esql_Slow_Query *));
+        EINA_SAFETY_ON_NULL_RETURN(log->ring);
+     }
+   /* the query and error strings are stored along with the record */
+   len = sq.query ? strlen(sq.query) + 1 : 0;
+   error_len = sq.error ? strlen(sq.error) + 1 : 0;
+   copy = malloc(sizeof(Esql_Slow_Query) + len + error_len);
+   EINA_SAFETY_ON_NULL_RETURN(copy);
+   memcpy(copy, &sq, sizeof(Esql_Slow_Query));
+   if (len)
+     {
+        copy->query = (char *)(copy + 1);
+        memcpy(copy + 1, sq.query, len);
+     }
+   if (error_len)
+     {
+        copy->error = (char *)(copy + 1) + len;
+        memcpy((char *)(copy + 1) + len, sq.error, error_len);
+     }
+   if (log->count == log->size)
+     {
+        free(esql_slow_log_shift(log));
+        log->dropped++;
+     }
+   log->ring[(log->head + log->count) % log->size] = copy;
+   log->count++;
+}
+
+void
+esql_slow_log_clear(Esql_Slow_Log *log)
+{
+   while (log->count)
+     free(esql_slow_log_shift(log));
+   free(log->ring);
+   log->ring = NULL;
+   log->head = 0;
+}
+
+/**
+ * @defgroup Esql_Slow_Query Slow query log
+ * @brief Functions to find out which queries take too long
+ * @{*/
+
+/**
+ * @brief Set the duration above which queries are logged as slow
+ * Queries whose result took longer than @p threshold to arrive, from the time they were
+ * sent, are recorded: either passed to the callback set with esql_slow_query_callback_set(),
+ * or kept until taken with esql_slow_query_pop().
+ * Queries which failed or timed out are recorded as well, along with their error.
+ * @param e The #Esql object (NOT NULL), for a pool this applies to all its connections
+ * @param threshold The duration in seconds, 0 to disable the log (default)
+ */
+void
+esql_slow_query_threshold_set(Esql  *e,
+                              double threshold)
+{
+   EINA_SAFETY_ON_NULL_RETURN(e);
+   EINA_SAFETY_ON_TRUE_RETURN(threshold < 0);
+
+   esql_slow_log_get(e)->threshold = threshold;
+}
+
+/**
+ * @brief Return the duration above which queries are logged as slow
+ * @param e The #Esql object (NOT NULL)
+ * @return The threshold in seconds, 0 if the slow query log is disabled
+ */
+double
+esql_slow_query_threshold_get(const Esql *e)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
+
+   return esql_slow_log_get((Esql *)e)->threshold;
+}
+
+/**
+ * @brief Set a callback to pass slow queries to instead of keeping them
+ * The record passed to @p cb, including its query string, is only valid during the call.
+ * @param e The #Esql object (NOT NULL)
+ * @param cb The callback, NULL to keep the records for esql_slow_query_pop()
+ * @param data Data to pass to @p cb
+ */
+void
+esql_slow_query_callback_set(Esql              *e,
+                             Esql_Slow_Query_Cb cb,
+                             void              *data)
+{
+   Esql_Slow_Log *log;
+
+   EINA_SAFETY_ON_NULL_RETURN(e);
+
+   log = esql_slow_log_get(e);
+   log->cb = cb;
+   log->cb_data = data;
+}
+
+/**
+ * @brief Set how many slow queries are kept
+ * When the log is full, the oldest record is dropped to make room for the new one.
+ * Records already kept are dropped when changing the size.
+ * @param e The #Esql object (NOT NULL)
+ * @param size The number of records, at least 1 (default: 64)
+ */
+void
+esql_slow_query_log_size_set(Esql        *e,
+                             unsigned int size)
+{
+   Esql_Slow_Log *log;
+
+   EINA_SAFETY_ON_NULL_RETURN(e);
+   EINA_SAFETY_ON_TRUE_RETURN(!size);
+
+   log = esql_slow_log_get(e);
+   esql_slow_log_clear(log);
+   log->size = size;
+}
+
+/**
+ * @brief Take the oldest slow query from the log
+ * @param e The #Esql object (NOT NULL)
+ * @param dropped Where to store the number of records dropped because the log was full since
+ * the last call, can be NULL
+ * @return The record, to be freed with free(), or NULL if the log is empty
+ */
+Esql_Slow_Query *
+esql_slow_query_pop(Esql               *e,
+                    unsigned long long *dropped)
+{
+   Esql_Slow_Log *log;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, NULL);
+
+   log = esql_slow_log_get(e);
+   if (dropped) *dropped = log->dropped;
+   log->dropped = 0;
+   return esql_slow_log_shift(log);
+}
+
+/** @} */
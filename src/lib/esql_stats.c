@@ -0,0 +1,232 @@
+/*
+ * Copyright 2011, 2012, 2013, 2014 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esql_private.h"
+
+/*
+ * histogram buckets are in microseconds: 0 to 3 get a bucket each, then every
+ * power of 2 is split in 4 buckets, so a bucket is at most 25% wide whatever
+ * the duration. the last bucket holds everything from about 2 hours.
+ */
+#define ESQL_HISTOGRAM_SUB_BITS 2
+#define ESQL_HISTOGRAM_SUB (1 << ESQL_HISTOGRAM_SUB_BITS)
+
+static unsigned int
+esql_histogram_index(unsigned long long us)
+{
+   unsigned int msb = 0, idx;
+
+   if (us < ESQL_HISTOGRAM_SUB) return us;
+   while (us >> (msb + 1)) msb++;
+   idx = (msb - ESQL_HISTOGRAM_SUB_BITS + 1) * ESQL_HISTOGRAM_SUB +
+     ((us >> (msb - ESQL_HISTOGRAM_SUB_BITS)) & (ESQL_HISTOGRAM_SUB - 1));
+   return (idx < ESQL_HISTOGRAM_BUCKETS) ? idx : ESQL_HISTOGRAM_BUCKETS - 1;
+}
+
+/* returns the first duration, in microseconds, which does not fit in bucket @p idx */
+static unsigned long long
+esql_histogram_bucket_end(unsigned int idx)
+{
+   unsigned int msb;
+
+   idx++;
+   if (idx < ESQL_HISTOGRAM_SUB) return idx;
+   msb = idx / ESQL_HISTOGRAM_SUB + ESQL_HISTOGRAM_SUB_BITS - 1;
+   return (unsigned long long)(ESQL_HISTOGRAM_SUB + idx % ESQL_HISTOGRAM_SUB) << (msb - ESQL_HISTOGRAM_SUB_BITS);
+}
+
+/* records a duration of @p t seconds */
+void
+esql_histogram_add(Esql_Histogram *h,
+                   double          t)
+{
+   if (t < 0) t = 0; /* the clock is monotonic, but the start may be unset */
+   h->count++;
+   h->total += t;
+   if (t > h->max) h->max = t;
+   /* anything from a day lands in the last bucket anyway */
+   h->buckets[esql_histogram_index((t < 86400) ? t * 1000000 : 86400000000ULL)]++;
+}
+
+static void
+esql_histogram_merge(Esql_Histogram       *h,
+                     const Esql_Histogram *add)
+{
+   unsigned int i;
+
+   h->count += add->count;
+   h->total += add->total;
+   if (add->max > h->max) h->max = add->max;
+   for (i = 0; i < ESQL_HISTOGRAM_BUCKETS; i++)
+     h->buckets[i] += add->buckets[i];
+}
+
+static void
+esql_stats_merge(Esql_Stats       *stats,
+                 const Esql_Stats *add)
+{
+   stats->submitted += add->submitted;
+   stats->completed += add->completed;
+   stats->failed += add->failed;
+   stats->bytes_sent += add->bytes_sent;
+   stats->bytes_received += add->bytes_received;
+   if (add->queue_max > stats->queue_max) stats->queue_max = add->queue_max;
+   esql_histogram_merge(&stats->queue_wait, &add->queue_wait);
+   esql_histogram_merge(&stats->exec, &add->exec);
+   esql_histogram_merge(&stats->callback, &add->callback);
+}
+
+/* a query was made, @p queued being the number of calls now waiting */
+void
+esql_stats_submit(Esql_Stats  *stats,
+                  unsigned int queued)
+{
+   stats->submitted++;
+   if (queued > stats->queue_max) stats->queue_max = queued;
+}
+
+/* a query of @p len bytes was handed to the backend of @p e */
+void
+esql_stats_send(Esql              *e,
+                unsigned int       len,
+                const Esql_Params *params)
+{
+   unsigned int i;
+
+   e->stats.bytes_sent += len;
+   if (!params) return;
+   for (i = 0; i < params->count; i++)
+     {
+        if (params->params[i].type == ESQL_PARAM_STRING)
+          e->stats.bytes_sent += params->params[i].len;
+        else if (params->params[i].type != ESQL_PARAM_NULL)
+          e->stats.bytes_sent += 8;
+     }
+}
+
+/* the current query of @p e has completed at e->query_end */
+void
+esql_stats_done(Esql      *e,
+                Eina_Bool  failed)
+{
+   if (failed)
+     e->stats.failed++;
+   else
+     e->stats.completed++;
+   if (e->query_start > 0)
+     esql_histogram_add(&e->stats.exec, e->query_end - e->query_start);
+}
+
+/**
+ * @defgroup Esql_Stats Statistics
+ * @brief Functions to monitor the queries made on a connection or pool
+ * @{*/
+
+/**
+ * @brief Return the statistics of a connection or pool
+ * Every connection keeps counters and latency histograms of the queries made on it,
+ * from its creation or the last call to esql_stats_reset(). The statistics of a pool
+ * add up those of its connections, along with the queries waiting for a connection.
+ * The histograms are:
+ * - queue_wait: from the query being made to its sending to the server, 0 if the connection was idle
+ * - exec: from sending to the result having been received
+ * - callback: time spent in the result callback, when the result is not delivered as an event
+ * @param e The #Esql object (NOT NULL)
+ * @param stats Where to store the statistics (NOT NULL)
+ * @return EINA_TRUE on success, EINA_FALSE on failure
+ * @note bytes_received is based on what the backend buffers: the result packets with MySQL, the
+ * cell data with PostgreSQL, and it stays at 0 with SQLite.
+ */
+Eina_Bool
+esql_stats_get(const Esql *e,
+               Esql_Stats *stats)
+{
+   const Esql_Pool *ep;
+   const Esql *m;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, EINA_FALSE);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(stats, EINA_FALSE);
+
+   if (!e->pool)
+     {
+        memcpy(stats, &e->stats, sizeof(Esql_Stats));
+        return EINA_TRUE;
+     }
+   ep = (const Esql_Pool *)e;
+   memcpy(stats, &ep->stats, sizeof(Esql_Stats));
+   EINA_INLIST_FOREACH(ep->esqls, m)
+     esql_stats_merge(stats, &m->stats);
+   return EINA_TRUE;
+}
+
+/**
+ * @brief Reset the statistics of a connection or pool
+ * @param e The #Esql object (NOT NULL), the connections of a pool are reset as well
+ */
+void
+esql_stats_reset(Esql *e)
+{
+   Esql_Pool *ep;
+   Esql *m;
+
+   EINA_SAFETY_ON_NULL_RETURN(e);
+
+   if (!e->pool)
+     {
+        memset(&e->stats, 0, sizeof(Esql_Stats));
+        return;
+     }
+   ep = (Esql_Pool *)e;
+   memset(&ep->stats, 0, sizeof(Esql_Stats));
+   EINA_INLIST_FOREACH(ep->esqls, m)
+     memset(&m->stats, 0, sizeof(Esql_Stats));
+}
+
+/**
+ * @brief Return a quantile of a histogram
+ * @param h The histogram (NOT NULL)
+ * @param q The quantile, between 0 and 1 (0.99 for the 99th percentile)
+ * @return The duration in seconds which @p q of the samples do not exceed, rounded up
+ * to the end of its bucket and at most the longest sample; 0 if @p h is empty.
+ */
+double
+esql_histogram_quantile(const Esql_Histogram *h,
+                        double                q)
+{
+   unsigned long long n, rank;
+   unsigned int i;
+   double t;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(h, 0);
+   if (!h->count) return 0;
+   if (q <= 0) q = 0;
+   if (q >= 1) return h->max;
+
+   /* the rank of the sample, rounded up */
+   rank = (unsigned long long)(q * h->count);
+   if (rank < q * h->count) rank++;
+   if (!rank) rank = 1;
+   for (i = 0, n = 0; i < ESQL_HISTOGRAM_BUCKETS - 1; i++)
+     {
+        n += h->buckets[i];
+        if (n >= rank) break;
+     }
+   t = esql_histogram_bucket_end(i) / 1000000.0;
+   return (t < h->max) ? t : h->max;
+}
+
+/** @} */
@@ -0,0 +1,542 @@
+/*
+ * Copyright 2011, 2012, 2013, 2014 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esql_private.h"
+#include <stdarg.h>
+
+/* longest placeholder written for one conversion: '$' and the parameter number */
+#define ESQL_STMT_PLACEHOLDER_MAX 11
+
+/*
+ * an Esql_Stmt only holds the backend-ready sql and the C types of its
+ * parameters, so it is not tied to a connection: every connection keeps
+ * its own LRU cache of backend handles keyed by sql, and prepares a statement
+ * the first time it executes it. this is what lets pool members run
+ * any statement prepared on their pool.
+ */
+
+typedef struct Esql_Stmt_Handle
+{
+   EINA_INLIST;
+   const char *sql; /* stringshared, key in the handle hash */
+   void       *handle; /* backend statement */
+} Esql_Stmt_Handle;
+
+static void
+esql_stmt_handle_free(Esql             *e,
+                      Esql_Stmt_Handle *h)
+{
+   e->backend.stmt_free(e, h->handle);
+   eina_stringshare_del(h->sql);
+   free(h);
+}
+
+static void
+esql_stmt_cache_evict(Esql *e)
+{
+   Esql_Stmt_Handle *h;
+
+   h = EINA_INLIST_CONTAINER_GET(e->stmts.lru, Esql_Stmt_Handle);
+   DBG("(e=%p, sql='%s')", e, h->sql);
+   e->stmts.lru = eina_inlist_remove(e->stmts.lru, e->stmts.lru);
+   eina_hash_del_by_key(e->stmts.handles, h->sql);
+   e->stmts.count--;
+   esql_stmt_handle_free(e, h);
+}
+
+/* must be called before the backend connection (or the backend itself) goes away */
+void
+esql_stmt_cache_clear(Esql *e)
+{
+   while (e->stmts.lru)
+     esql_stmt_cache_evict(e);
+   if (e->stmts.handles) eina_hash_free(e->stmts.handles);
+   e->stmts.handles = NULL;
+}
+
+/* prepares @p sql on @p e unless it is cached, then sends it with @p params */
+Eina_Bool
+esql_stmt_send(Esql              *e,
+               const char        *sql,
+               unsigned int       len,
+               const Esql_Params *params)
+{
+   Esql_Stmt_Handle *h;
+
+   if ((!e->backend.prepare) || (!e->backend.execute))
+     {
+        ERR("Prepared statements are not supported by this backend!");
+        return EINA_FALSE;
+     }
+   if (!e->stmts.handles)
+     {
+        e->stmts.handles = eina_hash_string_superfast_new(NULL);
+        EINA_SAFETY_ON_NULL_RETURN_VAL(e->stmts.handles, EINA_FALSE);
+     }
+
+   h = eina_hash_find(e->stmts.handles, sql);
+   if (h)
+     {
+        e->stmts.lru = eina_inlist_demote(e->stmts.lru, EINA_INLIST_GET(h));
+        e->stmts.hits++;
+        return e->backend.execute(e, h->handle, params);
+     }
+
+   while (e->stmts.count >= e->stmts.max)
+     esql_stmt_cache_evict(e);
+
+   e->stmts.misses++;
+   h = calloc(1, sizeof(Esql_Stmt_Handle));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(h, EINA_FALSE);
+   h->handle = e->backend.prepare(e, sql, len);
+   if (!h->handle)
+     {
+        free(h);
+        return EINA_FALSE;
+     }
+   h->sql = eina_stringshare_add_length(sql, len);
+   eina_hash_direct_add(e->stmts.handles, h->sql, h);
+   e->stmts.lru = eina_inlist_append(e->stmts.lru, EINA_INLIST_GET(h));
+   e->stmts.count++;
+   DBG("(e=%p, sql='%s'): prepared, %u statements cached", e, h->sql, e->stmts.count);
+
+   return e->backend.execute(e, h->handle, params);
+}
+
+static Esql_Stmt *
+esql_stmt_parse(Esql_Type   type,
+                const char *fmt)
+{
+   Esql_Stmt *stmt;
+   const char *p;
+   char *sp;
+   unsigned int convs = 0;
+
+   for (p = strchr(fmt, '%'); p; p = strchr(p + 1, '%'))
+     convs++;
+
+   stmt = calloc(1, sizeof(Esql_Stmt));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(stmt, NULL);
+   stmt->sql = malloc(strlen(fmt) + convs * ESQL_STMT_PLACEHOLDER_MAX + 1);
+   EINA_SAFETY_ON_NULL_GOTO(stmt->sql, error);
+   if (convs)
+     {
+        stmt->args = malloc(convs);
+        EINA_SAFETY_ON_NULL_GOTO(stmt->args, error);
+     }
+
+   for (p = fmt, sp = stmt->sql; *p; p++)
+     {
+        Esql_Stmt_Arg arg;
+        unsigned int l = 0;
+
+        if (*p != '%')
+          {
+             *sp++ = *p;
+             continue;
+          }
+        for (p++; *p == 'l'; p++)
+          l++;
+        switch (*p)
+          {
+           case '%':
+             if (l) goto invalid;
+             *sp++ = '%';
+             continue;
+
+           case 'i':
+           case 'd':
+             if (l > 2) goto invalid;
+             arg = (l == 2) ? ESQL_STMT_ARG_LLONG : (l ? ESQL_STMT_ARG_LONG : ESQL_STMT_ARG_INT);
+             break;
+
+           case 'u':
+             if (l > 2) goto invalid;
+             arg = (l == 2) ? ESQL_STMT_ARG_ULLONG : (l ? ESQL_STMT_ARG_ULONG : ESQL_STMT_ARG_UINT);
+             break;
+
+           case 'f':
+             if (l > 1) goto invalid;
+             arg = ESQL_STMT_ARG_DOUBLE;
+             break;
+
+           case 's':
+             if (l) goto invalid;
+             arg = ESQL_STMT_ARG_STRING;
+             break;
+
+           case 'c':
+             if (l) goto invalid;
+             arg = ESQL_STMT_ARG_CHAR;
+             break;
+
+           default:
+             goto invalid;
+          }
+
+        /* '%s' is quoted for esql_query_args(), a placeholder must not be */
+        if ((sp > stmt->sql) && (sp[-1] == '\'') && (p[1] == '\''))
+          {
+             sp--;
+             p++;
+          }
+        stmt->args[stmt->count++] = arg;
+        if (type == ESQL_TYPE_POSTGRESQL) /* postgresql numbers its placeholders */
+          sp += sprintf(sp, "$%u", stmt->count);
+        else
+          *sp++ = '?';
+     }
+   *sp = 0;
+   stmt->len = sp - stmt->sql;
+   return stmt;
+
+invalid:
+   ERR("Unsupported format string: '%s'!", fmt);
+error:
+   free(stmt->args);
+   free(stmt->sql);
+   free(stmt);
+   return NULL;
+}
+
+static Esql_Params *
+esql_stmt_params_new(const Esql_Stmt *stmt,
+                     va_list          args)
+{
+   Esql_Params *params;
+   Esql_Param *param;
+   va_list copy;
+   size_t size = 0;
+   const char *s;
+   char *str;
+   unsigned int i;
+
+   /* strings are copied behind the params, so measure them first */
+   va_copy(copy, args);
+   for (i = 0; i < stmt->count; i++)
+     switch (stmt->args[i])
+       {
+        case ESQL_STMT_ARG_INT:
+        case ESQL_STMT_ARG_CHAR:
+          (void)va_arg(copy, int);
+          if (stmt->args[i] == ESQL_STMT_ARG_CHAR) size += 2;
+          break;
+        case ESQL_STMT_ARG_UINT:
+          (void)va_arg(copy, unsigned int);
+          break;
+        case ESQL_STMT_ARG_LONG:
+          (void)va_arg(copy, long int);
+          break;
+        case ESQL_STMT_ARG_ULONG:
+          (void)va_arg(copy, unsigned long int);
+          break;
+        case ESQL_STMT_ARG_LLONG:
+          (void)va_arg(copy, long long int);
+          break;
+        case ESQL_STMT_ARG_ULLONG:
+          (void)va_arg(copy, unsigned long long int);
+          break;
+        case ESQL_STMT_ARG_DOUBLE:
+          (void)va_arg(copy, double);
+          break;
+        case ESQL_STMT_ARG_STRING:
+          s = va_arg(copy, const char *);
+          if (s) size += strlen(s) + 1;
+          break;
+       }
+   va_end(copy);
+
+   params = malloc(sizeof(Esql_Params) + stmt->count * sizeof(Esql_Param) + size);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(params, NULL);
+   params->count = stmt->count;
+   str = (char *)(params->params + stmt->count);
+
+   for (i = 0, param = params->params; i < stmt->count; i++, param++)
+     {
+        param->len = 0;
+        switch (stmt->args[i])
+          {
+           case ESQL_STMT_ARG_INT:
+             param->type = ESQL_PARAM_INT64;
+             param->v.i = va_arg(args, int);
+             break;
+           case ESQL_STMT_ARG_UINT:
+             param->type = ESQL_PARAM_INT64;
+             param->v.i = va_arg(args, unsigned int);
+             break;
+           case ESQL_STMT_ARG_LONG:
+             param->type = ESQL_PARAM_INT64;
+             param->v.i = va_arg(args, long int);
+             break;
+           case ESQL_STMT_ARG_ULONG:
+             param->type = ESQL_PARAM_INT64;
+             param->v.i = va_arg(args, unsigned long int);
+             break;
+           case ESQL_STMT_ARG_LLONG:
+             param->type = ESQL_PARAM_INT64;
+             param->v.i = va_arg(args, long long int);
+             break;
+           case ESQL_STMT_ARG_ULLONG:
+             param->type = ESQL_PARAM_INT64;
+             param->v.i = va_arg(args, unsigned long long int);
+             break;
+           case ESQL_STMT_ARG_DOUBLE:
+             param->type = ESQL_PARAM_DOUBLE;
+             param->v.d = va_arg(args, double);
+             break;
+           case ESQL_STMT_ARG_CHAR:
+             param->type = ESQL_PARAM_STRING;
+             param->len = 1;
+             str[0] = va_arg(args, int);
+             str[1] = 0;
+             param->v.s = str;
+             str += 2;
+             break;
+           case ESQL_STMT_ARG_STRING:
+             s = va_arg(args, const char *);
+             if (!s)
+               {
+                  param->type = ESQL_PARAM_NULL;
+                  break;
+               }
+             param->type = ESQL_PARAM_STRING;
+             param->len = strlen(s);
+             memcpy(str, s, param->len + 1);
+             param->v.s = str;
+             str += param->len + 1;
+             break;
+          }
+     }
+   return params;
+}
+
+/**
+ * @defgroup Esql_Stmt Prepared statements
+ * @brief Functions to prepare queries once and execute them many times
+ * @{*/
+
+/**
+ * @brief Prepare a statement
+ * This function creates a statement from a format string which uses the same
+ * printf-style conversions as esql_query_args(): each conversion becomes a placeholder
+ * which is bound to a value at execution, so the query is only parsed once by
+ * the server and its arguments never need to be escaped. Quotes around a conversion
+ * ('%s') are dropped, so the format strings of esql_query_args() can be reused as-is.
+ * The statement is prepared on a connection the first time that connection executes it,
+ * and stays in a per-connection cache (see esql_stmt_cache_size_set()). On a pool, each
+ * member prepares it on its own.
+ * @param e The #Esql object (or pool) to prepare the statement for (NOT NULL)
+ * @param fmt The format string for the query (NOT NULL)
+ * @return The statement, or NULL on failure
+ */
+Esql_Stmt *
+esql_prepare(Esql       *e,
+             const char *fmt)
+{
+   Esql_Stmt *stmt;
+
+   DBG("(e=%p, fmt='%s')", e, fmt);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, NULL);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(fmt, NULL);
+
+   stmt = esql_stmt_parse(e->type, fmt);
+   if (stmt) stmt->e = e;
+   return stmt;
+}
+
+/**
+ * @brief Execute a prepared statement
+ * Use this function to run @p stmt with the arguments for its conversions. The result is
+ * delivered like the result of esql_query_full(): to @p cb if it is not NULL, otherwise
+ * with ESQL_EVENT_RESULT.
+ * A NULL string argument is bound as SQL NULL.
+ * @param stmt The statement (NOT NULL)
+ * @param cb The callback to call with the result, or NULL
+ * @param data Data to associate with the result
+ * @return Query identifier or 0 on failure.
+ */
+Esql_Query_Id
+esql_execute(Esql_Stmt    *stmt,
+             Esql_Query_Cb cb,
+             void         *data,
+             ...)
+{
+   va_list args;
+   Esql_Query_Id ret;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(stmt, 0);
+   va_start(args, data);
+   ret = esql_execute_vargs(stmt, cb, data, args);
+   va_end(args);
+   return ret;
+}
+
+/**
+ * @brief Execute a prepared statement with a va_list
+ * @see esql_execute
+ * @param stmt The statement (NOT NULL)
+ * @param cb The callback to call with the result, or NULL
+ * @param data Data to associate with the result
+ * @param args The arg list for the conversions of @p stmt
+ * @return Query identifier or 0 on failure.
+ */
+Esql_Query_Id
+esql_execute_vargs(Esql_Stmt    *stmt,
+                   Esql_Query_Cb cb,
+                   void         *data,
+                   va_list       args)
+{
+   Esql_Params *params;
+   Esql *e;
+   char *query;
+
+   DBG("(stmt=%p, sql='%s')", stmt, stmt ? stmt->sql : NULL);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(stmt, 0);
+   e = stmt->e;
+   if (!e->connected)
+     {
+        ERR("Esql object must be connected!");
+        return 0;
+     }
+
+   params = esql_stmt_params_new(stmt, args);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(params, 0);
+   if (e->pool) return esql_pool_execute((Esql_Pool *)e, stmt, params, cb, data);
+
+   query = strdup(stmt->sql);
+   if (!query)
+     {
+        free(params);
+        return 0;
+     }
+   return esql_query_send(e, query, stmt->len, params, NULL, cb, data);
+}
+
+/**
+ * @brief Return the query of a prepared statement
+ * @param stmt The statement (NOT NULL)
+ * @return The query as sent to the server, with the backend's placeholders
+ */
+const char *
+esql_stmt_query_get(const Esql_Stmt *stmt)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(stmt, NULL);
+
+   return stmt->sql;
+}
+
+/**
+ * @brief Free a prepared statement
+ * Executions which are still queued are not affected, and the statement stays in
+ * the connection caches until it is evicted.
+ * @param stmt The statement (NOT NULL)
+ */
+void
+esql_stmt_free(Esql_Stmt *stmt)
+{
+   EINA_SAFETY_ON_NULL_RETURN(stmt);
+
+   free(stmt->args);
+   free(stmt->sql);
+   free(stmt);
+}
+
+/**
+ * @brief Set the number of prepared statements a connection keeps
+ * When a connection executes a statement which is not in its cache while the cache
+ * is full, the least recently used statement is released on the server.
+ * @param e The #Esql object (NOT NULL), for a pool the size applies to each member
+ * @param size The number of statements, at least 1 (default: 32)
+ */
+void
+esql_stmt_cache_size_set(Esql        *e,
+                         unsigned int size)
+{
+   EINA_SAFETY_ON_NULL_RETURN(e);
+   EINA_SAFETY_ON_TRUE_RETURN(size < 1);
+
+   if (e->pool)
+     {
+        esql_pool_stmt_cache_size_set((Esql_Pool *)e, size);
+        return;
+     }
+   e->stmts.max = size;
+   while (e->stmts.count > e->stmts.max)
+     esql_stmt_cache_evict(e);
+}
+
+/**
+ * @brief Return the number of prepared statements a connection keeps
+ * @param e The #Esql object (NOT NULL)
+ * @return The cache size
+ */
+unsigned int
+esql_stmt_cache_size_get(const Esql *e)
+{
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e, 0);
+
+   if (e->pool)
+     {
+        const Esql_Pool *ep = (const Esql_Pool *)e;
+
+        return EINA_INLIST_CONTAINER_GET(ep->esqls, Esql)->stmts.max;
+     }
+   return e->stmts.max;
+}
+
+/**
+ * @brief Return how often a connection could reuse a prepared statement
+ * Executions of an #Esql_Stmt are counted, and so are plain queries on backends
+ * which keep their statements prepared by query text (SQLite).
+ * @param e The #Esql object (NOT NULL), for a pool the members are summed up
+ * @param hits Pointer to store the number of statements found in a cache (or NULL)
+ * @param misses Pointer to store the number of statements which had to be prepared (or NULL)
+ */
+void
+esql_stmt_cache_stats_get(const Esql         *e,
+                          unsigned long long *hits,
+                          unsigned long long *misses)
+{
+   unsigned long long h = 0, m = 0;
+
+   if (hits) *hits = 0;
+   if (misses) *misses = 0;
+   EINA_SAFETY_ON_NULL_RETURN(e);
+
+   if (e->pool)
+     {
+        const Esql_Pool *ep = (const Esql_Pool *)e;
+        const Esql *es;
+
+        EINA_INLIST_FOREACH(ep->esqls, es)
+          {
+             h += es->stmts.hits;
+             m += es->stmts.misses;
+          }
+     }
+   else
+     {
+        h = e->stmts.hits;
+        m = e->stmts.misses;
+     }
+   if (hits) *hits = h;
+   if (misses) *misses = m;
+}
+
+/** @} */
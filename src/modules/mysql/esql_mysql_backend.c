@@ -18,6 +18,7 @@
 #include "esql_module.h"
 #include "mysac/mysac.h"
 #include <unistd.h>
+#include <errno.h>
 
 #define ESQL_MYSAC_SWITCH_RET(X) \
    switch (X) \
@@ -33,6 +34,58 @@
      } \
    return ECORE_FD_ERROR
 
+typedef struct Esql_Mysac_Stmt
+{
+   unsigned int id; /* set by mysac, with the MSB set if the statement returns rows */
+   char        *query;
+   unsigned int len;
+   Eina_Bool    prepared : 1;
+} Esql_Mysac_Stmt;
+
+/* queries pipelined behind the current one: their COM_QUERY packets are
+ * written as soon as the socket takes them, and once the response to the
+ * current query has been read mysac is pointed at the next one
+ */
+typedef struct Esql_Mysac_Pipeline
+{
+   char        *buf; /* COM_QUERY packets not written yet */
+   unsigned int size;
+   unsigned int len;
+   unsigned int sent; /* bytes of buf already written */
+   unsigned int queued; /* pipelined queries whose response has not been started */
+   Eina_Bool    done : 1; /* the response to the current query has been read */
+} Esql_Mysac_Pipeline;
+
+/* sizes are tracked in power of 2 buckets from 1kB to 8MB */
+#define ESQL_MYSAC_SIZE_SHIFT 10
+#define ESQL_MYSAC_SIZE_BUCKETS 14
+/* weight kept by older samples at each new one, so about the last 50 count */
+#define ESQL_MYSAC_SIZE_DECAY 0.98
+/* buffers are sized to hold this share of recent requests without growing */
+#define ESQL_MYSAC_SIZE_QUANTILE 0.95
+#define ESQL_MYSAC_RES_MIN 2048
+#define ESQL_MYSAC_BUF_MIN 4096
+/* result blocks kept for reuse by a connection */
+#define ESQL_MYSAC_RES_FREELIST 4
+
+typedef struct Esql_Mysac_Sizes
+{
+   double counts[ESQL_MYSAC_SIZE_BUCKETS];
+   double total;
+} Esql_Mysac_Sizes;
+
+/* e->backend.db, used as a MYSAC everywhere since it is the first member */
+typedef struct Esql_Mysac
+{
+   MYSAC            m;
+   Esql_Mysac_Sizes res_sizes; /* memory used by recent results */
+   Esql_Mysac_Sizes cmd_sizes; /* recent commands built in the send buffer */
+   MYSAC_RES       *res_free[ESQL_MYSAC_RES_FREELIST]; /* oldest first */
+   unsigned int     res_free_count;
+   const char      *built; /* last query returned by esql_mysac_escape() which was built in place */
+   const char      *built_at; /* where its packet goes, in the send or the pipeline buffer */
+} Esql_Mysac;
+
 static const char *esql_mysac_error_get(Esql *e);
 static void esql_mysac_disconnect(Esql *e);
 static int esql_mysac_fd_get(Esql *e);
@@ -40,14 +93,101 @@ static int esql_mysac_connect(Esql *e);
 static void esql_mysac_database_set(Esql *e, const char *database_name);
 static int esql_mysac_io(Esql *e);
 static void esql_mysac_setup(Esql *e, const char *addr, const char *user, const char *passwd);
-static void esql_mysac_query(Esql *e, const char *query, unsigned int len EINA_UNUSED);
+static void esql_mysac_query(Esql *e, const char *query, unsigned int len);
+static void *esql_mysac_prepare(Esql *e, const char *query, unsigned int len);
+static Eina_Bool esql_mysac_execute(Esql *e, void *stmt, const Esql_Params *params);
+static Eina_Bool esql_mysac_execute_send(Esql *e, Esql_Mysac_Stmt *stmt, const Esql_Params *params);
+static Eina_Bool esql_mysac_pipeline(Esql *e, const char *query, unsigned int len);
+static void esql_mysac_stmt_free(Esql *e, void *stmt);
 static void esql_mysac_res_free(Esql_Res *res);
 static void esql_mysac_res(Esql_Res *res);
 static char *esql_mysac_escape(Esql *e, unsigned int *len, const char *fmt, va_list args);
 static void esql_mysac_row_init(Esql_Row *r, MYSAC_ROW *row);
+static Eina_Bool esql_mysac_column_add(Esql_Res *res, MYSAC_ROW *row);
 static void esql_mysac_free(Esql *e);
 
 
+static void
+esql_mysac_sizes_add(Esql_Mysac_Sizes *s, unsigned int size)
+{
+   unsigned int i, b;
+
+   for (i = 0; i < ESQL_MYSAC_SIZE_BUCKETS; i++)
+     s->counts[i] *= ESQL_MYSAC_SIZE_DECAY;
+   s->total = s->total * ESQL_MYSAC_SIZE_DECAY + 1;
+   for (b = 0; b < ESQL_MYSAC_SIZE_BUCKETS - 1; b++)
+     if (size <= (1U << (b + ESQL_MYSAC_SIZE_SHIFT))) break;
+   s->counts[b] += 1;
+}
+
+/* returns the size holding ESQL_MYSAC_SIZE_QUANTILE of the recent samples, at least @p min */
+static unsigned int
+esql_mysac_sizes_get(const Esql_Mysac_Sizes *s, unsigned int min)
+{
+   double sum = 0;
+   unsigned int b, size;
+
+   if (s->total <= 0) return min;
+   for (b = 0; b < ESQL_MYSAC_SIZE_BUCKETS - 1; b++)
+     {
+        sum += s->counts[b];
+        if (sum >= s->total * ESQL_MYSAC_SIZE_QUANTILE) break;
+     }
+   size = 1U << (b + ESQL_MYSAC_SIZE_SHIFT);
+   return (size > min) ? size : min;
+}
+
+/* returns a result block sized for what the connection has recently been receiving */
+static MYSAC_RES *
+esql_mysac_res_new(Esql *e)
+{
+   Esql_Mysac *em = e->backend.db;
+   MYSAC_RES *res;
+   unsigned int size, i;
+
+   size = esql_mysac_sizes_get(&em->res_sizes, ESQL_MYSAC_RES_MIN);
+   /* the most recently freed block which is large enough */
+   for (i = em->res_free_count; i > 0; i--)
+     if (em->res_free[i - 1]->buffer_len + sizeof(MYSAC_RES) >= size) break;
+   if (!i)
+     {
+        res = mysac_new_res(size, 1);
+        EINA_SAFETY_ON_NULL_RETURN_VAL(res, NULL);
+        return res;
+     }
+   res = em->res_free[--i];
+   em->res_free_count--;
+   memmove(em->res_free + i, em->res_free + i + 1, (em->res_free_count - i) * sizeof(MYSAC_RES *));
+   mysac_reuse_res(res);
+   res->extend_bloc_size = size;
+   return res;
+}
+
+/* keeps a result block for a later query, unless it is no longer the right size */
+static void
+esql_mysac_res_release(Esql *e, MYSAC_RES *res)
+{
+   Esql_Mysac *em = e->backend.db;
+   unsigned int size, len;
+
+   if (!res) return;
+   size = esql_mysac_sizes_get(&em->res_sizes, ESQL_MYSAC_RES_MIN);
+   len = res->buffer_len + sizeof(MYSAC_RES);
+   /* too small to be picked again, or too large to be worth holding on to */
+   if ((len < size) || (len > size * 4))
+     {
+        mysac_free_res(res);
+        return;
+     }
+   if (em->res_free_count == ESQL_MYSAC_RES_FREELIST)
+     {
+        mysac_free_res(em->res_free[0]);
+        em->res_free_count--;
+        memmove(em->res_free, em->res_free + 1, em->res_free_count * sizeof(MYSAC_RES *));
+     }
+   em->res_free[em->res_free_count++] = res;
+}
+
 static void
 esql_module_setup_cb(MYSAC_RES *re, int col, Eina_Value_Struct_Member *m)
 {
@@ -116,6 +256,25 @@ esql_mysac_error_get(Esql *e)
    return mysac_advance_error(e->backend.db);
 }
 
+static void
+esql_mysac_stmt_closed_free(Esql *e)
+{
+   Esql_Mysac_Stmt *stmt;
+
+   EINA_LIST_FREE(e->backend.stmt_closed, stmt)
+     free(stmt);
+}
+
+static void
+esql_mysac_pipeline_reset(Esql *e)
+{
+   Esql_Mysac_Pipeline *p = e->backend.pipeline_data;
+
+   if (!p) return;
+   p->len = p->sent = p->queued = 0;
+   p->done = EINA_FALSE;
+}
+
 static void
 esql_mysac_disconnect(Esql *e)
 {
@@ -126,6 +285,10 @@ esql_mysac_disconnect(Esql *e)
    const char *password;
    size_t size;
 
+   /* a preparation in flight is dropped with the connection */
+   e->backend.stmt = NULL;
+   esql_mysac_stmt_closed_free(e);
+   esql_mysac_pipeline_reset(e);
    /* mysac is very complicated :/ */
    m = e->backend.db;
    if (m->fd >= 0) close(m->fd);
@@ -162,10 +325,88 @@ esql_mysac_database_set(Esql *e, const char *database_name)
    mysac_set_database(e->backend.db, database_name);
 }
 
+/* writes as much of the pipelined packets as the socket takes, returns MYERR_WANT_WRITE while some are left */
+static int
+esql_mysac_pipeline_flush(Esql *e, Esql_Mysac_Pipeline *p)
+{
+   MYSAC *m;
+   ssize_t n;
+
+   if (p->sent == p->len) return 0;
+   m = e->backend.db;
+   /* they go out behind the packet of the current query */
+   if ((m->qst == MYSAC_SEND_QUERY) && (m->len > 0)) return MYERR_WANT_WRITE;
+   n = write(m->fd, p->buf + p->sent, p->len - p->sent);
+   if (n < 0)
+     {
+        if ((errno == EAGAIN) || (errno == EINTR)) return MYERR_WANT_WRITE;
+        m->errorcode = MYERR_SERVER_LOST;
+        return MYERR_SERVER_LOST;
+     }
+   p->sent += n;
+   if (p->sent < p->len) return MYERR_WANT_WRITE;
+   p->len = p->sent = 0;
+   return 0;
+}
+
+/* the current query was pipelined: its response is the next one on the connection */
+static Eina_Bool
+esql_mysac_pipeline_recv(Esql *e, Esql_Mysac_Pipeline *p)
+{
+   MYSAC_RES *res;
+   MYSAC *m;
+
+   p->done = EINA_FALSE;
+   p->queued--;
+   m = e->backend.db;
+   /* forget the error of a previous query */
+   m->errorcode = 0;
+   m->mysql_error = NULL;
+   res = esql_mysac_res_new(e);
+   if (!res) return EINA_FALSE;
+   if (mysac_b_recv_query(m, res, e->cur_query, strlen(e->cur_query)))
+     {
+        esql_mysac_res_release(e, res);
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
 static int
 esql_mysac_io(Esql *e)
 {
-   ESQL_MYSAC_SWITCH_RET(mysac_io(e->backend.db));
+   Esql_Mysac_Pipeline *p = e->backend.pipeline_data;
+   Esql_Mysac_Stmt *stmt;
+   int ret, flush;
+
+   if (p && p->done && (!esql_mysac_pipeline_recv(e, p))) return ECORE_FD_ERROR;
+   ret = mysac_io(e->backend.db);
+   if (p)
+     {
+        if ((ret != MYERR_WANT_READ) && (ret != MYERR_WANT_WRITE))
+          p->done = !!p->queued;
+        else if (ret == MYERR_WANT_READ)
+          {
+             flush = esql_mysac_pipeline_flush(e, p);
+             if (flush == MYERR_WANT_WRITE) return ECORE_FD_READ | ECORE_FD_WRITE;
+             if (flush) return ECORE_FD_ERROR;
+          }
+     }
+   if ((!e->backend.stmt) || (ret == MYERR_WANT_READ) || (ret == MYERR_WANT_WRITE))
+     {
+        ESQL_MYSAC_SWITCH_RET(ret);
+     }
+
+   /* the statement of the current query has been prepared (or failed to), execute it */
+   stmt = e->backend.stmt;
+   e->backend.stmt = NULL;
+   if (!ret)
+     {
+        stmt->prepared = EINA_TRUE;
+        if (!esql_mysac_execute_send(e, stmt, e->cur_params)) return ECORE_FD_ERROR;
+        ret = mysac_io(e->backend.db);
+     }
+   ESQL_MYSAC_SWITCH_RET(ret);
 }
 
 static void
@@ -174,14 +415,241 @@ esql_mysac_setup(Esql *e, const char *addr, const char *user, const char *passwd
    mysac_setup(e->backend.db, eina_stringshare_add(addr), eina_stringshare_add(user), eina_stringshare_add(passwd), e->database, 0);
 }
 
+/* mysac is dumb and uses a user-allocated buffer, so we have to manually resize it:
+ * it is sized for the recent commands, so one huge query does not pin its memory
+ * for the lifetime of the connection. called while building a command, so the
+ * first @p len bytes are kept.
+ */
+static Eina_Bool
+esql_mysac_buf_reserve(MYSAC *m, unsigned int len)
+{
+   Esql_Mysac *em = (Esql_Mysac *)m;
+   unsigned int size;
+   char *tmp;
+
+   esql_mysac_sizes_add(&em->cmd_sizes, len);
+   size = esql_mysac_sizes_get(&em->cmd_sizes, ESQL_MYSAC_BUF_MIN);
+   if (len <= m->bufsize)
+     {
+        /* only shrink back once the large commands are out of the history */
+        if ((m->bufsize <= size * 4) || (len > size)) return EINA_TRUE;
+     }
+   else if (size < len)
+     size = len * 2;
+   tmp = realloc(m->buf, size);
+   if (!tmp) /* we're so fucked */
+     {
+        if (len <= m->bufsize) return EINA_TRUE;
+        ERR("Alloc! We're in trouble!");
+        m->errorcode = MYERR_BUFFER_TOO_SMALL;
+        return EINA_FALSE;
+     }
+   m->buf = tmp;
+   m->bufsize = size;
+   return EINA_TRUE;
+}
+
 static void
-esql_mysac_query(Esql *e, const char *query, unsigned int len EINA_UNUSED)
+esql_mysac_query(Esql *e, const char *query, unsigned int len)
 {
    MYSAC_RES *res;
+   MYSAC *m;
+
+   Esql_Mysac *em;
+   Eina_Bool built;
+
+   m = e->backend.db;
+   em = (Esql_Mysac *)m;
+   if (!esql_mysac_buf_reserve(m, len + 5)) return;
+   /* checked after the reserve, which may move the buffer */
+   built = (query == em->built) && (m->buf + 5 == em->built_at);
+   em->built = NULL;
+   res = esql_mysac_res_new(e);
+   if (!res) return;
+   if (built)
+     mysac_b_set_query_in_place(m, res, len);
+   else
+     mysac_b_set_query(m, res, query, len);
+}
+
+static Eina_Bool
+esql_mysac_pipeline(Esql *e, const char *query, unsigned int len)
+{
+   Esql_Mysac_Pipeline *p = e->backend.pipeline_data;
+   Esql_Mysac *em = e->backend.db;
+   const char *built = em->built;
+   char *buf;
 
-   res = mysac_new_res(2048, 1);
-   EINA_SAFETY_ON_NULL_RETURN(res);
-   mysac_s_set_query(e->backend.db, res, query);
+   em->built = NULL;
+
+   /* mysac does not split queries over several packets */
+   if (len + 1 >= 0xffffff) return EINA_FALSE;
+   if (!p)
+     {
+        p = calloc(1, sizeof(Esql_Mysac_Pipeline));
+        EINA_SAFETY_ON_NULL_RETURN_VAL(p, EINA_FALSE);
+        e->backend.pipeline_data = p;
+     }
+   if (p->len + len + 5 > p->size)
+     {
+        buf = realloc(p->buf, (p->len + len + 5) * 2);
+        EINA_SAFETY_ON_NULL_RETURN_VAL(buf, EINA_FALSE);
+        p->buf = buf;
+        p->size = (p->len + len + 5) * 2;
+     }
+   buf = p->buf + p->len;
+   buf[0] = (len + 1) & 0xff; /* 3 byte length */
+   buf[1] = ((len + 1) >> 8) & 0xff;
+   buf[2] = ((len + 1) >> 16) & 0xff;
+   buf[3] = 0; /* packet number */
+   buf[4] = COM_QUERY;
+   if ((query != built) || (buf + 5 != em->built_at))
+     memcpy(buf + 5, query, len);
+   p->len += len + 5;
+   p->queued++;
+   /* errors show up when reading the responses */
+   esql_mysac_pipeline_flush(e, p);
+   return EINA_TRUE;
+}
+
+static void *
+esql_mysac_prepare(Esql *e EINA_UNUSED, const char *query, unsigned int len)
+{
+   Esql_Mysac_Stmt *stmt;
+
+   /* nothing is sent until the first execution */
+   stmt = calloc(1, sizeof(Esql_Mysac_Stmt));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(stmt, NULL);
+   stmt->query = malloc(len + 1);
+   if (!stmt->query)
+     {
+        free(stmt);
+        return NULL;
+     }
+   memcpy(stmt->query, query, len);
+   stmt->query[len] = 0;
+   stmt->len = len;
+   return stmt;
+}
+
+static Eina_Bool
+esql_mysac_execute_send(Esql *e, Esql_Mysac_Stmt *stmt, const Esql_Params *params)
+{
+   const Esql_Param *p;
+   MYSAC_BIND *binds;
+   MYSAC_RES *res;
+   MYSAC *m;
+   unsigned int i, size;
+
+   m = e->backend.db;
+   /* header, NULL bitmap and types, then the values */
+   size = 16 + params->count / 8 + params->count * 2;
+   binds = alloca(params->count * sizeof(MYSAC_BIND) + 1);
+   memset(binds, 0, params->count * sizeof(MYSAC_BIND));
+   for (i = 0, p = params->params; i < params->count; i++, p++)
+     switch (p->type)
+       {
+        case ESQL_PARAM_INT64:
+          binds[i].type = MYSQL_TYPE_LONGLONG;
+          binds[i].value = (void *)&p->v.i;
+          size += 8;
+          break;
+        case ESQL_PARAM_DOUBLE:
+          binds[i].type = MYSQL_TYPE_DOUBLE;
+          binds[i].value = (void *)&p->v.d;
+          size += 8;
+          break;
+        case ESQL_PARAM_STRING:
+          binds[i].type = MYSQL_TYPE_VAR_STRING;
+          binds[i].value = (void *)p->v.s;
+          binds[i].value_len = p->len;
+          size += p->len + 9;
+          break;
+        default:
+          binds[i].type = MYSQL_TYPE_NULL;
+          binds[i].is_null = 1;
+          break;
+       }
+   if (!esql_mysac_buf_reserve(m, size)) return EINA_FALSE;
+
+   res = esql_mysac_res_new(e);
+   if (!res) return EINA_FALSE;
+   if (mysac_set_stmt_execute(m, res, stmt->id, binds, params->count))
+     {
+        esql_mysac_res_release(e, res);
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
+/* COM_STMT_CLOSE gets no reply, so evicted statements are closed by sending
+ * their packets right in front of the next command built in the send buffer
+ */
+static Eina_Bool
+esql_mysac_stmt_closed_flush(Esql *e)
+{
+   Esql_Mysac_Stmt *stmt;
+   unsigned int n;
+   MYSAC *m;
+   char *p;
+
+   n = eina_list_count(e->backend.stmt_closed);
+   if (!n) return EINA_TRUE;
+   m = e->backend.db;
+   if (!esql_mysac_buf_reserve(m, m->len + n * 9)) return EINA_FALSE;
+   memmove(m->buf + n * 9, m->buf, m->len);
+   p = m->buf;
+   EINA_LIST_FREE(e->backend.stmt_closed, stmt)
+     {
+        unsigned int id = stmt->id & 0x7fffffff;
+
+        p[0] = 5; /* 3 byte length */
+        p[1] = p[2] = 0;
+        p[3] = 0; /* packet number */
+        p[4] = COM_STMT_CLOSE;
+        p[5] = id & 0xff;
+        p[6] = (id >> 8) & 0xff;
+        p[7] = (id >> 16) & 0xff;
+        p[8] = (id >> 24) & 0xff;
+        p += 9;
+        free(stmt);
+     }
+   m->send = m->buf;
+   m->len += n * 9;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+esql_mysac_execute(Esql *e, void *data, const Esql_Params *params)
+{
+   Esql_Mysac_Stmt *stmt = data;
+   MYSAC *m;
+
+   if (stmt->prepared) return esql_mysac_execute_send(e, stmt, params);
+
+   m = e->backend.db;
+   if (!esql_mysac_buf_reserve(m, stmt->len + 5)) return EINA_FALSE;
+   if (mysac_b_set_stmt_prepare(m, &stmt->id, stmt->query, stmt->len))
+     {
+        m->errorcode = MYERR_BUFFER_TOO_SMALL;
+        return EINA_FALSE;
+     }
+   if (!esql_mysac_stmt_closed_flush(e)) return EINA_FALSE;
+   e->backend.stmt = stmt;
+   return EINA_TRUE;
+}
+
+static void
+esql_mysac_stmt_free(Esql *e, void *data)
+{
+   Esql_Mysac_Stmt *stmt = data;
+
+   free(stmt->query);
+   stmt->query = NULL;
+   if (stmt->prepared && e->connected)
+     e->backend.stmt_closed = eina_list_append(e->backend.stmt_closed, stmt);
+   else
+     free(stmt);
 }
 
 static void
@@ -193,7 +661,7 @@ esql_mysac_res_free(Esql_Res *res)
    mysac->errorcode = 0;
    mysac->mysql_error = NULL;
 
-   mysac_free_res(res->backend.res);
+   esql_mysac_res_release(res->e, res->backend.res);
 }
 
 static void
@@ -207,6 +675,12 @@ esql_mysac_res(Esql_Res *res)
    re = res->backend.res = mysac_get_res(res->e->backend.db);
    if (!re) return;
    m = res->e->backend.db;
+   /* the unused tail of the last chunk is all that is left of the result's memory */
+   if ((m->read_len >= 0) && (m->read_len < re->max_len))
+     {
+        esql_mysac_sizes_add(&((Esql_Mysac *)m)->res_sizes, re->max_len - m->read_len);
+        res->e->stats.bytes_received += re->max_len - m->read_len;
+     }
    res->desc = esql_module_desc_get(re->nb_cols, (Esql_Module_Setup_Cb)esql_module_setup_cb, res);
    mysac_first_row(re);
    row = mysac_fetch_row(re);
@@ -216,42 +690,69 @@ esql_mysac_res(Esql_Res *res)
         res->id = m->insert_id;
         return;
      }
-   res->row_count = mysac_num_rows(re);
+   if (res->e->columnar && esql_res_columns_setup(res) && res->columns)
+     {
+        do
+          {
+             if (!esql_mysac_column_add(res, row))
+               {
+                  esql_res_columns_fail(res);
+                  return;
+               }
+             res->row_count++;
+             if (ESQL_RES_STREAM_FULL(res)) esql_res_stream_flush(res);
+          } while ((row = mysac_fetch_row(re)));
+        return;
+     }
+   /* mysac has the whole result buffered by now, streaming only bounds the decoded rows */
    do
      {
-        r = esql_row_calloc(1);
+        r = esql_res_row_add(res);
         EINA_SAFETY_ON_NULL_RETURN(r);
-        r->res = res;
         esql_mysac_row_init(r, row);
-        res->rows = eina_inlist_append(res->rows, EINA_INLIST_GET(r));
+        res->row_count++;
+        if (ESQL_RES_STREAM_FULL(res)) esql_res_stream_flush(res);
      } while ((row = mysac_fetch_row(re)));
 }
 
 static char *
 esql_mysac_escape(Esql *e, unsigned int *len, const char *fmt, va_list args)
 {
+   Esql_Mysac_Pipeline *p = e->backend.pipeline_data;
+   Esql_Mysac *em;
    MYSAC *m;
    Eina_Bool backslashes = EINA_TRUE;
-   char *ret;
+   char *buf = NULL, *query, *ret;
+   unsigned int size = 0;
 
    m = e->backend.db;
+   em = (Esql_Mysac *)m;
+   em->built = NULL;
    if (m->status & 512) /* SERVER_STATUS_NO_BACKSLASH_ESCAPES */
      backslashes = EINA_FALSE;
-   ret = esql_query_escape(backslashes, len, fmt, args);
-   if (*len > m->bufsize - 5) /* mysac is dumb and uses a user-allocated buffer, so we have to manually resize it */
+   /* a query about to be sent is built in a single pass where its packet goes: in the send
+    * buffer, which is free while nothing is in flight, or behind the pipelined queries not
+    * written yet if it can be pipelined. the caller still gets a copy of its own. the send
+    * buffer is only resized in esql_mysac_query(), since a pool may run this query on
+    * another connection
+    */
+   if (e->connected && (!e->current) && (m->bufsize > 5))
      {
-        char *tmp;
-
-        tmp = realloc(m->buf, (*len) * 2);
-        if (!tmp) /* we're so fucked */
-          {
-             free(ret);
-             ERR("Alloc! We're in trouble!");
-             return NULL;
-          }
-        m->buf = tmp;
-        m->bufsize = (*len) * 2;
+        buf = m->buf + 5;
+        size = m->bufsize - 5;
+     }
+   else if ((e->current == ESQL_CONNECT_TYPE_QUERY) && p && (!e->calls.count) && (p->size > p->len + 5))
+     {
+        buf = p->buf + p->len + 5;
+        size = p->size - p->len - 5;
      }
+   query = esql_query_escape_buf(backslashes, buf, size, len, fmt, args);
+   if ((!query) || (query != buf)) return query;
+   ret = malloc(*len + 1);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ret, NULL);
+   memcpy(ret, query, *len + 1);
+   em->built = ret;
+   em->built_at = query;
    return ret;
 }
 
@@ -259,121 +760,170 @@ static void
 esql_mysac_row_init(Esql_Row *r, MYSAC_ROW *row)
 {
    MYSAC_RES *res;
-   MYSAC_ROWS *rows;
-   struct mysac_list_head *l;
-   Eina_Value *sval;
    unsigned int i, cols;
 
    res = r->res->backend.res;
-   rows = res->cr;
-   l = res->data.next;
    cols = res->nb_cols;
 
-   sval = &(r->value);
-   eina_value_struct_setup(sval, r->res->desc);
-   for (i = 0; i < cols; i++, l = l->next, rows = mysac_container_of(l, MYSAC_ROWS, link))
+   for (i = 0; i < cols; i++)
      {
-        Eina_Value val;
-        const Eina_Value_Struct_Member *m = r->res->desc->members + i;
-
+        /* left unset */
+        if (res->cr->lengths[i] == MYSAC_NULL_LENGTH) continue;
         switch (res->cols[i].type)
           {
            case MYSQL_TYPE_TIME:
-             eina_value_setup(&val, EINA_VALUE_TYPE_DOUBLE);
-             eina_value_set(&val, (double)row[i].tv.tv_sec + (double)((double)row[i].tv.tv_usec / (double) 1000000));
+             esql_row_cell_double_set(r, i, (double)row[i].tv.tv_sec + (double)((double)row[i].tv.tv_usec / (double) 1000000));
              break;
 
            case MYSQL_TYPE_YEAR:
            case MYSQL_TYPE_TIMESTAMP:
            case MYSQL_TYPE_DATETIME:
            case MYSQL_TYPE_DATE:
-             eina_value_setup(&val, EINA_VALUE_TYPE_TIMESTAMP);
-             eina_value_set(&val, (long)mktime(row[i].tm));
+             esql_row_cell_int64_set(r, i, mktime(row[i].tm));
              break;
 
            case MYSQL_TYPE_STRING:
            case MYSQL_TYPE_VARCHAR:
            case MYSQL_TYPE_VAR_STRING:
-             eina_value_setup(&val, EINA_VALUE_TYPE_STRING);
-             eina_value_set(&val, row[i].string);
-             //cell->len = rows->lengths[i];
-             break;
-
            case MYSQL_TYPE_TINY_BLOB:
            case MYSQL_TYPE_MEDIUM_BLOB:
            case MYSQL_TYPE_LONG_BLOB:
            case MYSQL_TYPE_BLOB:
-             {
-                Eina_Value_Blob blob;
-
-                blob.ops = NULL;
-                blob.memory = row[i].string;
-                blob.size = rows->lengths[i];
-                eina_value_setup(&val, EINA_VALUE_TYPE_BLOB);
-                eina_value_set(&val, blob);
-                break;
-             }
+             /* mysac terminates strings in its buffer, which lives as long as the result */
+             esql_row_cell_string_ref(r, i, row[i].string, res->cr->lengths[i]);
+             break;
 
            case MYSQL_TYPE_TINY:
-             eina_value_setup(&val, EINA_VALUE_TYPE_CHAR);
-             eina_value_set(&val, row[i].stiny);
+             esql_row_cell_int64_set(r, i, row[i].stiny);
              break;
 
            case MYSQL_TYPE_SHORT:
-             eina_value_setup(&val, EINA_VALUE_TYPE_SHORT);
-             eina_value_set(&val, row[i].ssmall);
+             esql_row_cell_int64_set(r, i, row[i].ssmall);
              break;
 
            case MYSQL_TYPE_LONG:
            case MYSQL_TYPE_INT24:
-             eina_value_setup(&val, EINA_VALUE_TYPE_LONG);
-             eina_value_set(&val, row[i].sint);
+             esql_row_cell_int64_set(r, i, row[i].sint);
              break;
 
            case MYSQL_TYPE_DECIMAL:
            case MYSQL_TYPE_NEWDECIMAL:
            case MYSQL_TYPE_LONGLONG:
-             eina_value_setup(&val, EINA_VALUE_TYPE_INT64);
-             eina_value_set(&val, row[i].sbigint);
+             esql_row_cell_int64_set(r, i, row[i].sbigint);
              break;
 
            case MYSQL_TYPE_FLOAT:
-             eina_value_setup(&val, EINA_VALUE_TYPE_FLOAT);
-             eina_value_set(&val, row[i].mfloat);
+             esql_row_cell_double_set(r, i, row[i].mfloat);
              break;
 
            case MYSQL_TYPE_DOUBLE:
-             eina_value_setup(&val, EINA_VALUE_TYPE_DOUBLE);
-             eina_value_set(&val, row[i].mdouble);
+             esql_row_cell_double_set(r, i, row[i].mdouble);
              break;
 
            default:
              ERR("FIXME: Got unknown column type %u!", res->cols[i].type);
              break;
           }
-        eina_value_struct_member_value_set(sval, m, &val);
-        eina_value_flush(&val);
      }
 }
 
+static Eina_Bool
+esql_mysac_column_add(Esql_Res *res, MYSAC_ROW *row)
+{
+   MYSAC_RES *re;
+   unsigned int i, cols;
+   Eina_Bool ret;
+
+   re = res->backend.res;
+   cols = re->nb_cols;
+
+   for (i = 0; i < cols; i++)
+     {
+        if (re->cr->lengths[i] == MYSAC_NULL_LENGTH)
+          {
+             if (!esql_res_column_null_append(res, i)) return EINA_FALSE;
+             continue;
+          }
+        switch (re->cols[i].type)
+          {
+           case MYSQL_TYPE_TIME:
+             ret = esql_res_column_double_append(res, i, (double)row[i].tv.tv_sec + (double)row[i].tv.tv_usec / 1000000.0);
+             break;
+
+           case MYSQL_TYPE_YEAR:
+           case MYSQL_TYPE_TIMESTAMP:
+           case MYSQL_TYPE_DATETIME:
+           case MYSQL_TYPE_DATE:
+             ret = esql_res_column_int64_append(res, i, mktime(row[i].tm));
+             break;
+
+           case MYSQL_TYPE_TINY:
+             ret = esql_res_column_int64_append(res, i, row[i].stiny);
+             break;
+
+           case MYSQL_TYPE_SHORT:
+             ret = esql_res_column_int64_append(res, i, row[i].ssmall);
+             break;
+
+           case MYSQL_TYPE_LONG:
+           case MYSQL_TYPE_INT24:
+             ret = esql_res_column_int64_append(res, i, row[i].sint);
+             break;
+
+           case MYSQL_TYPE_DECIMAL:
+           case MYSQL_TYPE_NEWDECIMAL:
+           case MYSQL_TYPE_LONGLONG:
+             ret = esql_res_column_int64_append(res, i, row[i].sbigint);
+             break;
+
+           case MYSQL_TYPE_FLOAT:
+             ret = esql_res_column_double_append(res, i, row[i].mfloat);
+             break;
+
+           case MYSQL_TYPE_DOUBLE:
+             ret = esql_res_column_double_append(res, i, row[i].mdouble);
+             break;
+
+           default:
+             ret = esql_res_column_string_append(res, i, row[i].string, re->cr->lengths[i]);
+             break;
+          }
+        if (!ret) return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
 static void
 esql_mysac_free(Esql *e)
 {
+   Esql_Mysac *em;
    MYSAC *m;
 
    esql_mysac_disconnect(e);
    e->backend.free = NULL;
-   m = e->backend.db;
+   if (e->backend.pipeline_data)
+     {
+        free(((Esql_Mysac_Pipeline *)e->backend.pipeline_data)->buf);
+        free(e->backend.pipeline_data);
+        e->backend.pipeline_data = NULL;
+     }
+   em = e->backend.db;
+   while (em->res_free_count)
+     mysac_free_res(em->res_free[--em->res_free_count]);
+   m = &em->m;
    eina_stringshare_del(m->addr);
    eina_stringshare_del(m->login);
    eina_stringshare_del(m->password);
    free(m->buf);
-   free(m);
+   free(em);
 }
 
 static void
 esql_mysac_init(Esql *e)
 {
+   Esql_Mysac *em;
+   char *buf;
+
    INFO("Esql type for %p set to MySQL", e);
    e->type = ESQL_TYPE_MYSQL;
    e->backend.connect = esql_mysac_connect;
@@ -385,12 +935,27 @@ esql_mysac_init(Esql *e)
    e->backend.fd_get = esql_mysac_fd_get;
    e->backend.escape = esql_mysac_escape;
    e->backend.query = esql_mysac_query;
+   e->backend.pipeline = esql_mysac_pipeline;
+   e->backend.prepare = esql_mysac_prepare;
+   e->backend.execute = esql_mysac_execute;
+   e->backend.stmt_free = esql_mysac_stmt_free;
    e->backend.res = esql_mysac_res;
    e->backend.res_free = esql_mysac_res_free;
    e->backend.free = esql_mysac_free;
 
-   e->backend.db = mysac_new(4096);
-   EINA_SAFETY_ON_NULL_RETURN(e->backend.db);
+   em = calloc(1, sizeof(Esql_Mysac));
+   EINA_SAFETY_ON_NULL_RETURN(em);
+   buf = calloc(1, ESQL_MYSAC_BUF_MIN);
+   if (!buf)
+     {
+        ERR("Alloc! We're in trouble!");
+        free(em);
+        return;
+     }
+   /* what mysac_new() does, with room for the size history around the MYSAC */
+   mysac_init(&em->m, buf, ESQL_MYSAC_BUF_MIN);
+   em->m.free_it = 1;
+   e->backend.db = em;
 }
 
 EAPI Esql_Type
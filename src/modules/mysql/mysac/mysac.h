@@ -186,12 +186,25 @@ typedef union {
 /**
  * This is chained element. contain pointer to each elements of one row
  */
+/**
+ * Length of a NULL cell in MYSAC_ROWS.lengths
+ */
+#define MYSAC_NULL_LENGTH ((unsigned long)-1)
+
 typedef struct {
 	struct mysac_list_head link;
-	unsigned long *lengths;
+	unsigned long *lengths;     /* MYSAC_NULL_LENGTH for NULL cells */
 	MYSAC_ROW *data;
 } MYSAC_ROWS;
 
+/**
+ * Memory chained to a resource once its buffer is full
+ */
+struct mysac_chunk {
+	struct mysac_chunk *next;
+	char data[];
+};
+
 /**
  * This contain the complete result of one request
  */
@@ -205,6 +218,7 @@ typedef struct {
 	int extend_bloc_size;
 	int max_len;
 	int do_free;
+	struct mysac_chunk *chunks; /* extension chunks, newest first */
 	unsigned long int affected_rows;
 	unsigned long int insert_id;
 	unsigned long int warnings;
@@ -509,7 +523,8 @@ void mysac_reset_res(MYSAC_RES *res);
  * @param chunk_size is the size allocated for the bloc
  * @param extend if is true, the block is extended if the initial
  *               memory does not enough. the extension size is the size
- *               of chunk_size
+ *               of chunk_size, and extensions are separate chunks, so
+ *               the memory already used never moves
  */
 MYSAC_RES *mysac_new_res(int chunk_size, int extend);
 
@@ -519,6 +534,15 @@ MYSAC_RES *mysac_new_res(int chunk_size, int extend);
  */
 void mysac_free_res(MYSAC_RES *r);
 
+/**
+ * Make a MYSAC_RES structur ready for a new request.
+ * The extension chunks are freed, the initial block is kept
+ * with its allocation bloc size and free status.
+ *
+ * @param r Should be the address of an existing MYSAC_RES structur.
+ */
+void mysac_reuse_res(MYSAC_RES *r);
+
 /**
  * Add resource to mysac struct. This resource can by used for store
  * the response. You can add more than one ressource for multireponse
@@ -600,6 +624,35 @@ int mysac_s_set_query(MYSAC *mysac, MYSAC_RES *res, const char *query);
  */
 int mysac_b_set_query(MYSAC *mysac, MYSAC_RES *res, const char *query, unsigned int len);
 
+/**
+ * Initialize query which the caller wrote in the send buffer already,
+ * 5 bytes after its start, leaving room for the packet header.
+ *
+ * @param mysac Should be the address of an existing MYSAC structur.
+ * @param res Should be the address of an existing MYSAC_RES structur,
+ *            or must be NULL if mysac_add_res is used previously.
+ * @param len is the len of the query
+ *
+ * @return 0: ok, -1 nok
+ */
+int mysac_b_set_query_in_place(MYSAC *mysac, MYSAC_RES *res, unsigned int len);
+
+/**
+ * Initialize the reception of the response to a query which was sent
+ * already, without sending anything. Used to pipeline queries: several
+ * COM_QUERY packets are written back-to-back by the caller, then their
+ * responses are read in order, one mysac_send_query() cycle each.
+ *
+ * @param mysac Should be the address of an existing MYSAC structur.
+ * @param res Should be the address of an existing MYSAC_RES structur,
+ *            or must be NULL if mysac_add_res is used previously.
+ * @param query is a string containing the query which was sent
+ * @param len is the len of the query
+ *
+ * @return 0: ok, -1 nok
+ */
+int mysac_b_recv_query(MYSAC *mysac, MYSAC_RES *res, const char *query, unsigned int len);
+
 /**
  * This function return the mysql response pointer
  *
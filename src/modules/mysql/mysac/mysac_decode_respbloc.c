@@ -48,7 +48,7 @@ int mysac_decode_respbloc(MYSAC *m, enum my_expected_response_t expect) {
 
 		/* check for avalaible size in buffer */
 		while (m->read_len < 4)
-			if (mysac_extend_res(m) != 0)
+			if (mysac_extend_res(m, 4) != 0)
 				return MYSAC_RET_ERROR;
 
 		err = mysac_read(m->fd, m->read + m->len,
@@ -77,9 +77,10 @@ int mysac_decode_respbloc(MYSAC *m, enum my_expected_response_t expect) {
 	/* read data */
 	case RDST_READ_DATA:
 
-		/* check for avalaible size in buffer */
-		while ((unsigned int)m->read_len < m->packet_length)
-			if (mysac_extend_res(m) != 0)
+		/* check for avalaible size in buffer, plus one byte for
+		 * terminating the last string of the packet */
+		while ((unsigned int)m->read_len < m->packet_length + 1)
+			if (mysac_extend_res(m, m->packet_length + 1) != 0)
 				return MYSAC_RET_ERROR;
 
 		err = mysac_read(m->fd, m->read + m->len,
@@ -47,12 +47,13 @@ int mysac_decode_binary_row(char *buf, int packet_len,
 	char nul;
 	unsigned long len;
 	int tmp_len;
-	char *wh;
+	int end;
+	int str_end;
 	char _null_ptr[16];
 	char *null_ptr;
 	unsigned char bit;
 
-	wh = buf;
+	end = -1;
 	null_ptr = _null_ptr;
 	bit = 4; /* first 2 bits are reserved */
 
@@ -68,6 +69,7 @@ int mysac_decode_binary_row(char *buf, int packet_len,
 	i += tmp_len;
 
 	for (j = 0; j < res->nb_cols; j++) {
+		str_end = -1;
 
 		/*
 		   We should set both row_ptr and is_null to be able to see
@@ -77,10 +79,13 @@ int mysac_decode_binary_row(char *buf, int packet_len,
 		   lost. See mysql_stmt_fetch_column for details.
 		 */
 		if ( (*null_ptr & bit) != 0 ) {
-			/* do nothing */
+			/* only the length tells the cells which are not
+			 * pointers apart */
+			row->lengths[j] = MYSAC_NULL_LENGTH;
 		}
 
 		else {
+			row->lengths[j] = 0;
 			switch (res->cols[j].type) {
 	
 			/* read null */
@@ -109,11 +114,10 @@ int mysac_decode_binary_row(char *buf, int packet_len,
 				if (nul == 1)
 					row->data[j].blob = NULL;
 				else {
-					memmove(wh, &buf[i], len);
-					row->data[j].blob = wh;
-					row->data[j].blob[len] = '\0';
+					/* the string stays in the packet */
+					row->data[j].blob = &buf[i];
 					i += len;
-					wh += len + 1;
+					str_end = i;
 				}
 				row->lengths[j] = len;
 				break;
@@ -249,6 +253,15 @@ int mysac_decode_binary_row(char *buf, int packet_len,
 			}
 		}
 
+		/* the previous string is terminated over the first byte
+		 * of the next field, once that field has been read */
+		if (end >= 0 && i > end) {
+			buf[end] = '\0';
+			end = -1;
+		}
+		if (str_end >= 0)
+			end = str_end;
+
 		/* To next bit */
 		bit <<= 1;
 
@@ -258,7 +271,11 @@ int mysac_decode_binary_row(char *buf, int packet_len,
 			null_ptr++;
 		}
 	}
-	return wh - buf;
+
+	/* the reader leaves one byte behind the packet for this */
+	if (end >= 0)
+		buf[end] = '\0';
+	return packet_len + 1;
 }
 
 /**************************************************
@@ -272,12 +289,12 @@ int mysac_decode_string_row(char *buf, int packet_len,
 	int tmp_len;
 	unsigned long len;
 	char nul;
-	char *wh;
+	int end;
 	char mem;
 	char *error;
 
 	i = 0;
-	wh = buf;
+	end = -1;
 
 	for (j = 0; j < res->nb_cols; j++) {
 
@@ -285,6 +302,13 @@ int mysac_decode_string_row(char *buf, int packet_len,
 		if (tmp_len == -1)
 			return -MYERR_BAD_LCB;
 
+		/* the length has been read, the previous string can be
+		 * terminated over it */
+		if (end >= 0) {
+			buf[end] = '\0';
+			end = -1;
+		}
+
 		i += tmp_len;
 
 		if (i + len > (unsigned int)packet_len)
@@ -292,8 +316,10 @@ int mysac_decode_string_row(char *buf, int packet_len,
 
 		if (nul == 1) {
 			row->data[j].blob = NULL;
+			row->lengths[j] = MYSAC_NULL_LENGTH;
 			continue;
 		}
+		row->lengths[j] = len;
 
 		/* convert string to specified type */
 		switch (res->cols[j].type) {
@@ -315,11 +341,10 @@ int mysac_decode_string_row(char *buf, int packet_len,
 		case MYSQL_TYPE_VARCHAR:
 		/* read date */
 		case MYSQL_TYPE_NEWDATE:
-			memmove(wh, &buf[i], len);
-			row->data[j].blob = wh;
-			row->data[j].blob[len] = '\0';
-			wh += len + 1;
+			/* the string stays in the packet */
+			row->data[j].blob = &buf[i];
 			row->lengths[j] = len;
+			end = i + len;
 			break;
 
 		case MYSQL_TYPE_TINY:
@@ -454,6 +479,9 @@ int mysac_decode_string_row(char *buf, int packet_len,
 		i += len;
 	}
 
-	return wh - buf;
+	/* the reader leaves one byte behind the packet for this */
+	if (end >= 0)
+		buf[end] = '\0';
+	return packet_len + 1;
 }
 
@@ -26,13 +26,14 @@
 /**
  * This decode mysql row binary format packet 
  *
- * @param buf is the buffer containing packet the strings stored into col, are
- *        allocated into this buffer
+ * @param buf is the buffer containing packet, the strings stored into col
+ *        point into it and are terminated in place, so it must have one
+ *        spare byte behind the packet
  * @param len is the length of the packet
  * @param res is valid MYSAC_RES
  * @param row is valid col struct space for storing pointers and values
  *
- * @return the len of the buffer used for storing data or
+ * @return the len of the buffer used for storing data (the whole packet) or
  *         -1 if the packet is corrupted
  */
 int mysac_decode_binary_row(char *buf, int len, MYSAC_RES *res, MYSAC_ROWS *row);
@@ -40,13 +41,14 @@ int mysac_decode_binary_row(char *buf, int len, MYSAC_RES *res, MYSAC_ROWS *row)
 /**
  * This decode mysql row string format packet 
  *
- * @param buf is the buffer containing packet the strings stored into col, are
- *        allocated into this buffer
+ * @param buf is the buffer containing packet, the strings stored into col
+ *        point into it and are terminated in place, so it must have one
+ *        spare byte behind the packet
  * @param len is the length of the packet
  * @param res is valid MYSAC_RES
  * @param row is valid col struct space for storing pointers and values
  * 
- * @return the len of the buffer used for storing data or
+ * @return the len of the buffer used for storing data (the whole packet) or
  *         -1 if the packet is corrupted
  */
 int mysac_decode_string_row(char *buf, int len, MYSAC_RES *res, MYSAC_ROWS *row);
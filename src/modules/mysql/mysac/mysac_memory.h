@@ -23,12 +23,15 @@
 
 /**
  * This extend memory for containing complete response.
+ * A new chunk is chained to the resource and the reading continues in it,
+ * so the data already received never moves.
  *
  * @param mysac Should be the address of an existing MYSAC structure.
+ * @param need is the contiguous size required at the read position
  * 
  * @return 0 if not error occured else return -1
  */
-int mysac_extend_res(MYSAC *m);
+int mysac_extend_res(MYSAC *m, unsigned int need);
 
 void *mysac_calloc(size_t nmemb, size_t size);
 void *mysac_realloc(void *ptr, size_t size);
@@ -77,6 +77,47 @@ int mysac_b_set_query(MYSAC *mysac, MYSAC_RES *res, const char *query, unsigned
 	return mysac_set_query_params(mysac, res, len);
 }
 
+int mysac_b_set_query_in_place(MYSAC *mysac, MYSAC_RES *res, unsigned int len) {
+
+	/* the sql query is in the buffer already */
+	if (mysac->bufsize - 5 < len) {
+		mysac->errorcode = MYERR_BUFFER_TOO_SMALL;
+		mysac->len = 0;
+		return -1;
+	}
+
+	/* build request */
+	return mysac_set_query_params(mysac, res, len);
+}
+
+int mysac_b_recv_query(MYSAC *mysac, MYSAC_RES *res, const char *query, unsigned int len) {
+
+	/* request type */
+	mysac->expect = check_action(query, len, mysac);
+
+	/* unset statement result */
+	mysac->stmt_id = (void *)0;
+
+	/* add resource */
+	if (res != NULL)
+		mysac->res = res;
+	else {
+		mysac->res = mysac_get_first_res(mysac);
+		if (mysac->res == NULL) {
+			mysac->errorcode = MYERR_NO_RES;
+			return -1;
+		}
+	}
+
+	/* the query is already on the wire, nothing to send */
+	mysac->send = mysac->buf;
+	mysac->len = 0;
+	mysac->qst = MYSAC_SEND_QUERY;
+	mysac->call_it = mysac_send_query;
+
+	return 0;
+}
+
 int mysac_s_set_query(MYSAC *mysac, MYSAC_RES *res, const char *query) {
 	return mysac_b_set_query(mysac, res, query, strlen(query));
 }
@@ -113,6 +154,8 @@ int mysac_send_query(MYSAC *mysac) {
 	int i;
 	int len;
 	unsigned int nb_cols;
+	MYSAC_RES *last;
+	char *packet;
 
 	switch (mysac->qst) {
 
@@ -122,15 +165,17 @@ int mysac_send_query(MYSAC *mysac) {
 	*
 	**********************************************************/
 	case MYSAC_SEND_QUERY:
-		err = mysac_write(mysac->fd, mysac->send, mysac->len, &errcode);
+		if (mysac->len > 0) {
+			err = mysac_write(mysac->fd, mysac->send, mysac->len, &errcode);
 
-		if (err == -1)
-			return errcode;
+			if (err == -1)
+				return errcode;
 
-		mysac->len -= err;
-		mysac->send += err;
-		if (mysac->len > 0)
-			return MYERR_WANT_WRITE;
+			mysac->len -= err;
+			mysac->send += err;
+			if (mysac->len > 0)
+				return MYERR_WANT_WRITE;
+		}
 
 		/* prepare first resource */
 		mysac->read = mysac->res->buffer;
@@ -176,6 +221,7 @@ int mysac_send_query(MYSAC *mysac) {
 				return 0;
 
 			/* use next resource */
+			last = mysac->res;
 			if (mysac->all_res.next != &mysac->all_res)
 				mysac->res = mysac_get_next_res(mysac, mysac->res);
 			if (mysac->res == NULL) {
@@ -186,17 +232,17 @@ int mysac_send_query(MYSAC *mysac) {
 				}
 			}
 
-			/* update resource size */
-			while ((unsigned int)mysac->read_len < mysac->packet_length)
-				if (mysac_extend_res(mysac) != 0)
-					return MYSAC_RET_ERROR;
-
-			/* copy data */
-			if (mysac->res->buffer != mysac->read) {
-				memcpy(mysac->res->buffer, mysac->read, mysac->packet_length);
+			/* copy data into the new resource, within the same
+			 * resource the packet stays where it was read */
+			if (mysac->res != last) {
+				packet = mysac->read;
+				mysac->read = mysac->res->buffer;
+				mysac->read_len = mysac->res->buffer_len;
+				while ((unsigned int)mysac->read_len < mysac->packet_length)
+					if (mysac_extend_res(mysac, mysac->packet_length) != 0)
+						return MYSAC_RET_ERROR;
+				memcpy(mysac->read, packet, mysac->packet_length);
 			}
-			mysac->read = mysac->res->buffer;
-			mysac->read_len = mysac->res->buffer_len;
 			mysac->len = mysac->packet_length;
 		}
 
@@ -247,7 +293,7 @@ int mysac_send_query(MYSAC *mysac) {
 
 		/* check for avalaible size in buffer */
 		while ((unsigned int)mysac->read_len < sizeof(MYSQL_FIELD) * nb_cols)
-			if (mysac_extend_res(mysac) != 0)
+			if (mysac_extend_res(mysac, sizeof(MYSQL_FIELD) * nb_cols) != 0)
 				return mysac->errorcode;
 
 		mysac->res->nb_cols = nb_cols;
@@ -347,7 +393,8 @@ int mysac_send_query(MYSAC *mysac) {
 	/* check for avalaible size in buffer */
 	while ((unsigned int)mysac->read_len < sizeof(MYSAC_ROWS) + ( mysac->res->nb_cols * (
 	                         sizeof(MYSAC_ROW) + sizeof(unsigned long) ) ) )
-		if (mysac_extend_res(mysac) != 0)
+		if (mysac_extend_res(mysac, sizeof(MYSAC_ROWS) + ( mysac->res->nb_cols * (
+		                     sizeof(MYSAC_ROW) + sizeof(unsigned long) ) ) ) != 0)
 			return mysac->errorcode;
 
 	mysac->read_len -= sizeof(MYSAC_ROWS) + ( mysac->res->nb_cols * (
@@ -377,7 +424,7 @@ int mysac_send_query(MYSAC *mysac) {
 		case MYSQL_TYPE_DATETIME:
 		case MYSQL_TYPE_DATE:
 			while ((unsigned int)mysac->read_len < sizeof(struct tm))
-				if (mysac_extend_res(mysac) != 0)
+				if (mysac_extend_res(mysac, sizeof(struct tm)) != 0)
 					return mysac->errorcode;
 
 			mysac->res->cr->data[i].tm = (struct tm *)mysac->read;
@@ -39,6 +39,7 @@ MYSAC_RES *mysac_init_res(char *buffer, int len) {
 	res->extend_bloc_size = 0;
 	res->max_len = len;
 	res->do_free = 0;
+	res->chunks = NULL;
 	res->buffer = buffer + sizeof(MYSAC_RES);
 	res->buffer_len = len - sizeof(MYSAC_RES);
 	INIT_LIST_HEAD(&res->list);
@@ -77,10 +78,35 @@ void mysac_del_res(MYSAC_RES *res)
 
 void mysac_free_res(MYSAC_RES *r)
 {
-	if (r && r->do_free == 1)
+	struct mysac_chunk *c;
+
+	if (r == NULL)
+		return;
+	while ((c = r->chunks) != NULL) {
+		r->chunks = c->next;
+		mysac_free(c);
+	}
+	if (r->do_free == 1)
 		mysac_free(r);
 }
 
+void mysac_reuse_res(MYSAC_RES *r)
+{
+	struct mysac_chunk *c;
+	int extend_bloc_size;
+	int do_free;
+
+	while ((c = r->chunks) != NULL) {
+		r->chunks = c->next;
+		mysac_free(c);
+	}
+	extend_bloc_size = r->extend_bloc_size;
+	do_free = r->do_free;
+	mysac_init_res((char *)r, r->buffer_len + sizeof(MYSAC_RES));
+	r->extend_bloc_size = extend_bloc_size;
+	r->do_free = do_free;
+}
+
 MYSAC_RES *mysac_get_res(MYSAC *mysac) {
 	return mysac->res;
 }
@@ -161,8 +161,10 @@ int mysac_send_stmt_prepare(MYSAC *mysac) {
 
 		/* 9-.. don't care ! */
 
-		/* if no data expected */
-		if (mysac->expect == MYSAC_EXPECT_OK)
+		/* nothing follows: neither placeholder nor column
+		 * descriptions. the server describes the placeholders of
+		 * any statement, not only those which return data */
+		if (mysac->nb_plhold == 0 && mysac->nb_cols == 0)
 			return 0;
 
 		if (mysac->nb_plhold > 0)
@@ -230,6 +232,10 @@ int mysac_send_stmt_prepare(MYSAC *mysac) {
 			return mysac->errorcode;
 		}
 
+		/* no data expected */
+		if (mysac->nb_cols == 0)
+			return 0;
+
 		mysac->qst = MYSAC_RECV_QUERY_COLDESC2;
 
 	/**********************************************************
@@ -380,7 +386,7 @@ int mysac_set_stmt_execute(MYSAC *mysac, MYSAC_RES *res, unsigned int stmt_id,
 		 *
 		 ***********************/
 		if (values[i].is_null != 0)
-			mysac->buf[len + (i << 3)] |= 1 << (i & 0xf);
+			mysac->buf[len + (i >> 3)] |= 1 << (i & 0x7);
 
 		/***********************
 		 *
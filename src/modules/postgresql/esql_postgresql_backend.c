@@ -34,6 +34,47 @@
 #include <libpq-fe.h>
 #include <catalog/pg_type.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+
+typedef struct Esql_Postgresql_Stmt
+{
+   char      name[32];
+   char     *query;
+   Eina_Bool preparing : 1; /* PQsendPrepare() went out, after the evicted statements were deallocated */
+   Eina_Bool prepared : 1;
+   Eina_Bool binary : 1; /* every result column has a binary decoder, rows are received in binary */
+   Eina_Bool failed : 1; /* preparation failed, reported once it has completed */
+} Esql_Postgresql_Stmt;
+
+typedef enum
+{
+   ESQL_POSTGRESQL_CELL_INT,
+   ESQL_POSTGRESQL_CELL_DOUBLE,
+   ESQL_POSTGRESQL_CELL_STRING
+} Esql_Postgresql_Cell_Type;
+
+/* a decoded cell, whatever the format it was received in */
+typedef struct Esql_Postgresql_Cell
+{
+   Esql_Postgresql_Cell_Type type;
+   int64_t                   i;
+   double                    d;
+   const char               *s;
+   unsigned int              len;
+} Esql_Postgresql_Cell;
+
+/* 2000-01-01, the epoch of binary timestamps, in unix time */
+#define ESQL_POSTGRESQL_EPOCH 946684800
+
+/* 'infinity' and '-infinity', which binary timestamps send as the int64 limits;
+ * they are reported as LONG_MAX and LONG_MIN, the limits of timestamp values
+ */
+#define ESQL_POSTGRESQL_TIMESTAMP_INFINITY INT64_MAX
+#define ESQL_POSTGRESQL_TIMESTAMP_NINFINITY INT64_MIN
+
+/* statement names only have to be unique per connection */
+static unsigned int esql_postgresql_stmt_id = 0;
 
 static const char *esql_postgresql_error_get(Esql *e);
 static void esql_postgresql_disconnect(Esql *e);
@@ -42,10 +83,22 @@ static int esql_postgresql_connect(Esql *e);
 static int esql_postgresql_io(Esql *e);
 static void esql_postgresql_setup(Esql *e, const char *addr, const char *user, const char *passwd);
 static void esql_postgresql_query(Esql *e, const char *query, unsigned int len);
+static void *esql_postgresql_prepare(Esql *e, const char *query, unsigned int len);
+static Eina_Bool esql_postgresql_execute(Esql *e, void *stmt, const Esql_Params *params);
+static Eina_Bool esql_postgresql_execute_send(Esql *e, Esql_Postgresql_Stmt *stmt, const Esql_Params *params);
+static Eina_Bool esql_postgresql_prepare_send(Esql *e, Esql_Postgresql_Stmt *stmt);
+#ifdef LIBPQ_HAS_PIPELINING
+static Eina_Bool esql_postgresql_pipeline(Esql *e, const char *query, unsigned int len);
+#endif
+static void esql_postgresql_stmt_free(Esql *e, void *stmt);
 static void esql_postgresql_res_free(Esql_Res *res);
 static void esql_postgresql_res(Esql_Res *res);
+static Eina_Bool esql_postgresql_res_status(Esql_Res *res, PGresult *pres);
+static void esql_postgresql_rows_add(Esql_Res *res, PGresult *pres);
 static char *esql_postgresql_escape(Esql *e, unsigned int *len, const char *fmt, va_list args);
 static void esql_postgresql_row_init(Esql_Row *r, int row_num);
+static Eina_Bool esql_postgresql_columns_add(Esql_Res *res, int row_num);
+static Eina_Bool esql_postgresql_binary_ok(Esql *e, PGresult *pres);
 static void esql_postgresql_free(Esql *e);
 
 static void
@@ -116,12 +169,24 @@ esql_postgresql_error_get(Esql *e)
    return p;
 }
 
+static void
+esql_postgresql_stmt_closed_free(Esql *e)
+{
+   Esql_Postgresql_Stmt *stmt;
+
+   EINA_LIST_FREE(e->backend.stmt_closed, stmt)
+     free(stmt);
+}
+
 static void
 esql_postgresql_disconnect(Esql *e)
 {
    if (!e->backend.db) return;
    PQfinish(e->backend.db);
    e->backend.db = NULL;
+   /* a preparation in flight is dropped with the connection */
+   e->backend.stmt = NULL;
+   esql_postgresql_stmt_closed_free(e);
 }
 
 static int
@@ -146,6 +211,240 @@ esql_postgresql_connect(Esql *e)
    return ECORE_FD_READ | ECORE_FD_WRITE;
 }
 
+/* adds the rows of @p pres to the result of the current query; in single-row
+ * (or chunked) mode they come a few at a time, are converted and freed right
+ * away, and the final result of the query only carries its status
+ */
+static Eina_Bool
+esql_postgresql_res_take(Esql *e, PGresult *pres)
+{
+   if (!e->res)
+     {
+        e->res = esql_res_calloc(1);
+        if (!e->res)
+          {
+             PQclear(pres);
+             return EINA_FALSE;
+          }
+        e->res->e = e;
+     }
+   switch (PQresultStatus(pres))
+     {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+      case PGRES_TUPLES_CHUNK:
+#endif
+      case PGRES_SINGLE_TUPLE:
+        /* rows are copied out of @p pres: single-row results pile up until a batch is full,
+         * the last one is handed over on completion
+         */
+        esql_postgresql_rows_add(e->res, pres);
+        if (ESQL_RES_STREAM_FULL(e->res)) esql_res_stream_flush(e->res);
+        e->res->backend.res = NULL;
+        PQclear(pres);
+        break;
+
+      default:
+        PQclear(e->res->backend.res);
+        e->res->backend.res = pres;
+        if (esql_postgresql_res_status(e->res, pres))
+          esql_postgresql_rows_add(e->res, pres);
+        break;
+     }
+   return EINA_TRUE;
+}
+
+/* must be called right after sending a query, so that its rows never pile up in a PGresult */
+static void
+esql_postgresql_row_mode_set(Esql *e)
+{
+#ifdef LIBPQ_HAS_CHUNK_MODE
+   PQsetChunkedRowsMode(e->backend.db, ESQL_STREAM_BATCH);
+#else
+   PQsetSingleRowMode(e->backend.db);
+#endif
+}
+
+/* reads the results of the current query as they arrive, it has completed once libpq returns NULL */
+static int
+esql_postgresql_results(Esql *e)
+{
+   PGresult *pres;
+
+   while (!PQisBusy(e->backend.db))
+     {
+        pres = PQgetResult(e->backend.db);
+        if (!pres)
+          {
+             if ((!e->res) && (!(e->res = esql_res_calloc(1)))) return ECORE_FD_ERROR;
+             e->res->e = e;
+             return 0;
+          }
+        if (!esql_postgresql_res_take(e, pres)) return ECORE_FD_ERROR;
+     }
+   return ECORE_FD_READ | ECORE_FD_WRITE;
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+/* only plain queries use pipeline mode, and switching requires an idle connection */
+static Eina_Bool
+esql_postgresql_pipeline_mode_set(Esql *e, Eina_Bool enable)
+{
+   PGpipelineStatus status;
+
+   status = PQpipelineStatus(e->backend.db);
+   if (enable && (status == PQ_PIPELINE_OFF))
+     PQenterPipelineMode(e->backend.db);
+   else if ((!enable) && (status != PQ_PIPELINE_OFF))
+     PQexitPipelineMode(e->backend.db);
+   return PQpipelineStatus(e->backend.db) != PQ_PIPELINE_OFF;
+}
+
+static Eina_Bool
+esql_postgresql_pipeline(Esql *e, const char *query, unsigned int len EINA_UNUSED)
+{
+   /* the current query was not sent in pipeline mode */
+   if (PQpipelineStatus(e->backend.db) != PQ_PIPELINE_ON) return EINA_FALSE;
+   /* one statement per query with the extended protocol; a sync after each query keeps
+    * it in its own transaction, so a failure does not abort the ones behind it
+    */
+   if (!PQsendQueryParams(e->backend.db, query, 0, NULL, NULL, NULL, NULL, 0)) return EINA_FALSE;
+   esql_postgresql_row_mode_set(e);
+   /* the query was taken and must not be sent again, but its results would never
+    * come: nothing lines up with the sent queue anymore
+    */
+   if (!PQpipelineSync(e->backend.db))
+     {
+        ERR("%s", PQerrorMessage(e->backend.db));
+        e->backend.broken = EINA_TRUE;
+     }
+   return EINA_TRUE;
+}
+
+/* the results of a pipelined query are followed by a NULL, then by its sync */
+static int
+esql_postgresql_pipeline_io(Esql *e)
+{
+   PGresult *pres;
+   Eina_Bool end = EINA_FALSE;
+
+   while (!PQisBusy(e->backend.db))
+     {
+        pres = PQgetResult(e->backend.db);
+        if (!pres)
+          {
+             if (end)
+               {
+                  ERR("Pipeline out of sync");
+                  return ECORE_FD_ERROR;
+               }
+             end = EINA_TRUE;
+             continue;
+          }
+        end = EINA_FALSE;
+        if (PQresultStatus(pres) == PGRES_PIPELINE_SYNC)
+          {
+             PQclear(pres);
+             /* never leave the result to esql_postgresql_res(), it would read the next query's */
+             if ((!e->res) && (!(e->res = esql_res_calloc(1)))) return ECORE_FD_ERROR;
+             e->res->e = e;
+             return 0;
+          }
+        if (!esql_postgresql_res_take(e, pres)) return ECORE_FD_ERROR;
+     }
+   return ECORE_FD_READ | ECORE_FD_WRITE;
+}
+
+#endif
+
+/* returns EINA_TRUE if every column of @p pres can be decoded from the binary format;
+ * bytea is left out, its cells are the escaped text strings in both cases
+ */
+static Eina_Bool
+esql_postgresql_binary_ok(Esql *e, PGresult *pres)
+{
+   const char *s;
+   int i, cols;
+
+   cols = PQnfields(pres);
+   if (!cols) return EINA_FALSE;
+   for (i = 0; i < cols; i++)
+     switch (PQftype(pres, i))
+       {
+        case TIMESTAMPOID:
+          /* 64-bit integer timestamps, floating point ones are long gone */
+          s = PQparameterStatus(e->backend.db, "integer_datetimes");
+          if ((!s) || strcmp(s, "on")) return EINA_FALSE;
+          break;
+
+        case BOOLOID:
+        case CHAROID:
+        case INT2OID:
+        case INT4OID:
+        case INT8OID:
+        case FLOAT4OID:
+        case FLOAT8OID:
+        case NAMEOID:
+        case TEXTOID:
+        case VARCHAROID:
+        case BPCHAROID:
+          break;
+
+        default:
+          return EINA_FALSE;
+       }
+   return EINA_TRUE;
+}
+
+/* the statement of the current query is being prepared, execute it once that has completed */
+static int
+esql_postgresql_prepared(Esql *e)
+{
+   Esql_Postgresql_Stmt *stmt = e->backend.stmt;
+   PGresult *pres;
+
+   for (;;)
+     {
+        if (PQisBusy(e->backend.db)) return ECORE_FD_READ | ECORE_FD_WRITE;
+        pres = PQgetResult(e->backend.db);
+        if (!pres) break;
+        if (!stmt->preparing) /* the statements evicted from the cache are gone or were never there */
+          {
+             if (PQresultStatus(pres) != PGRES_COMMAND_OK)
+               WARN("Could not deallocate statement: %s", PQresultErrorMessage(pres));
+          }
+        else if (stmt->prepared) /* the description of the statement */
+          stmt->binary = (PQresultStatus(pres) == PGRES_COMMAND_OK) && esql_postgresql_binary_ok(e, pres);
+        else if (PQresultStatus(pres) != PGRES_COMMAND_OK)
+          {
+             ERR("Could not prepare statement: %s", PQresultErrorMessage(pres));
+             stmt->failed = EINA_TRUE;
+          }
+        PQclear(pres);
+     }
+
+   if (stmt->failed)
+     {
+        e->backend.stmt = NULL;
+        stmt->failed = EINA_FALSE;
+        stmt->preparing = EINA_FALSE;
+        return ECORE_FD_ERROR;
+     }
+   if (!stmt->preparing)
+     {
+        if (!esql_postgresql_prepare_send(e, stmt)) return ECORE_FD_ERROR;
+        return ECORE_FD_READ | ECORE_FD_WRITE;
+     }
+   if (!stmt->prepared)
+     {
+        stmt->prepared = EINA_TRUE;
+        /* its result columns decide whether rows can be received in binary */
+        if (PQsendDescribePrepared(e->backend.db, stmt->name)) return ECORE_FD_READ | ECORE_FD_WRITE;
+     }
+   e->backend.stmt = NULL;
+   if (!esql_postgresql_execute_send(e, stmt, e->cur_params)) return ECORE_FD_ERROR;
+   return ECORE_FD_READ | ECORE_FD_WRITE;
+}
+
 static int
 esql_postgresql_io(Esql *e)
 {
@@ -154,6 +453,11 @@ esql_postgresql_io(Esql *e)
         ERR("%s", esql_postgresql_error_get(e));
         return ECORE_FD_ERROR;
      }
+   if (e->backend.broken)
+     {
+        ERR("Pipeline out of sync");
+        return ECORE_FD_ERROR;
+     }
    if (e->current == ESQL_CONNECT_TYPE_INIT)
      {
         switch (PQconnectPoll(e->backend.db))
@@ -174,6 +478,14 @@ esql_postgresql_io(Esql *e)
         ERR("%s", esql_postgresql_error_get(e));
         return ECORE_FD_ERROR;
      }
+   if (e->backend.stmt && (e->current == ESQL_CONNECT_TYPE_QUERY))
+     return esql_postgresql_prepared(e);
+#ifdef LIBPQ_HAS_PIPELINING
+   if ((e->current == ESQL_CONNECT_TYPE_QUERY) && (PQpipelineStatus(e->backend.db) != PQ_PIPELINE_OFF))
+     return esql_postgresql_pipeline_io(e);
+#endif
+   if (e->current == ESQL_CONNECT_TYPE_QUERY)
+     return esql_postgresql_results(e);
    if (!PQisBusy(e->backend.db)) return 0;
    return ECORE_FD_READ | ECORE_FD_WRITE; /* psql does not provide a method to get read/write mode :( */
 }
@@ -201,27 +513,142 @@ esql_postgresql_setup(Esql *e, const char *addr, const char *user, const char *p
 }
 
 static void
-esql_postgresql_query(Esql *e, const char *query, unsigned int len EINA_UNUSED)
+esql_postgresql_query(Esql *e, const char *query, unsigned int len)
 {
+#ifdef LIBPQ_HAS_PIPELINING
+   /* only a query with more queued behind it is sent so that they can follow it: pipeline
+    * mode takes one statement per query, and a lone query may hold several
+    */
+   if ((!e->cur_row_cb) && esql_pipeline_next_ok(e) && esql_postgresql_pipeline_mode_set(e, EINA_TRUE))
+     {
+        /* the current query is not sent, fail the connection rather than wait forever */
+        if (!esql_postgresql_pipeline(e, query, len))
+          e->backend.broken = EINA_TRUE;
+        return;
+     }
+   esql_postgresql_pipeline_mode_set(e, EINA_FALSE);
+#endif
    EINA_SAFETY_ON_FALSE_RETURN(PQsendQuery(e->backend.db, query));
+   esql_postgresql_row_mode_set(e);
 }
 
-static void
-esql_postgresql_res_free(Esql_Res *res)
+static void *
+esql_postgresql_prepare(Esql *e EINA_UNUSED, const char *query, unsigned int len)
 {
-   PQclear(res->backend.res);
+   Esql_Postgresql_Stmt *stmt;
+
+   /* nothing is sent until the first execution */
+   stmt = calloc(1, sizeof(Esql_Postgresql_Stmt));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(stmt, NULL);
+   stmt->query = strndup(query, len);
+   if (!stmt->query)
+     {
+        free(stmt);
+        return NULL;
+     }
+   snprintf(stmt->name, sizeof(stmt->name), "esql_stmt_%u", ++esql_postgresql_stmt_id);
+   return stmt;
+}
+
+static Eina_Bool
+esql_postgresql_execute_send(Esql *e, Esql_Postgresql_Stmt *stmt, const Esql_Params *params)
+{
+   const Esql_Param *p;
+   const char **values;
+   char *nums;
+   unsigned int i;
+
+   /* text parameters, libpq copies them while sending */
+   values = alloca(params->count * sizeof(char *) + 1);
+   nums = alloca(params->count * 32 + 1);
+   for (i = 0, p = params->params; i < params->count; i++, p++)
+     switch (p->type)
+       {
+        case ESQL_PARAM_INT64:
+          snprintf(nums + i * 32, 32, "%" PRId64, p->v.i);
+          values[i] = nums + i * 32;
+          break;
+        case ESQL_PARAM_DOUBLE:
+          snprintf(nums + i * 32, 32, "%.17g", p->v.d);
+          values[i] = nums + i * 32;
+          break;
+        case ESQL_PARAM_STRING:
+          values[i] = p->v.s;
+          break;
+        default:
+          values[i] = NULL;
+          break;
+       }
+   if (!PQsendQueryPrepared(e->backend.db, stmt->name, params->count, values, NULL, NULL, stmt->binary))
+     return EINA_FALSE;
+   esql_postgresql_row_mode_set(e);
+   return EINA_TRUE;
+}
+
+/* parameter types are left to the server, as with a PREPARE without a type list */
+static Eina_Bool
+esql_postgresql_prepare_send(Esql *e, Esql_Postgresql_Stmt *stmt)
+{
+   if (!PQsendPrepare(e->backend.db, stmt->name, stmt->query, 0, NULL)) return EINA_FALSE;
+   stmt->preparing = EINA_TRUE;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+esql_postgresql_execute(Esql *e, void *data, const Esql_Params *params)
+{
+   Esql_Postgresql_Stmt *stmt = data, *closed;
+   Eina_Strbuf *buf;
+   Eina_Bool ret;
+
+#ifdef LIBPQ_HAS_PIPELINING
+   esql_postgresql_pipeline_mode_set(e, EINA_FALSE);
+#endif
+   if (stmt->prepared) return esql_postgresql_execute_send(e, stmt, params);
+   if (!e->backend.stmt_closed)
+     {
+        ret = esql_postgresql_prepare_send(e, stmt);
+        if (ret) e->backend.stmt = stmt;
+        return ret;
+     }
+
+   /* statements evicted from the cache are deallocated first, only our own names go in there */
+   buf = eina_strbuf_new();
+   EINA_SAFETY_ON_NULL_RETURN_VAL(buf, EINA_FALSE);
+   EINA_LIST_FREE(e->backend.stmt_closed, closed)
+     {
+        eina_strbuf_append_printf(buf, "DEALLOCATE %s;", closed->name);
+        free(closed);
+     }
+   ret = PQsendQuery(e->backend.db, eina_strbuf_string_get(buf));
+   eina_strbuf_free(buf);
+   if (ret) e->backend.stmt = stmt;
+   return ret;
 }
 
 static void
-esql_postgresql_res(Esql_Res *res)
+esql_postgresql_stmt_free(Esql *e, void *data)
 {
-   Esql_Row *r;
-   PGresult *pres;
-   int i;
+   Esql_Postgresql_Stmt *stmt = data;
 
-   pres = res->backend.res = PQgetResult(res->e->backend.db);
-   EINA_SAFETY_ON_NULL_RETURN(pres);
+   free(stmt->query);
+   stmt->query = NULL;
+   if (stmt->prepared && e->connected)
+     e->backend.stmt_closed = eina_list_append(e->backend.stmt_closed, stmt);
+   else
+     free(stmt);
+}
 
+static void
+esql_postgresql_res_free(Esql_Res *res)
+{
+   PQclear(res->backend.res);
+}
+
+/* returns EINA_TRUE if @p pres holds rows */
+static Eina_Bool
+esql_postgresql_res_status(Esql_Res *res, PGresult *pres)
+{
    switch (PQresultStatus(pres))
      {
       case PGRES_COMMAND_OK:
@@ -233,23 +660,69 @@ esql_postgresql_res(Esql_Res *res)
              res->affected = strtol(a, NULL, 10);
            res->id = PQoidValue(pres);
         }
-        return;
+        return EINA_FALSE;
       case PGRES_TUPLES_OK:
-        break;
+        return EINA_TRUE;
       default:
         res->error = PQresultErrorMessage(pres);
         ERR("Error %s:'%s'!", PQresStatus(PQresultStatus(pres)), res->error);
-        return;
+        return EINA_FALSE;
      }
-   res->desc = esql_module_desc_get(PQntuples(pres), (Esql_Module_Setup_Cb)esql_module_setup_cb, res);
-   for (i = 0; i < res->row_count; i++)
+}
+
+/* each cell comes with its length on the wire */
+static void
+esql_postgresql_row_bytes_count(Esql *e, PGresult *pres, int row_num)
+{
+   int i, cols;
+
+   cols = PQnfields(pres);
+   for (i = 0; i < cols; i++)
+     e->stats.bytes_received += 4 + PQgetlength(pres, row_num, i); /* 0 for NULL */
+}
+
+static void
+esql_postgresql_rows_add(Esql_Res *res, PGresult *pres)
+{
+   Esql_Row *r;
+   int i, rows;
+
+   res->backend.res = pres;
+   /* the cells of a streamed result which could not be stored are dropped up to its end */
+   if (res->error) return;
+   if (!res->desc)
+     {
+        res->desc = esql_module_desc_get(PQnfields(pres), (Esql_Module_Setup_Cb)esql_module_setup_cb, res);
+        if (!res->desc) return;
+        if (res->e->columnar) esql_res_columns_setup(res);
+     }
+   rows = PQntuples(pres);
+   for (i = 0; i < rows; i++)
      {
-        r = esql_row_calloc(1);
+        esql_postgresql_row_bytes_count(res->e, pres, i);
+        if (res->columns)
+          {
+             if (esql_postgresql_columns_add(res, i)) continue;
+             esql_res_columns_fail(res);
+             return;
+          }
+        r = esql_res_row_add(res);
         EINA_SAFETY_ON_NULL_RETURN(r);
-        r->res = res;
         esql_postgresql_row_init(r, i);
-        res->rows = eina_inlist_append(res->rows, EINA_INLIST_GET(r));
      }
+   res->row_count += rows;
+}
+
+static void
+esql_postgresql_res(Esql_Res *res)
+{
+   PGresult *pres;
+
+   pres = res->backend.res = PQgetResult(res->e->backend.db);
+   EINA_SAFETY_ON_NULL_RETURN(pres);
+
+   if (esql_postgresql_res_status(res, pres))
+     esql_postgresql_rows_add(res, pres);
 }
 
 static char *
@@ -261,109 +734,277 @@ esql_postgresql_escape(Esql *e EINA_UNUSED, unsigned int *len, const char *fmt,
    return ret;
 }
 
+/* binary values are in network byte order */
+static uint64_t
+esql_postgresql_uint_get(const char *str, int len)
+{
+   const unsigned char *p = (const unsigned char *)str;
+   uint64_t v = 0;
+   int i;
+
+   for (i = 0; i < len; i++)
+     v = (v << 8) | p[i];
+   return v;
+}
+
+static int64_t
+esql_postgresql_int_get(const char *str, int len)
+{
+   uint64_t v;
+
+   if ((len < 1) || (len > 8)) return 0;
+   v = esql_postgresql_uint_get(str, len);
+   if ((len < 8) && (str[0] & 0x80)) /* sign extension */
+     v |= ~(uint64_t)0 << (len * 8);
+   return (int64_t)v;
+}
+
+static double
+esql_postgresql_float_get(const char *str, int len)
+{
+   if (len == 4)
+     {
+        uint32_t v = esql_postgresql_uint_get(str, 4);
+        float f;
+
+        memcpy(&f, &v, sizeof(f));
+        return f;
+     }
+   if (len == 8)
+     {
+        uint64_t v = esql_postgresql_uint_get(str, 8);
+        double d;
+
+        memcpy(&d, &v, sizeof(d));
+        return d;
+     }
+   return 0.0;
+}
+
+/* days between 1970-01-01 and the given date of the proleptic gregorian calendar */
+static int64_t
+esql_postgresql_days_get(int y, int m, int d)
+{
+   int era, yoe, doy;
+
+   y -= m <= 2;
+   era = (y >= 0 ? y : y - 399) / 400;
+   yoe = y - era * 400;
+   doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+   return (int64_t)era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+/* timestamps have no time zone: the wall clock time @p t, counted as if it was UTC,
+ * is converted to unix time in the local time zone like mktime() does
+ */
+static int64_t
+esql_postgresql_timestamp_local(int64_t t)
+{
+   struct tm tm;
+   time_t tt = t;
+
+   if (!gmtime_r(&tt, &tm)) return t;
+   tm.tm_isdst = -1;
+   return mktime(&tm);
+}
+
+/* the seconds of binary timestamp @p us */
+static int64_t
+esql_postgresql_timestamp_get(int64_t us)
+{
+   if (us == ESQL_POSTGRESQL_TIMESTAMP_INFINITY) return LONG_MAX;
+   if (us == ESQL_POSTGRESQL_TIMESTAMP_NINFINITY) return LONG_MIN;
+   return esql_postgresql_timestamp_local(us / 1000000 - (us % 1000000 < 0) + ESQL_POSTGRESQL_EPOCH);
+}
+
+/* "YYYY-MM-DD HH:MM:SS[.ffffff]", "infinity" or "-infinity" */
+static int64_t
+esql_postgresql_timestamp_parse(const char *str)
+{
+   long f[6] = {0, 1, 1, 0, 0, 0};
+   char *end;
+   unsigned int i;
+
+   if (!strcmp(str, "infinity")) return LONG_MAX;
+   if (!strcmp(str, "-infinity")) return LONG_MIN;
+   for (i = 0; i < 6; i++)
+     {
+        f[i] = strtol(str, &end, 10);
+        if ((end == str) || (!*end)) break;
+        str = end + 1;
+     }
+   return esql_postgresql_timestamp_local(esql_postgresql_days_get(f[0], f[1], f[2]) * 86400 +
+                                          f[3] * 3600 + f[4] * 60 + f[5]);
+}
+
+static void
+esql_postgresql_cell_decode(PGresult *pres, int row_num, int col, Esql_Postgresql_Cell *c)
+{
+   const char *str;
+   int len;
+   int64_t us;
+   struct tm tm;
+   time_t t;
+
+   str = PQgetvalue(pres, row_num, col);
+   len = PQgetlength(pres, row_num, col);
+   c->type = ESQL_POSTGRESQL_CELL_STRING;
+   c->s = str;
+   c->len = len;
+
+   if (PQfformat(pres, col))
+     {
+        /* only requested for the types checked by esql_postgresql_binary_ok() */
+        switch (PQftype(pres, col))
+          {
+           case TIMESTAMPOID:
+             us = esql_postgresql_int_get(str, len);
+             c->type = ESQL_POSTGRESQL_CELL_INT;
+             c->i = esql_postgresql_timestamp_get(us);
+             break;
+
+           case BOOLOID:
+           case CHAROID:
+             c->type = ESQL_POSTGRESQL_CELL_INT;
+             c->i = len ? (char)str[0] : 0;
+             break;
+
+           case INT2OID:
+           case INT4OID:
+           case INT8OID:
+             c->type = ESQL_POSTGRESQL_CELL_INT;
+             c->i = esql_postgresql_int_get(str, len);
+             break;
+
+           case FLOAT4OID:
+           case FLOAT8OID:
+             c->type = ESQL_POSTGRESQL_CELL_DOUBLE;
+             c->d = esql_postgresql_float_get(str, len);
+             break;
+
+           default:
+             /* text types are sent as they are */
+             break;
+          }
+        return;
+     }
+
+   switch (PQftype(pres, col))
+     {
+      case TIMESTAMPOID:
+        c->type = ESQL_POSTGRESQL_CELL_INT;
+        c->i = esql_postgresql_timestamp_parse(str);
+        break;
+
+      case BOOLOID:
+        c->type = ESQL_POSTGRESQL_CELL_INT;
+        c->i = str[0] == 't';
+        break;
+
+      case CHAROID:
+        c->type = ESQL_POSTGRESQL_CELL_INT;
+        c->i = str[0];
+        break;
+
+      case ABSTIMEOID:
+        t = strtoumax(str, NULL, 10);
+        localtime_r(&t, &tm);
+        c->type = ESQL_POSTGRESQL_CELL_INT;
+        c->i = mktime(&tm);
+        break;
+
+      case INT2OID:
+      case INT4OID:
+      case INT8OID:
+        c->type = ESQL_POSTGRESQL_CELL_INT;
+        c->i = strtoll(str, NULL, 10);
+        break;
+
+      case FLOAT4OID:
+      case FLOAT8OID:
+      case TINTERVALOID:
+      case RELTIMEOID:
+        c->type = ESQL_POSTGRESQL_CELL_DOUBLE;
+        c->d = strtod(str, NULL);
+        break;
+
+      default:
+        /* text types and bytea as they are, everything else as a blob */
+        break;
+     }
+}
+
 static void
 esql_postgresql_row_init(Esql_Row *r, int row_num)
 {
+   Esql_Postgresql_Cell c;
    PGresult *pres;
    Esql_Res *res;
-   Eina_Value *sval;
    unsigned int i, cols;
    res = r->res;
    pres = res->backend.res;
    cols = res->desc->member_count;
 
-   sval = &(r->value);
-   eina_value_struct_setup(sval, res->desc);
-
    for (i = 0; i < cols; i++)
      {
-        const Eina_Value_Struct_Member *m = res->desc->members + i;
-        Eina_Value val;
-        const char *str;
-        struct tm tm;
-
         if (PQgetisnull(pres, row_num, i))
-          goto out;
+          continue;
 
-        str = PQgetvalue(pres, row_num, i);
-        switch (PQftype(pres, i))
+        esql_postgresql_cell_decode(pres, row_num, i, &c);
+        switch (c.type)
           {
-           case TIMESTAMPOID:
-             strptime(str, "%Y-%m-%d %H:%M:%S", &tm);
-             eina_value_setup(&val, EINA_VALUE_TYPE_ULONG);
-             eina_value_set(&val, (long)mktime(&tm));
-             break;
-           case ABSTIMEOID:
-             {
-                time_t t;
-
-                t = strtoumax(str, NULL, 10);
-                localtime_r(&t, &tm);
-                eina_value_setup(&val, EINA_VALUE_TYPE_ULONG);
-                eina_value_set(&val, (long)mktime(&tm));
-                break;
-             }
-
-           case BYTEAOID:
-           case NAMEOID:
-           case TEXTOID:
-           case VARCHAROID:
-           case BPCHAROID:
-             eina_value_setup(&val, EINA_VALUE_TYPE_STRING);
-             eina_value_set(&val, str);
-             //cell->len = PQgetlength(pres, row_num, i);
+           case ESQL_POSTGRESQL_CELL_INT:
+             esql_row_cell_int64_set(r, i, c.i);
              break;
 
-           case BOOLOID:
-           case CHAROID:
-             eina_value_setup(&val, EINA_VALUE_TYPE_CHAR);
-             eina_value_set(&val, (char)strtol(str, NULL, 10));
+           case ESQL_POSTGRESQL_CELL_DOUBLE:
+             esql_row_cell_double_set(r, i, c.d);
              break;
 
-           case INT2OID:
-             eina_value_setup(&val, EINA_VALUE_TYPE_SHORT);
-             eina_value_set(&val, (short)strtol(str, NULL, 10));
+           default:
+             esql_row_cell_string_set(r, i, c.s, c.len);
              break;
+          }
+     }
+}
 
-           case INT4OID:
-             eina_value_setup(&val, EINA_VALUE_TYPE_LONG);
-             eina_value_set(&val, strtol(str, NULL, 10));
-             break;
+static Eina_Bool
+esql_postgresql_columns_add(Esql_Res *res, int row_num)
+{
+   Esql_Postgresql_Cell c;
+   PGresult *pres;
+   unsigned int i, cols;
+   Eina_Bool ret;
 
-           case INT8OID:
-             eina_value_setup(&val, EINA_VALUE_TYPE_INT64);
-             eina_value_set(&val, strtoll(str, NULL, 10));
-             break;
+   pres = res->backend.res;
+   cols = res->desc->member_count;
 
-           case FLOAT4OID:
-             eina_value_setup(&val, EINA_VALUE_TYPE_FLOAT);
-             eina_value_set(&val, strtof(str, NULL));
+   for (i = 0; i < cols; i++)
+     {
+        if (PQgetisnull(pres, row_num, i))
+          {
+             if (!esql_res_column_null_append(res, i)) return EINA_FALSE;
+             continue;
+          }
+
+        esql_postgresql_cell_decode(pres, row_num, i, &c);
+        switch (c.type)
+          {
+           case ESQL_POSTGRESQL_CELL_INT:
+             ret = esql_res_column_int64_append(res, i, c.i);
              break;
 
-           case FLOAT8OID:
-           case TINTERVALOID:
-           case RELTIMEOID:
-             eina_value_setup(&val, EINA_VALUE_TYPE_DOUBLE);
-             eina_value_set(&val, strtod(str, NULL));
+           case ESQL_POSTGRESQL_CELL_DOUBLE:
+             ret = esql_res_column_double_append(res, i, c.d);
              break;
 
            default:
-             {
-                Eina_Value_Blob blob;
-
-                blob.ops = NULL;
-                blob.memory = str;
-                blob.size = PQgetlength(pres, row_num, i);
-                eina_value_setup(&val, EINA_VALUE_TYPE_BLOB);
-                eina_value_set(&val, blob);
-                //WARN("Unsupported type passed with Oid %u in column '%s': '%*s'!", PQftype(pres, i), cell->colname, blob.size, (char*)str);
-                break;
-             }
+             ret = esql_res_column_string_append(res, i, c.s, c.len);
+             break;
           }
-out:
-        eina_value_struct_member_value_set(sval, m, &val);
-        eina_value_flush(&val);
+        if (!ret) return EINA_FALSE;
      }
+   return EINA_TRUE;
 }
 
 static void
@@ -372,6 +1013,8 @@ esql_postgresql_free(Esql *e)
    if (!e->backend.db) return;
    PQfinish(e->backend.db);
    e->backend.db = NULL;
+   e->backend.stmt = NULL;
+   esql_postgresql_stmt_closed_free(e);
    e->backend.free = NULL;
 }
 
@@ -388,9 +1031,15 @@ esql_postgresql_init(Esql *e)
    e->backend.fd_get = esql_postgresql_fd_get;
    e->backend.escape = esql_postgresql_escape;
    e->backend.query = esql_postgresql_query;
+   e->backend.prepare = esql_postgresql_prepare;
+   e->backend.execute = esql_postgresql_execute;
+   e->backend.stmt_free = esql_postgresql_stmt_free;
    e->backend.res = esql_postgresql_res;
    e->backend.res_free = esql_postgresql_res_free;
    e->backend.free = esql_postgresql_free;
+#ifdef LIBPQ_HAS_PIPELINING
+   e->backend.pipeline = esql_postgresql_pipeline;
+#endif
 }
 
 EAPI Esql_Type
@@ -17,12 +17,102 @@
 
 #include "esql_module.h"
 #include <sqlite3.h>
+#include <stdint.h>
+
+/* jobs the worker can hold at once, must be a power of 2 */
+#define ESQL_SQLITE_QUEUE_SIZE 16
+/* plain queries whose statements the worker keeps prepared */
+#define ESQL_SQLITE_STMT_CACHE_SIZE 64
 
 typedef struct _Esql_Sqlite_Res
 {
    sqlite3_stmt *stmt;
 } Esql_Sqlite_Res;
 
+typedef struct _Esql_Sqlite_Stmt Esql_Sqlite_Stmt;
+struct _Esql_Sqlite_Stmt
+{
+   Esql_Sqlite_Stmt *next; /* on the list of handles waiting to be finalized */
+   sqlite3_stmt     *stmt; /* prepared by the worker on first execution */
+   unsigned int      len;
+   char              query[];
+};
+
+/* statement of a plain query, reset and reused when the same sql comes again */
+typedef struct _Esql_Sqlite_Cached
+{
+   EINA_INLIST;
+   sqlite3_stmt *stmt;
+   char          query[];
+} Esql_Sqlite_Cached;
+
+typedef enum
+{
+   ESQL_SQLITE_JOB_OPEN,
+   ESQL_SQLITE_JOB_QUERY,
+   ESQL_SQLITE_JOB_EXECUTE,
+   ESQL_SQLITE_JOB_QUIT
+} Esql_Sqlite_Job_Type;
+
+typedef struct _Esql_Sqlite_Job
+{
+   Esql_Sqlite_Job_Type type;
+   Esql                *e;
+   char                *query; /* OPEN: path, QUERY: sql, owned by the job */
+   unsigned int         len;
+   Esql_Sqlite_Stmt    *stmt; /* EXECUTE */
+   const Esql_Params   *params; /* EXECUTE: kept by the lib until the query completes */
+   Esql_Sqlite_Stmt    *closed; /* handles to finalize before running the job */
+} Esql_Sqlite_Job;
+
+/* messages posted from the worker to the main loop */
+typedef enum
+{
+   ESQL_SQLITE_MSG_STREAM = 1,
+   ESQL_SQLITE_MSG_OPENED,
+   ESQL_SQLITE_MSG_DONE,
+   ESQL_SQLITE_MSG_FAILED
+} Esql_Sqlite_Msg;
+
+/* or'd onto DONE and FAILED when the query went through the statement cache */
+#define ESQL_SQLITE_MSG_HIT  0x100
+#define ESQL_SQLITE_MSG_MISS 0x200
+#define ESQL_SQLITE_MSG_MASK 0xff
+
+/*
+ * one long-lived thread per connection: the main loop is the only producer
+ * and the worker the only consumer of the job ring, so head and tail are
+ * each written by a single side and only need to be published atomically.
+ * the semaphore is only there to let an idle worker sleep.
+ */
+typedef struct _Esql_Sqlite_Worker
+{
+   Esql           *e; /* NULL once the connection has been dropped */
+   sqlite3        *db; /* only used by the worker, apart from sqlite3_interrupt() */
+   Ecore_Thread   *thread;
+   Eina_Semaphore  wake; /* one count per submitted job */
+   Eina_Semaphore  ack; /* released once the main loop has consumed a streamed batch */
+   Eina_Semaphore  idle; /* released when the worker reaches the QUIT job */
+   Eina_Semaphore  room; /* released on each job popped once quit is set */
+   Esql_Sqlite_Job jobs[ESQL_SQLITE_QUEUE_SIZE];
+   unsigned int    head; /* next job to run, written by the worker */
+   unsigned int    tail; /* next free slot, written by the main loop */
+   int             quit;
+   unsigned int    busy; /* jobs in flight, main loop only */
+   char            error[512]; /* error of the last failed job, written by the worker */
+   Eina_Hash      *cache; /* sql -> Esql_Sqlite_Cached, worker only */
+   Eina_Inlist    *lru; /* least recently used first */
+   unsigned int    cached;
+} Esql_Sqlite_Worker;
+
+/* e->backend.db, kept across reconnects */
+typedef struct _Esql_Sqlite
+{
+   Esql_Sqlite_Worker *worker; /* running while connected */
+   Esql_Sqlite_Stmt   *closed; /* freed handles, handed to the worker with the next job */
+   char                error[512]; /* copied from the worker on failure */
+} Esql_Sqlite;
+
 static const char *esql_sqlite_error_get(Esql *e);
 static void esql_sqlite_disconnect(Esql *e);
 static int esql_sqlite_fd_get(Esql *e);
@@ -30,27 +120,101 @@ static int esql_sqlite_connect(Esql *e);
 static int esql_sqlite_io(Esql *e);
 static void esql_sqlite_setup(Esql *e, const char *addr, const char *user, const char *passwd);
 static void esql_sqlite_query(Esql *e, const char *query, unsigned int len);
+static void *esql_sqlite_prepare(Esql *e, const char *query, unsigned int len);
+static Eina_Bool esql_sqlite_execute(Esql *e, void *stmt, const Esql_Params *params);
+static void esql_sqlite_stmt_free(Esql *e, void *stmt);
 static void esql_sqlite_res_free(Esql_Res *res);
 static void esql_sqlite_res(Esql_Res *res);
 static char *esql_sqlite_escape(Esql *e, unsigned int *len, const char *fmt, va_list args);
-static void esql_sqlite_row_add(Esql_Res *res);
+static Eina_Bool esql_sqlite_row_add(Esql_Res *res);
 static void esql_sqlite_free(Esql *e);
 
 
 static const char *
 esql_sqlite_error_get(Esql *e)
 {
-   if (sqlite3_errcode(e->backend.db))
-     return sqlite3_errmsg(e->backend.db);
-   return NULL;
+   Esql_Sqlite *s = e->backend.db;
+
+   /* nothing has failed yet while the worker still owns the job */
+   if ((!s) || (s->worker && s->worker->busy) || (!s->error[0])) return NULL;
+   return s->error;
+}
+
+/* main loop side */
+static Eina_Bool
+esql_sqlite_job_push(Esql_Sqlite_Worker *w, const Esql_Sqlite_Job *job)
+{
+   unsigned int tail = w->tail;
+
+   if (tail - __atomic_load_n(&w->head, __ATOMIC_ACQUIRE) == ESQL_SQLITE_QUEUE_SIZE)
+     return EINA_FALSE;
+   w->jobs[tail & (ESQL_SQLITE_QUEUE_SIZE - 1)] = *job;
+   __atomic_store_n(&w->tail, tail + 1, __ATOMIC_RELEASE);
+   eina_semaphore_release(&w->wake, 1);
+   return EINA_TRUE;
+}
+
+/* worker side */
+static Eina_Bool
+esql_sqlite_job_pop(Esql_Sqlite_Worker *w, Esql_Sqlite_Job *job)
+{
+   unsigned int head = w->head;
+
+   if (__atomic_load_n(&w->tail, __ATOMIC_ACQUIRE) == head) return EINA_FALSE;
+   *job = w->jobs[head & (ESQL_SQLITE_QUEUE_SIZE - 1)];
+   __atomic_store_n(&w->head, head + 1, __ATOMIC_RELEASE);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+esql_sqlite_submit(Esql *e, Esql_Sqlite_Job *job)
+{
+   Esql_Sqlite *s = e->backend.db;
+   Esql_Sqlite_Worker *w = s->worker;
+
+   s->error[0] = 0;
+   job->e = e;
+   job->closed = s->closed;
+   if (!esql_sqlite_job_push(w, job))
+     {
+        snprintf(s->error, sizeof(s->error), "Too many queued SQLite jobs");
+        return EINA_FALSE;
+     }
+   s->closed = NULL;
+   w->busy++;
+   return EINA_TRUE;
 }
 
 static void
 esql_sqlite_disconnect(Esql *e)
 {
-   if (!e->backend.db) return;
-   while (sqlite3_close(e->backend.db));
-   e->backend.db = NULL;
+   Esql_Sqlite *s = e->backend.db;
+   Esql_Sqlite_Worker *w;
+   Esql_Sqlite_Job job;
+   sqlite3 *db;
+
+   if (s && s->worker)
+     {
+        w = s->worker;
+        s->worker = NULL;
+        w->e = NULL;
+        /* cut short whatever is running, including a stream waiting for its batch to be consumed */
+        __atomic_store_n(&w->quit, 1, __ATOMIC_SEQ_CST);
+        db = __atomic_load_n(&w->db, __ATOMIC_ACQUIRE);
+        if (db) sqlite3_interrupt(db);
+        eina_semaphore_release(&w->ack, 1);
+
+        memset(&job, 0, sizeof(Esql_Sqlite_Job));
+        job.type = ESQL_SQLITE_JOB_QUIT;
+        job.closed = s->closed;
+        s->closed = NULL;
+        /* with a full ring, the jobs ahead are skipped until there is room */
+        while (!esql_sqlite_job_push(w, &job))
+          eina_semaphore_lock(&w->room);
+        /* the job in flight still uses e, so wait until the worker is past it */
+        eina_semaphore_lock(&w->idle);
+        e->backend.stmt = NULL;
+     }
    free(e->backend.conn_str);
    e->backend.conn_str = NULL;
    e->backend.conn_str_len = 0;
@@ -64,45 +228,98 @@ esql_sqlite_fd_get(Esql *e EINA_UNUSED)
 }
 
 static void
-esql_sqlite_thread_end_cb(Esql *e, Ecore_Thread *et EINA_UNUSED)
+esql_sqlite_error_set(Esql_Sqlite_Worker *w, sqlite3 *db)
 {
-   DBG("(e=%p)", e);
-   e->backend.thread = NULL;
-   if (e->backend.stmt) sqlite3_finalize(e->backend.stmt);
-   e->backend.stmt = NULL;
-   esql_call_complete(e);
+   snprintf(w->error, sizeof(w->error), "%s", db ? sqlite3_errmsg(db) : "Out of memory");
 }
 
 static void
-esql_sqlite_thread_cancel_cb(Esql *e, Ecore_Thread *et EINA_UNUSED)
+esql_sqlite_stmts_finalize(Esql_Sqlite_Stmt *h)
 {
-   DBG("(e=%p)", e);
-   e->backend.thread = NULL;
-   esql_event_error(e);
+   Esql_Sqlite_Stmt *next;
+
+   for (; h; h = next)
+     {
+        next = h->next;
+        sqlite3_finalize(h->stmt);
+        free(h);
+     }
 }
 
 static void
-esql_sqlite_connect_cb(Esql *e, Ecore_Thread *et)
+esql_sqlite_cache_evict(Esql_Sqlite_Worker *w)
+{
+   Esql_Sqlite_Cached *c;
+
+   c = EINA_INLIST_CONTAINER_GET(w->lru, Esql_Sqlite_Cached);
+   w->lru = eina_inlist_remove(w->lru, w->lru);
+   eina_hash_del_by_key(w->cache, c->query);
+   sqlite3_finalize(c->stmt);
+   free(c);
+   w->cached--;
+}
+
+static void
+esql_sqlite_cache_clear(Esql_Sqlite_Worker *w)
+{
+   while (w->lru)
+     esql_sqlite_cache_evict(w);
+   if (w->cache) eina_hash_free(w->cache);
+   w->cache = NULL;
+}
+
+/* finds the statement for a plain query, preparing and caching it on a miss;
+ * statements which could not be cached come back without a HIT or MISS flag in @p msg
+ */
+static int
+esql_sqlite_cache_prepare(Esql_Sqlite_Worker *w, const Esql_Sqlite_Job *job, sqlite3_stmt **stmt, unsigned int *msg)
 {
-   if (sqlite3_open_v2(e->backend.conn_str, (struct sqlite3 **)&e->backend.db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL))
+   Esql_Sqlite_Cached *c;
+   int ret;
+
+   c = w->cache ? eina_hash_find(w->cache, job->query) : NULL;
+   if (c)
      {
-        ERR("Could not open %s: %s",
-            e->backend.conn_str, esql_sqlite_error_get(e));
-        ecore_thread_cancel(et);
-        e->backend.thread = NULL;
+        w->lru = eina_inlist_demote(w->lru, EINA_INLIST_GET(c));
+        *stmt = c->stmt;
+        *msg |= ESQL_SQLITE_MSG_HIT;
+        return SQLITE_OK;
      }
-   else
-     e->current = ESQL_CONNECT_TYPE_INIT;
+
+   ret = sqlite3_prepare_v2(w->db, job->query, job->len, stmt, NULL);
+   /* errors and empty queries */
+   if (ret || (!*stmt)) return ret;
+
+   if ((!w->cache) && (!(w->cache = eina_hash_string_superfast_new(NULL))))
+     return SQLITE_OK;
+   while (w->cached >= ESQL_SQLITE_STMT_CACHE_SIZE)
+     esql_sqlite_cache_evict(w);
+   c = malloc(sizeof(Esql_Sqlite_Cached) + job->len + 1);
+   if (!c) return SQLITE_OK;
+   c->stmt = *stmt;
+   memcpy(c->query, job->query, job->len + 1);
+   eina_hash_direct_add(w->cache, c->query, c);
+   w->lru = eina_inlist_append(w->lru, EINA_INLIST_GET(c));
+   w->cached++;
+   *msg |= ESQL_SQLITE_MSG_MISS;
+   return SQLITE_OK;
 }
 
-static int
-esql_sqlite_connect(Esql *e)
+static Eina_Bool
+esql_sqlite_open(Esql_Sqlite_Worker *w, const char *path)
 {
-   e->backend.thread = ecore_thread_run((Ecore_Thread_Cb)esql_sqlite_connect_cb,
-                                      (Ecore_Thread_Cb)esql_sqlite_thread_end_cb,
-                                      (Ecore_Thread_Cb)esql_sqlite_thread_cancel_cb, e);
-   EINA_SAFETY_ON_NULL_RETURN_VAL(e->backend.thread, ECORE_FD_ERROR);
-   return ECORE_FD_READ | ECORE_FD_WRITE;
+   sqlite3 *db = NULL;
+
+   /* only the worker ever runs statements, sqlite's own locking is not needed */
+   if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL))
+     {
+        esql_sqlite_error_set(w, db);
+        ERR("Could not open %s: %s", path, w->error);
+        sqlite3_close(db);
+        return EINA_FALSE;
+     }
+   __atomic_store_n(&w->db, db, __ATOMIC_RELEASE);
+   return EINA_TRUE;
 }
 
 static void
@@ -127,7 +344,7 @@ esql_module_setup_cb(Esql_Sqlite_Res *res, int col, Eina_Value_Struct_Member *m)
 }
 
 static Eina_Bool
-esql_sqlite_res_init(Esql *e)
+esql_sqlite_res_init(Esql *e, sqlite3 *db)
 {
    Esql_Sqlite_Res *res;
 
@@ -146,21 +363,70 @@ esql_sqlite_res_init(Esql *e)
 
    e->res->e = e;
    e->res->desc = esql_module_desc_get(sqlite3_column_count(e->backend.stmt), (Esql_Module_Setup_Cb)esql_module_setup_cb, e->res);
-   e->res->affected = sqlite3_changes(e->backend.db);
+   e->res->affected = sqlite3_changes(db);
+   if (e->columnar) return esql_res_columns_setup(e->res);
 
    return EINA_TRUE;
 }
 
-static void
-esql_sqlite_query_cb(Esql *e, Ecore_Thread *et)
+static Eina_Bool
+esql_sqlite_bind(sqlite3_stmt *stmt, const Esql_Params *params)
 {
+   const Esql_Param *p;
+   unsigned int i;
+   int ret = SQLITE_OK;
+
+   sqlite3_clear_bindings(stmt);
+   for (i = 0, p = params->params; (i < params->count) && (ret == SQLITE_OK); i++, p++)
+     switch (p->type)
+       {
+        case ESQL_PARAM_INT64:
+          ret = sqlite3_bind_int64(stmt, i + 1, p->v.i);
+          break;
+        case ESQL_PARAM_DOUBLE:
+          ret = sqlite3_bind_double(stmt, i + 1, p->v.d);
+          break;
+        case ESQL_PARAM_STRING:
+          /* params are kept until the query completes */
+          ret = sqlite3_bind_text(stmt, i + 1, p->v.s, p->len, SQLITE_STATIC);
+          break;
+        default:
+          ret = sqlite3_bind_null(stmt, i + 1);
+          break;
+       }
+   return ret == SQLITE_OK;
+}
+
+/* runs on the worker: prepares the job's statement and steps it to the end,
+ * returns the message to post
+ */
+static unsigned int
+esql_sqlite_job_run(Esql_Sqlite_Worker *w, Ecore_Thread *et, Esql_Sqlite_Job *job)
+{
+   Esql *e = job->e;
+   sqlite3_stmt *stmt = NULL;
+   unsigned int msg = 0;
    int ret = -1, tries = 0;
 
+   if (job->type == ESQL_SQLITE_JOB_EXECUTE)
+     {
+        /* cached handles are prepared once, then only rewound */
+        if ((!job->stmt->stmt) &&
+            sqlite3_prepare_v2(w->db, job->stmt->query, job->stmt->len, &job->stmt->stmt, NULL))
+          goto error;
+        stmt = job->stmt->stmt;
+        if (!esql_sqlite_bind(stmt, job->params)) goto error;
+     }
+   else if (esql_sqlite_cache_prepare(w, job, &stmt, &msg))
+     goto error;
+   /* empty query */
+   if (!stmt) return ESQL_SQLITE_MSG_DONE;
+
+   e->backend.stmt = stmt;
    while (++tries < 1000)
      {
-        if (!e->backend.stmt)
-          return;
-        ret = sqlite3_step(e->backend.stmt);
+        if (__atomic_load_n(&w->quit, __ATOMIC_ACQUIRE)) break;
+        ret = sqlite3_step(stmt);
         switch (ret)
           {
            case SQLITE_BUSY:
@@ -169,18 +435,23 @@ esql_sqlite_query_cb(Esql *e, Ecore_Thread *et)
            case SQLITE_DONE:
              if (!e->res)
                {
-                  if (!esql_sqlite_res_init(e)) goto out;
+                  if (!esql_sqlite_res_init(e, w->db)) goto out;
                }
-             sqlite3_finalize(e->backend.stmt);
-             e->backend.stmt = NULL;
-             return;
+             goto done;
            case SQLITE_ROW:
              if (!e->res)
                {
-                  if (!esql_sqlite_res_init(e)) goto out;
+                  if (!esql_sqlite_res_init(e, w->db)) goto out;
                }
-             esql_sqlite_row_add(e->res);
+             /* a result which could not be stored is handed over with its error */
+             if (!esql_sqlite_row_add(e->res)) goto done;
              tries = 0;
+             if (ESQL_RES_STREAM_FULL(e->res))
+               {
+                  /* wait for the batch to be consumed so only one is ever held in memory */
+                  ecore_thread_feedback(et, (void *)(uintptr_t)ESQL_SQLITE_MSG_STREAM);
+                  eina_semaphore_lock(&w->ack);
+               }
              break;
 
            default:
@@ -191,20 +462,170 @@ esql_sqlite_query_cb(Esql *e, Ecore_Thread *et)
    /* something crazy is going on */
 out:
    ERR("Query failed. Tries %d, ret %d", tries, ret);
-   sqlite3_finalize(e->backend.stmt);
+error:
+   esql_sqlite_error_set(w, w->db);
+   ret = -1;
+done:
    e->backend.stmt = NULL;
-   ecore_thread_cancel(et);
+   if ((job->type == ESQL_SQLITE_JOB_EXECUTE) || (msg & (ESQL_SQLITE_MSG_HIT | ESQL_SQLITE_MSG_MISS)))
+     {
+        if (stmt) sqlite3_reset(stmt);
+     }
+   else
+     sqlite3_finalize(stmt);
+   return msg | ((ret != -1) ? ESQL_SQLITE_MSG_DONE : ESQL_SQLITE_MSG_FAILED);
+}
+
+static void
+esql_sqlite_worker_cb(Esql_Sqlite_Worker *w, Ecore_Thread *et)
+{
+   Esql_Sqlite_Job job;
+   unsigned int msg;
+
+   for (;;)
+     {
+        eina_semaphore_lock(&w->wake);
+        if (!esql_sqlite_job_pop(w, &job)) continue;
+        esql_sqlite_stmts_finalize(job.closed);
+        if (__atomic_load_n(&w->quit, __ATOMIC_SEQ_CST))
+          {
+             eina_semaphore_release(&w->room, 1);
+             /* the connection is gone: e, and the params of an execution, must not be touched */
+             if (job.type != ESQL_SQLITE_JOB_QUIT)
+               {
+                  free(job.query);
+                  continue;
+               }
+          }
+        switch (job.type)
+          {
+           case ESQL_SQLITE_JOB_OPEN:
+             msg = esql_sqlite_open(w, job.query) ? ESQL_SQLITE_MSG_OPENED : ESQL_SQLITE_MSG_FAILED;
+             break;
+           case ESQL_SQLITE_JOB_QUIT:
+             esql_sqlite_cache_clear(w);
+             /* handles still held by the user keep the db alive until they are finalized */
+             sqlite3_close_v2(w->db);
+             eina_semaphore_release(&w->idle, 1);
+             return;
+           default:
+             msg = esql_sqlite_job_run(w, et, &job);
+          }
+        free(job.query);
+        /* ecore hands every message queued since its last wakeup to the main loop in one go */
+        if (!__atomic_load_n(&w->quit, __ATOMIC_ACQUIRE))
+          ecore_thread_feedback(et, (void *)(uintptr_t)msg);
+     }
+}
+
+static void
+esql_sqlite_notify_cb(Esql_Sqlite_Worker *w, Ecore_Thread *et EINA_UNUSED, void *data)
+{
+   unsigned int msg = (uintptr_t)data;
+   Esql_Sqlite *s;
+   Esql *e = w->e;
+
+   /* the connection was dropped while the message was in flight */
+   if (!e) return;
+   DBG("(e=%p, msg=%#x)", e, msg);
+   if (msg & ESQL_SQLITE_MSG_HIT)
+     e->stmts.hits++;
+   else if (msg & ESQL_SQLITE_MSG_MISS)
+     e->stmts.misses++;
+   msg &= ESQL_SQLITE_MSG_MASK;
+
+   if (msg == ESQL_SQLITE_MSG_STREAM)
+     {
+        esql_res_stream_flush(e->res);
+        eina_semaphore_release(&w->ack, 1);
+        return;
+     }
+
+   w->busy--;
+   switch (msg)
+     {
+      case ESQL_SQLITE_MSG_OPENED:
+        e->current = ESQL_CONNECT_TYPE_INIT;
+        esql_call_complete(e);
+        break;
+      case ESQL_SQLITE_MSG_DONE:
+        esql_call_complete(e);
+        break;
+      default:
+        s = e->backend.db;
+        memcpy(s->error, w->error, sizeof(s->error));
+        esql_event_error(e);
+     }
+}
+
+static void
+esql_sqlite_worker_free(Esql_Sqlite_Worker *w, Ecore_Thread *et EINA_UNUSED)
+{
+   eina_semaphore_free(&w->wake);
+   eina_semaphore_free(&w->ack);
+   eina_semaphore_free(&w->idle);
+   eina_semaphore_free(&w->room);
+   free(w);
+}
+
+static Esql_Sqlite_Worker *
+esql_sqlite_worker_new(Esql *e)
+{
+   Esql_Sqlite_Worker *w;
+   Ecore_Thread *t;
+
+   w = calloc(1, sizeof(Esql_Sqlite_Worker));
+   EINA_SAFETY_ON_NULL_RETURN_VAL(w, NULL);
+   w->e = e;
+   eina_semaphore_new(&w->wake, 0);
+   eina_semaphore_new(&w->ack, 0);
+   eina_semaphore_new(&w->idle, 0);
+   eina_semaphore_new(&w->room, 0);
+   /* a dedicated thread rather than one from the pool, it lives as long as the connection;
+    * on failure the cancel callback has already freed the worker
+    */
+   t = ecore_thread_feedback_run((Ecore_Thread_Cb)esql_sqlite_worker_cb,
+                                 (Ecore_Thread_Notify_Cb)esql_sqlite_notify_cb,
+                                 (Ecore_Thread_Cb)esql_sqlite_worker_free,
+                                 (Ecore_Thread_Cb)esql_sqlite_worker_free, w, EINA_TRUE);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(t, NULL);
+   w->thread = t;
+   return w;
+}
+
+static int
+esql_sqlite_connect(Esql *e)
+{
+   Esql_Sqlite *s = e->backend.db;
+   Esql_Sqlite_Job job;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(e->backend.conn_str, ECORE_FD_ERROR);
+   if (!s)
+     {
+        s = calloc(1, sizeof(Esql_Sqlite));
+        EINA_SAFETY_ON_NULL_RETURN_VAL(s, ECORE_FD_ERROR);
+        e->backend.db = s;
+     }
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(!!s->worker, ECORE_FD_ERROR);
+   s->worker = esql_sqlite_worker_new(e);
+   if (!s->worker) return ECORE_FD_ERROR;
+
+   memset(&job, 0, sizeof(Esql_Sqlite_Job));
+   job.type = ESQL_SQLITE_JOB_OPEN;
+   job.query = strdup(e->backend.conn_str);
+   if ((!job.query) || (!esql_sqlite_submit(e, &job)))
+     {
+        free(job.query);
+        return ECORE_FD_ERROR;
+     }
+   return ECORE_FD_READ | ECORE_FD_WRITE;
 }
 
 static int
 esql_sqlite_io(Esql *e)
 {
-   DBG("(e=%p, thread=%p)", e, e->backend.thread);
-   if (e->backend.thread) return ECORE_FD_ERROR;
-   e->backend.thread = ecore_thread_run((Ecore_Thread_Cb)esql_sqlite_query_cb,
-                                      (Ecore_Thread_Cb)esql_sqlite_thread_end_cb,
-                                      (Ecore_Thread_Cb)esql_sqlite_thread_cancel_cb, e);
-   EINA_SAFETY_ON_NULL_RETURN_VAL(e->backend.thread, ECORE_FD_ERROR);
+   /* jobs are handed to the worker as they are sent and complete through its notify callback */
+   DBG("(e=%p)", e);
    return ECORE_FD_READ | ECORE_FD_WRITE;
 }
 
@@ -217,7 +638,61 @@ esql_sqlite_setup(Esql *e, const char *addr, const char *user EINA_UNUSED, const
 static void
 esql_sqlite_query(Esql *e, const char *query, unsigned int len)
 {
-   EINA_SAFETY_ON_TRUE_RETURN(sqlite3_prepare_v2(e->backend.db, query, len, (struct sqlite3_stmt**)&e->backend.stmt, NULL));
+   Esql_Sqlite_Job job;
+
+   memset(&job, 0, sizeof(Esql_Sqlite_Job));
+   job.type = ESQL_SQLITE_JOB_QUERY;
+   /* preparing is left to the worker */
+   job.query = malloc(len + 1);
+   EINA_SAFETY_ON_NULL_RETURN(job.query);
+   memcpy(job.query, query, len);
+   job.query[len] = 0;
+   job.len = len;
+   if (!esql_sqlite_submit(e, &job)) free(job.query);
+}
+
+static void *
+esql_sqlite_prepare(Esql *e EINA_UNUSED, const char *query, unsigned int len)
+{
+   Esql_Sqlite_Stmt *h;
+
+   /* sqlite has no round trip to save: the worker prepares the handle when first executing it */
+   h = malloc(sizeof(Esql_Sqlite_Stmt) + len + 1);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(h, NULL);
+   h->next = NULL;
+   h->stmt = NULL;
+   h->len = len;
+   memcpy(h->query, query, len);
+   h->query[len] = 0;
+   return h;
+}
+
+static Eina_Bool
+esql_sqlite_execute(Esql *e, void *stmt, const Esql_Params *params)
+{
+   Esql_Sqlite_Job job;
+
+   memset(&job, 0, sizeof(Esql_Sqlite_Job));
+   job.type = ESQL_SQLITE_JOB_EXECUTE;
+   job.stmt = stmt;
+   job.params = params;
+   return esql_sqlite_submit(e, &job);
+}
+
+static void
+esql_sqlite_stmt_free(Esql *e, void *stmt)
+{
+   Esql_Sqlite *s = e->backend.db;
+   Esql_Sqlite_Stmt *h = stmt;
+
+   if (s && s->worker)
+     {
+        /* the worker may still be stepping it, it is finalized in order before the next job */
+        h->next = s->closed;
+        s->closed = h;
+        return;
+     }
+   esql_sqlite_stmts_finalize(h);
 }
 
 static void
@@ -237,80 +712,106 @@ esql_sqlite_escape(Esql *e EINA_UNUSED, unsigned int *len, const char *fmt, va_l
    return esql_query_escape(EINA_TRUE, len, fmt, args);
 }
 
-static void
+static Eina_Bool
+esql_sqlite_column_add(Esql_Res *res)
+{
+   sqlite3_stmt *stmt = res->e->backend.stmt;
+   unsigned int i;
+   Eina_Bool ret;
+
+   res->row_count++;
+   /* column storage types come from the first row, later rows are converted */
+   for (i = 0; i < res->desc->member_count; i++)
+     {
+        if (sqlite3_column_type(stmt, i) == SQLITE_NULL)
+          ret = esql_res_column_null_append(res, i);
+        else
+          switch (res->columns[i].type)
+            {
+             case ESQL_COLUMN_TYPE_INT64:
+               ret = esql_res_column_int64_append(res, i, sqlite3_column_int64(stmt, i));
+               break;
+             case ESQL_COLUMN_TYPE_DOUBLE:
+               ret = esql_res_column_double_append(res, i, sqlite3_column_double(stmt, i));
+               break;
+             default:
+               {
+                  const void *data;
+
+                  data = sqlite3_column_blob(stmt, i);
+                  ret = esql_res_column_string_append(res, i, data, sqlite3_column_bytes(stmt, i));
+               }
+            }
+        if (!ret)
+          {
+             esql_res_columns_fail(res);
+             return EINA_FALSE;
+          }
+     }
+   return EINA_TRUE;
+}
+
+static Eina_Bool
 esql_sqlite_row_add(Esql_Res *res)
 {
+   sqlite3_stmt *stmt = res->e->backend.stmt;
    Esql_Row *r;
-   Eina_Value *val;
    unsigned int i;
 
-   r = esql_row_calloc(1);
-   EINA_SAFETY_ON_NULL_RETURN(r);
-   r->res = res;
-   res->row_count++;
-   res->rows = eina_inlist_append(res->rows, EINA_INLIST_GET(r));
+   if (res->columns)
+     return esql_sqlite_column_add(res);
 
-   val = &(r->value);
-   eina_value_struct_setup(val, res->desc);
+   r = esql_res_row_add(res);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(r, EINA_TRUE);
+   res->row_count++;
 
    for (i = 0; i < res->desc->member_count; i++)
      {
-        const Eina_Value_Struct_Member *m = res->desc->members + i;
-        Eina_Value inv;
-
-        switch (sqlite3_column_type(res->e->backend.stmt, i))
+        switch (sqlite3_column_type(stmt, i))
           {
            case SQLITE_TEXT:
              {
-                eina_value_setup(&inv, EINA_VALUE_TYPE_STRING);
-                eina_value_set(&inv, sqlite3_column_text(res->e->backend.stmt, i));
+                const unsigned char *text;
+
+                /* sqlite3_column_bytes() must come after the conversion */
+                text = sqlite3_column_text(stmt, i);
+                esql_row_cell_string_set(r, i, (const char *)text, sqlite3_column_bytes(stmt, i));
                 break;
              }
+
            case SQLITE_INTEGER:
-             eina_value_setup(&inv, EINA_VALUE_TYPE_INT64);
-             eina_value_set(&inv, sqlite3_column_int64(res->e->backend.stmt, i));
+             esql_row_cell_int64_set(r, i, sqlite3_column_int64(stmt, i));
              break;
 
            case SQLITE_FLOAT:
-             eina_value_setup(&inv, EINA_VALUE_TYPE_DOUBLE);
-             eina_value_set(&inv, sqlite3_column_double(res->e->backend.stmt, i));
+             esql_row_cell_double_set(r, i, sqlite3_column_double(stmt, i));
              break;
 
            case SQLITE_BLOB:
              {
-                Eina_Value_Blob blob;
-                char *tmp;
-                int size;
-
-                size = sqlite3_column_bytes(res->e->backend.stmt, i);
-                tmp = malloc(size);
-                memcpy(tmp, sqlite3_column_blob(res->e->backend.stmt, i), size);
-
-                blob.ops = NULL;
-                blob.memory = tmp;
-                blob.size = size;
-                eina_value_setup(&inv, EINA_VALUE_TYPE_BLOB);
-                eina_value_set(&inv, blob);
+                const void *data;
+
+                data = sqlite3_column_blob(stmt, i);
+                esql_row_cell_string_set(r, i, data, sqlite3_column_bytes(stmt, i));
                 break;
              }
-           default: continue;
-          }
 
-        eina_value_struct_member_value_set(val, m, &inv);
-        eina_value_flush(&inv);
+           default: /* NULL */
+             break;
+          }
      }
+   return EINA_TRUE;
 }
 
 static void
 esql_sqlite_free(Esql *e)
 {
    if (!e->backend.db) return;
-   while (sqlite3_close(e->backend.db));
+   esql_sqlite_disconnect(e);
+   esql_sqlite_stmts_finalize(((Esql_Sqlite *)e->backend.db)->closed);
+   free(e->backend.db);
    e->backend.db = NULL;
    e->backend.free = NULL;
-   free(e->backend.conn_str);
-   e->backend.conn_str = NULL;
-   e->backend.conn_str_len = 0;
 }
 
 static void
@@ -326,6 +827,9 @@ esql_sqlite_init(Esql *e)
    e->backend.fd_get = esql_sqlite_fd_get;
    e->backend.escape = esql_sqlite_escape;
    e->backend.query = esql_sqlite_query;
+   e->backend.prepare = esql_sqlite_prepare;
+   e->backend.execute = esql_sqlite_execute;
+   e->backend.stmt_free = esql_sqlite_stmt_free;
    e->backend.res = esql_sqlite_res;
    e->backend.res_free = esql_sqlite_res_free;
    e->backend.free = esql_sqlite_free;
@@ -1,18 +1,67 @@
 check_PROGRAMS = \
 src/tests/basic_query \
-src/tests/basic_pool
+src/tests/basic_pool \
+src/tests/bench \
+src/tests/bench_escape
 
 
 if SQLITE
 check_PROGRAMS += src/tests/test_sqlite
 endif
 
+if POSTGRESQL
+check_PROGRAMS += src/tests/test_postgresql
+endif
+
+if MYSQL
+check_PROGRAMS += src/tests/mysql_mock src/tests/test_mysql
+BENCH_MYSQL_MOCK = src/tests/mysql_mock$(EXEEXT)
+else
+BENCH_MYSQL_MOCK =
+endif
+
 src_tests_basic_query_SOURCES = src/tests/basic_query.c
 src_tests_basic_query_CFLAGS = $(MOD_CFLAGS)
 src_tests_basic_query_LDADD = $(MOD_LIBS)
 src_tests_basic_pool_SOURCES = src/tests/basic_pool.c
 src_tests_basic_pool_CFLAGS = $(MOD_CFLAGS)
 src_tests_basic_pool_LDADD = $(MOD_LIBS)
+src_tests_bench_SOURCES = src/tests/bench.c
+src_tests_bench_CFLAGS = $(MOD_CFLAGS)
+src_tests_bench_LDADD = $(MOD_LIBS)
+src_tests_bench_escape_SOURCES = src/tests/bench_escape.c
+src_tests_bench_escape_CFLAGS = $(MOD_CFLAGS)
+src_tests_bench_escape_LDADD = $(MOD_LIBS)
+src_tests_mysql_mock_SOURCES = src/tests/mysql_mock.c
+src_tests_test_mysql_SOURCES = src/tests/test_mysql.c
+src_tests_test_mysql_CFLAGS = $(MOD_CFLAGS)
+src_tests_test_mysql_LDADD = $(MOD_LIBS)
+src_tests_test_postgresql_SOURCES = src/tests/test_postgresql.c
+src_tests_test_postgresql_CFLAGS = $(MOD_CFLAGS)
+src_tests_test_postgresql_LDADD = $(MOD_LIBS)
 src_tests_test_sqlite_SOURCES = src/tests/test_sqlite.c
 src_tests_test_sqlite_CFLAGS = $(MOD_CFLAGS)
 src_tests_test_sqlite_LDADD = $(MOD_LIBS)
+
+# the backends are loaded from $(libdir): run "make install" first.
+# add servers with BENCH_FLAGS, e.g. BENCH_FLAGS="-p 127.0.0.1:5432,user,password,db"
+# the MySQL backend is measured against src/tests/mysql_mock, started on BENCH_MOCK_PORT
+BENCH_FLAGS =
+BENCH_OUTPUT = bench.json
+BENCH_MOCK_FLAGS =
+BENCH_MOCK_PORT = 13306
+
+bench: src/tests/bench$(EXEEXT) $(BENCH_MYSQL_MOCK)
+	@mock=""; mysql=""; \
+	if test -n "$(BENCH_MYSQL_MOCK)"; then \
+	   $(top_builddir)/src/tests/mysql_mock -q -p $(BENCH_MOCK_PORT) $(BENCH_MOCK_FLAGS) & mock=$$!; \
+	   sleep 1; \
+	   mysql="-M 127.0.0.1:$(BENCH_MOCK_PORT)"; \
+	fi; \
+	$(top_builddir)/src/tests/bench -o $(BENCH_OUTPUT) $$mysql $(BENCH_FLAGS); ret=$$?; \
+	if test -n "$$mock"; then kill $$mock; fi; \
+	exit $$ret
+
+.PHONY: bench
+
+CLEANFILES += $(BENCH_OUTPUT)
@@ -22,6 +22,8 @@
 #include "Esskyuehl.h"
 #include <Ecore.h>
 
+static int pending = 0; /**< results still expected before quitting the main loop */
+
 static void
 print_results(Esql_Res *res)
 {
@@ -61,7 +63,7 @@ callback_(Esql_Res *res, char *data)
    printf("Query string: '%s'\n", esql_res_query_get(res));
    print_results(res);
    free(data);
-   ecore_main_loop_quit();
+   if (!--pending) ecore_main_loop_quit();
 }
 
 static Eina_Bool
@@ -72,7 +74,7 @@ result_(void *data EINA_UNUSED, int type EINA_UNUSED, Esql_Res *res)
    printf("Query string: '%s'\n", esql_res_query_get(res));
    free(esql_res_data_get(res));
    print_results(res);
-   ecore_main_loop_quit();
+   if (!--pending) ecore_main_loop_quit();
    return ECORE_CALLBACK_RENEW;
 }
 
@@ -97,25 +99,39 @@ connect_(void *data EINA_UNUSED, int type EINA_UNUSED, Esql *e)
         fprintf(stderr, "Could not create query!\n");
         ecore_main_loop_quit();
      }
-   else if (id % 2)
-     esql_query_callback_set(id, (Esql_Query_Cb)callback_);
+   else
+     {
+        pending = 1;
+        if (id % 2)
+          esql_query_callback_set(id, (Esql_Query_Cb)callback_);
+     }
    return ECORE_CALLBACK_RENEW;
 }
 
 static void
 connect_cb(Esql *e, void *data EINA_UNUSED)
 {
+   const char *query = "SELECT * FROM `diskconfig` WHERE disk='21' LIMIT 1";
    Esql_Query_Id id;
 
    printf("Connected using callback!\n");
-   id = esql_query(e, strdup("test data"), "SELECT * FROM `diskconfig` WHERE disk='21' LIMIT 1");
-   if (!id) /**< queue up a simple query */
-     {
-        fprintf(stderr, "Could not create query!\n");
-        ecore_main_loop_quit();
-     }
-   if (id % 2)
-     esql_query_callback_set(id, (Esql_Query_Cb)callback_);
+   /* one query for each way of getting a result */
+   pending = 4;
+   if (!esql_query(e, strdup("event data"), query)) /**< result delivered with ESQL_EVENT_RESULT */
+     goto error;
+   id = esql_query(e, strdup("callback_set data"), query);
+   if (!id) goto error;
+   esql_query_callback_set(id, (Esql_Query_Cb)callback_); /**< callback looked up by query id */
+   if (!esql_query_full(e, query, (Esql_Query_Cb)callback_, strdup("inline data"))) /**< callback stored with the query */
+     goto error;
+   if (!esql_query_args_full(e, (Esql_Query_Cb)callback_, strdup("inline args data"),
+                             "SELECT * FROM `diskconfig` WHERE disk='%d' LIMIT 1", 21))
+     goto error;
+   return;
+
+error:
+   fprintf(stderr, "Could not create query!\n");
+   ecore_main_loop_quit();
 }
 
 
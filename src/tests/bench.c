@@ -0,0 +1,677 @@
+/*
+ * Copyright 2011, 2012 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Esskyuehl.h"
+#include <Ecore.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#ifndef PACKAGE_VERSION
+# define PACKAGE_VERSION "unknown"
+#endif
+
+/*
+ * measures throughput and latency of each backend, and writes the results as json:
+ * - insert: the table is filled with multi-row INSERTs
+ * - lookup: point lookups on the primary key, one query at a time
+ * - scan, scan_columnar: the whole table is read, by row and by column
+ * - pool: point lookups on pools of 1 to 128 connections, each kept busy
+ * latencies are measured from making the query to its callback being run.
+ */
+
+/* default number of point lookups per scenario */
+#define BENCH_LOOKUPS 20000
+/* default number of rows in the table */
+#define BENCH_ROWS 100000
+/* rows per INSERT */
+#define BENCH_INSERT_BATCH 1000
+/* times the whole table is read */
+#define BENCH_SCANS 5
+/* default largest pool */
+#define BENCH_POOL_MAX 128
+/* queries waiting for each connection of a pool */
+#define BENCH_POOL_DEPTH 2
+/* servers measured in one run, SQLite included */
+#define BENCH_BACKENDS_MAX 8
+
+#ifdef __GLIBC__
+/*
+ * counts the allocations of the whole process, esql and its backends included: defining
+ * these here overrides the libc ones for every library. the harness itself only allocates
+ * to build INSERT queries.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long long bench_allocs = 0;
+
+void *
+malloc(size_t size)
+{
+   __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+   return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+   __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+   return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+   __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+   return __libc_realloc(ptr, size);
+}
+
+# define BENCH_ALLOCS_GET() __atomic_load_n(&bench_allocs, __ATOMIC_RELAXED)
+#else
+# define BENCH_ALLOCS_GET() 0
+#endif
+
+typedef enum
+{
+   BENCH_STAGE_CONNECT,
+   BENCH_STAGE_SETUP,
+   BENCH_STAGE_INSERT,
+   BENCH_STAGE_LOOKUP,
+   BENCH_STAGE_SCAN,
+   BENCH_STAGE_SCAN_COLUMNAR,
+   BENCH_STAGE_POOL_CONNECT,
+   BENCH_STAGE_POOL,
+   BENCH_STAGE_POOL_DONE,
+   BENCH_STAGE_FINISH
+} Bench_Stage;
+
+typedef struct
+{
+   const char *name;
+   Esql_Type   type;
+   const char *addr;
+   const char *user;
+   const char *passwd;
+   const char *database;
+   char       *spec; /* the fields above point into it */
+} Bench_Backend;
+
+typedef struct Bench Bench;
+typedef const char *(*Bench_Query)(Bench *b, unsigned int i);
+
+struct Bench
+{
+   Bench_Backend backends[BENCH_BACKENDS_MAX];
+   unsigned int  backend_count;
+   unsigned int  backend; /* index of the current one */
+   Bench_Stage   stage;
+   Eina_Bool     aborted;
+   Esql         *e; /* the connection used outside of pools */
+   Esql         *cur; /* what queries are made on */
+   unsigned int  pool_size;
+
+   unsigned int  lookups;
+   unsigned int  rows;
+   unsigned int  pool_max;
+
+   /* the running scenario */
+   const char   *scenario; /* NULL if it is not reported */
+   Bench_Query   query;
+   unsigned int  total;
+   unsigned int  depth;
+   unsigned int  sent;
+   unsigned int  done;
+   unsigned int  errors;
+   unsigned long long rows_done;
+   unsigned long long allocs;
+   double        start;
+   double       *lat; /* start time, then latency of each query */
+   char          buf[256];
+   Eina_Strbuf  *insert;
+
+   Eina_Strbuf  *json;
+   unsigned int  results;
+};
+
+static void bench_step(void *data);
+
+static void
+bench_step_next(Bench *b)
+{
+   b->stage++;
+   ecore_job_add(bench_step, b);
+}
+
+static void
+bench_abort(Bench *b)
+{
+   if (b->aborted) return;
+   b->aborted = EINA_TRUE;
+   b->stage = BENCH_STAGE_FINISH;
+   ecore_job_add(bench_step, b);
+}
+
+static long
+bench_rss_kb(void)
+{
+   long pages, rss;
+   FILE *f;
+
+   f = fopen("/proc/self/statm", "r");
+   if (!f) return -1;
+   if (fscanf(f, "%ld %ld", &pages, &rss) != 2) rss = -1;
+   fclose(f);
+   return (rss < 0) ? -1 : rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int
+bench_double_cmp(const void *a,
+                 const void *b)
+{
+   double x = *(const double *)a, y = *(const double *)b;
+
+   return (x > y) - (x < y);
+}
+
+/* nearest rank, on sorted latencies */
+static double
+bench_quantile(const double *lat,
+               unsigned int  count,
+               double        q)
+{
+   unsigned int rank;
+
+   if (!count) return 0;
+   rank = (unsigned int)(q * count);
+   if (rank < q * count) rank++;
+   if (!rank) rank = 1;
+   return lat[rank - 1];
+}
+
+static void
+bench_report(Bench *b)
+{
+   unsigned long long allocs;
+   struct rusage ru;
+   double t, p50, p99;
+
+   t = ecore_time_get() - b->start;
+   if (t <= 0) t = 1e-9;
+   allocs = BENCH_ALLOCS_GET() - b->allocs;
+   if (!b->scenario) return;
+
+   qsort(b->lat, b->done, sizeof(double), bench_double_cmp);
+   p50 = bench_quantile(b->lat, b->done, 0.5);
+   p99 = bench_quantile(b->lat, b->done, 0.99);
+   getrusage(RUSAGE_SELF, &ru);
+
+   fprintf(stderr, "%-10s %-14s x%-4u %9.0f q/s %11.0f rows/s  p50 %8.3fms  p99 %8.3fms",
+           b->backends[b->backend].name, b->scenario, b->cur == b->e ? 1 : b->pool_size,
+           b->done / t, b->rows_done / t, p50 * 1000, p99 * 1000);
+#ifdef __GLIBC__
+   fprintf(stderr, "  %7.1f allocs/q", b->done ? (double)allocs / b->done : 0.0);
+#endif
+   fprintf(stderr, "%s\n", b->errors ? "  (errors!)" : "");
+
+   eina_strbuf_append_printf(b->json, "%s\n    {\"backend\": \"%s\", \"scenario\": \"%s\", \"connections\": %u, "
+                             "\"queries\": %u, \"errors\": %u, \"rows\": %llu, \"seconds\": %.6f, "
+                             "\"qps\": %.1f, \"rows_per_sec\": %.1f, "
+                             "\"latency_p50_ms\": %.4f, \"latency_p99_ms\": %.4f, \"latency_max_ms\": %.4f, ",
+                             b->results ? "," : "", b->backends[b->backend].name, b->scenario,
+                             b->cur == b->e ? 1 : b->pool_size, b->done, b->errors, b->rows_done, t,
+                             b->done / t, b->rows_done / t, p50 * 1000, p99 * 1000,
+                             b->done ? b->lat[b->done - 1] * 1000 : 0);
+#ifdef __GLIBC__
+   eina_strbuf_append_printf(b->json, "\"allocs_per_query\": %.2f, ",
+                             b->done ? (double)allocs / b->done : 0.0);
+#else
+   eina_strbuf_append(b->json, "\"allocs_per_query\": null, ");
+#endif
+   eina_strbuf_append_printf(b->json, "\"rss_kb\": %ld, \"max_rss_kb\": %ld}", bench_rss_kb(), ru.ru_maxrss);
+   b->results++;
+}
+
+static void bench_send(Bench *b);
+
+static void
+bench_query_done(Esql_Res *res,
+                 void     *data)
+{
+   Bench *b = esql_data_get(esql_res_esql_get(res));
+   unsigned int i = (uintptr_t)data;
+   int rows;
+
+   /* the connection is about to be freed */
+   if (b->aborted) return;
+   b->lat[i] = ecore_time_get() - b->lat[i];
+   if (esql_res_error_get(res))
+     {
+        if (!b->errors)
+          fprintf(stderr, "%s: %s\n", b->backends[b->backend].name, esql_res_error_get(res));
+        b->errors++;
+     }
+   rows = esql_res_rows_count(res);
+   b->rows_done += (rows > 0) ? rows : esql_res_rows_affected(res);
+   b->done++;
+   if (b->sent < b->total)
+     bench_send(b);
+   else if (b->done == b->total)
+     {
+        bench_report(b);
+        /* a failed setup would make the numbers meaningless */
+        if ((!b->scenario) && b->errors)
+          bench_abort(b);
+        else
+          bench_step_next(b);
+     }
+}
+
+static void
+bench_send(Bench *b)
+{
+   unsigned int i = b->sent++;
+   const char *query;
+
+   query = b->query(b, i);
+   b->lat[i] = ecore_time_get();
+   if (query && esql_query_full(b->cur, query, bench_query_done, (void *)(uintptr_t)i)) return;
+
+   fprintf(stderr, "%s: could not make query %u\n", b->backends[b->backend].name, i);
+   b->lat[i] = 0;
+   b->errors++;
+   b->done++;
+   bench_abort(b);
+}
+
+/* makes @p total queries from @p query, keeping @p depth of them in flight */
+static void
+bench_run(Bench       *b,
+          const char  *scenario,
+          Bench_Query  query,
+          unsigned int total,
+          unsigned int depth)
+{
+   free(b->lat);
+   b->lat = calloc(total, sizeof(double));
+   if (!b->lat)
+     {
+        bench_abort(b);
+        return;
+     }
+   b->scenario = scenario;
+   b->query = query;
+   b->total = total;
+   b->depth = depth;
+   b->sent = b->done = b->errors = 0;
+   b->rows_done = 0;
+   b->allocs = BENCH_ALLOCS_GET();
+   b->start = ecore_time_get();
+   while ((b->sent < b->total) && (b->sent < b->depth) && (!b->aborted))
+     bench_send(b);
+}
+
+static const char *
+bench_query_setup(Bench       *b EINA_UNUSED,
+                  unsigned int i)
+{
+   static const char *queries[] =
+   {
+      "DROP TABLE IF EXISTS esql_bench",
+      "CREATE TABLE esql_bench (id INTEGER PRIMARY KEY, name VARCHAR(64), value DOUBLE PRECISION)"
+   };
+
+   return queries[i];
+}
+
+static const char *
+bench_query_insert(Bench       *b,
+                   unsigned int i)
+{
+   unsigned int id, end;
+
+   id = i * BENCH_INSERT_BATCH;
+   end = (id + BENCH_INSERT_BATCH < b->rows) ? id + BENCH_INSERT_BATCH : b->rows;
+   eina_strbuf_reset(b->insert);
+   eina_strbuf_append(b->insert, "INSERT INTO esql_bench (id, name, value) VALUES ");
+   for (; id < end; id++)
+     eina_strbuf_append_printf(b->insert, "%s(%u, 'name-%u', %u.25)",
+                               (id % BENCH_INSERT_BATCH) ? "," : "", id, id, id);
+   return eina_strbuf_string_get(b->insert);
+}
+
+static const char *
+bench_query_lookup(Bench       *b,
+                   unsigned int i)
+{
+   /* spread over the whole table, the same ids on every run */
+   snprintf(b->buf, sizeof(b->buf), "SELECT id, name, value FROM esql_bench WHERE id = %u",
+            (unsigned int)((i * 2654435761U) % b->rows));
+   return b->buf;
+}
+
+static const char *
+bench_query_scan(Bench       *b EINA_UNUSED,
+                 unsigned int i EINA_UNUSED)
+{
+   return "SELECT id, name, value FROM esql_bench";
+}
+
+static void
+bench_connected(Esql *e,
+                void *data)
+{
+   Bench *b = data;
+
+   /* failures are handled along with the error event */
+   if ((e != b->cur) || (!esql_isconnected(e))) return;
+   bench_step_next(b);
+}
+
+static Eina_Bool
+bench_error(void *data,
+            int   type EINA_UNUSED,
+            void *event_info)
+{
+   Bench *b = data;
+   Esql *e = event_info;
+
+   if (e != b->cur) return ECORE_CALLBACK_RENEW;
+   fprintf(stderr, "%s: %s\n", b->backends[b->backend].name, esql_error_get(e));
+   bench_abort(b);
+   return ECORE_CALLBACK_RENEW;
+}
+
+/* connects @p e, moving on to the next stage once connected */
+static void
+bench_connect(Bench *b,
+              Esql  *e)
+{
+   const Bench_Backend *be = &b->backends[b->backend];
+
+   b->cur = e;
+   esql_data_set(e, b);
+   esql_connect_callback_set(e, bench_connected, b);
+   esql_connect_timeout_set(e, 10.0);
+   if (be->database) esql_database_set(e, be->database);
+   if (!esql_connect(e, be->addr, be->user, be->passwd))
+     {
+        fprintf(stderr, "%s: could not connect to %s\n", be->name, be->addr);
+        bench_abort(b);
+     }
+}
+
+static void
+bench_step(void *data)
+{
+   Bench *b = data;
+   Esql *pool;
+
+   if (b->aborted && (b->stage != BENCH_STAGE_FINISH)) return;
+   switch (b->stage)
+     {
+      case BENCH_STAGE_CONNECT:
+        b->e = esql_new(b->backends[b->backend].type);
+        if (!b->e)
+          {
+             bench_abort(b);
+             break;
+          }
+        bench_connect(b, b->e);
+        break;
+
+      case BENCH_STAGE_SETUP:
+        bench_run(b, NULL, bench_query_setup, 2, 1);
+        break;
+
+      case BENCH_STAGE_INSERT:
+        bench_run(b, "insert", bench_query_insert, (b->rows + BENCH_INSERT_BATCH - 1) / BENCH_INSERT_BATCH, 1);
+        break;
+
+      case BENCH_STAGE_LOOKUP:
+        bench_run(b, "lookup", bench_query_lookup, b->lookups, 1);
+        break;
+
+      case BENCH_STAGE_SCAN:
+        bench_run(b, "scan", bench_query_scan, BENCH_SCANS, 1);
+        break;
+
+      case BENCH_STAGE_SCAN_COLUMNAR:
+        esql_columnar_set(b->e, EINA_TRUE);
+        bench_run(b, "scan_columnar", bench_query_scan, BENCH_SCANS, 1);
+        break;
+
+      case BENCH_STAGE_POOL_CONNECT:
+        b->pool_size = b->pool_size ? b->pool_size * 2 : 1;
+        if (b->pool_size > b->pool_max) b->pool_size = b->pool_max;
+        pool = esql_pool_new(b->pool_size, b->backends[b->backend].type);
+        if (!pool)
+          {
+             bench_abort(b);
+             break;
+          }
+        bench_connect(b, pool);
+        break;
+
+      case BENCH_STAGE_POOL:
+        bench_run(b, "pool", bench_query_lookup, b->lookups, b->pool_size * BENCH_POOL_DEPTH);
+        break;
+
+      case BENCH_STAGE_POOL_DONE:
+        esql_free(b->cur);
+        b->cur = b->e;
+        if (b->pool_size < b->pool_max)
+          {
+             b->stage = BENCH_STAGE_POOL_CONNECT;
+             ecore_job_add(bench_step, b);
+          }
+        else
+          bench_step_next(b);
+        break;
+
+      case BENCH_STAGE_FINISH:
+        if (b->cur && (b->cur != b->e)) esql_free(b->cur);
+        if (b->e) esql_free(b->e);
+        b->e = b->cur = NULL;
+        b->pool_size = 0;
+        b->aborted = EINA_FALSE;
+        b->stage = BENCH_STAGE_CONNECT;
+        if (++b->backend < b->backend_count)
+          ecore_job_add(bench_step, b);
+        else
+          ecore_main_loop_quit();
+        break;
+     }
+}
+
+/* parses ADDR,USER,PASSWORD,DATABASE */
+static Eina_Bool
+bench_backend_add(Bench      *b,
+                  const char *name,
+                  Esql_Type   type,
+                  const char *arg)
+{
+   Bench_Backend *be = &b->backends[b->backend_count];
+   char *spec;
+
+   /* a slot is kept for SQLite */
+   if (b->backend_count == BENCH_BACKENDS_MAX - 1)
+     {
+        fprintf(stderr, "too many servers\n");
+        return EINA_FALSE;
+     }
+   spec = be->spec = strdup(arg);
+   if (!spec) return EINA_FALSE;
+   be->name = name;
+   be->type = type;
+   be->addr = strsep(&spec, ",");
+   be->user = strsep(&spec, ",");
+   be->passwd = strsep(&spec, ",");
+   be->database = strsep(&spec, ",");
+   if ((!be->addr) || (!be->addr[0]) || (!be->database))
+     {
+        fprintf(stderr, "%s: expected ADDR,USER,PASSWORD,DATABASE\n", name);
+        free(be->spec);
+        be->spec = NULL;
+        return EINA_FALSE;
+     }
+   b->backend_count++;
+   return EINA_TRUE;
+}
+
+static void
+usage(const char *prog)
+{
+   fprintf(stderr,
+           "usage: %s [options]\n"
+           "  -o FILE                          write the json results to FILE instead of stdout\n"
+           "  -n NUMBER                        point lookups per scenario (default: %u)\n"
+           "  -r NUMBER                        rows in the table (default: %u)\n"
+           "  -c NUMBER                        largest pool, sizes double from 1 (default: %u)\n"
+           "  -s PATH                          SQLite database to use (default: a temporary file)\n"
+           "  -S                               skip SQLite\n"
+           "  -m ADDR,USER,PASSWORD,DATABASE   benchmark a MySQL server\n"
+           "  -p ADDR,USER,PASSWORD,DATABASE   benchmark a PostgreSQL server\n"
+           "  -M ADDR                          benchmark the MySQL backend against src/tests/mysql_mock\n"
+           "the table esql_bench is dropped and created again in each database.\n",
+           prog, BENCH_LOOKUPS, BENCH_ROWS, BENCH_POOL_MAX);
+}
+
+int
+main(int    argc,
+     char **argv)
+{
+   Bench b;
+   Ecore_Event_Handler *eh;
+   const char *out = NULL, *sqlite = NULL;
+   Eina_Tmpstr *tmp = NULL;
+   Eina_Bool use_sqlite = EINA_TRUE;
+   char mock[256];
+   FILE *f;
+   unsigned int i;
+   int opt, fd, ret = 0;
+
+   memset(&b, 0, sizeof(b));
+   b.lookups = BENCH_LOOKUPS;
+   b.rows = BENCH_ROWS;
+   b.pool_max = BENCH_POOL_MAX;
+
+   while ((opt = getopt(argc, argv, "o:n:r:c:s:Sm:p:M:h")) != -1)
+     {
+        switch (opt)
+          {
+           case 'o': out = optarg; break;
+           case 'n': b.lookups = strtoul(optarg, NULL, 10); break;
+           case 'r': b.rows = strtoul(optarg, NULL, 10); break;
+           case 'c': b.pool_max = strtoul(optarg, NULL, 10); break;
+           case 's': sqlite = optarg; break;
+           case 'S': use_sqlite = EINA_FALSE; break;
+           case 'm':
+             if (!bench_backend_add(&b, "mysql", ESQL_TYPE_MYSQL, optarg)) return 1;
+             break;
+           case 'p':
+             if (!bench_backend_add(&b, "postgresql", ESQL_TYPE_POSTGRESQL, optarg)) return 1;
+             break;
+           case 'M':
+             /* the mock takes any login */
+             snprintf(mock, sizeof(mock), "%s,bench,bench,bench", optarg);
+             if (!bench_backend_add(&b, "mysql_mock", ESQL_TYPE_MYSQL, mock)) return 1;
+             break;
+           default:
+             usage(argv[0]);
+             return opt != 'h';
+          }
+     }
+   if ((!b.lookups) || (!b.rows) || (!b.pool_max))
+     {
+        usage(argv[0]);
+        return 1;
+     }
+
+   if (!esql_init()) return 1;
+
+   if (use_sqlite)
+     {
+        if (!sqlite)
+          {
+             fd = eina_file_mkstemp("esql_bench_XXXXXX.db", &tmp);
+             if (fd < 0)
+               {
+                  fprintf(stderr, "could not create a temporary file\n");
+                  esql_shutdown();
+                  return 1;
+               }
+             close(fd);
+             sqlite = tmp;
+          }
+        /* run first, it needs no server */
+        memmove(&b.backends[1], &b.backends[0], b.backend_count * sizeof(Bench_Backend));
+        b.backends[0].name = "sqlite";
+        b.backends[0].type = ESQL_TYPE_SQLITE;
+        b.backends[0].addr = sqlite;
+        b.backends[0].database = NULL;
+        b.backends[0].spec = NULL;
+        b.backend_count++;
+     }
+
+   b.insert = eina_strbuf_new();
+   b.json = eina_strbuf_new();
+   eina_strbuf_append_printf(b.json, "{\n  \"version\": \"%s\",\n  \"time\": %lld,\n  \"lookups\": %u,\n"
+                             "  \"rows\": %u,\n  \"results\": [", PACKAGE_VERSION, (long long)time(NULL),
+                             b.lookups, b.rows);
+   eh = ecore_event_handler_add(ESQL_EVENT_ERROR, bench_error, &b);
+
+   if (b.backend_count)
+     {
+        ecore_job_add(bench_step, &b);
+        ecore_main_loop_begin();
+     }
+   eina_strbuf_append(b.json, "\n  ]\n}\n");
+
+   f = out ? fopen(out, "w") : stdout;
+   if (f)
+     {
+        fputs(eina_strbuf_string_get(b.json), f);
+        if (f != stdout) fclose(f);
+     }
+   else
+     {
+        fprintf(stderr, "could not write to %s\n", out);
+        ret = 1;
+     }
+
+   if (tmp)
+     {
+        unlink(tmp);
+        eina_tmpstr_del(tmp);
+     }
+   for (i = 0; i < b.backend_count; i++)
+     free(b.backends[i].spec);
+   ecore_event_handler_del(eh);
+   eina_strbuf_free(b.json);
+   eina_strbuf_free(b.insert);
+   free(b.lat);
+   esql_shutdown();
+   return ret;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2011, 2012 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Esskyuehl.h"
+#include <Ecore.h>
+#include <stdio.h>
+
+/* compares esql_string_escape() with the byte-by-byte implementation it replaced */
+
+/* bytes escaped per payload and implementation */
+#define BENCH_BYTES (256 * 1024 * 1024)
+
+static char *
+escape_bytewise(Eina_Bool   backslashes,
+                const char *s)
+{
+   char *ret, *rp;
+   const char *p;
+
+   ret = malloc(sizeof(char) * strlen(s) * 2 + 1);
+   if (!ret) return NULL;
+   if (!backslashes)
+     {
+        for (p = s, rp = ret; *p; p++, rp++)
+          {
+             if (*p == '\'')
+               {
+                  *rp = '\'';
+                  rp++;
+               }
+
+             *rp = *p;
+          }
+     }
+   else
+     {
+        for (p = s, rp = ret; *p; p++, rp++)
+          {
+             char e = 0;
+
+             switch (*p)
+               {
+                case '\'':
+                case '\\':
+                case '"':
+                  e = *p;
+                  break;
+
+                case '\n':
+                  e = 'n';
+                  break;
+
+                case '\r':
+                  e = 'r';
+                  break;
+
+                default:
+                  *rp = *p;
+                  continue;
+               }
+
+             *rp++ = '\\';
+             *rp = e;
+          }
+     }
+   *rp = 0;
+   return ret;
+}
+
+/* an array of json objects, as stored in a text column */
+static char *
+payload_json(void)
+{
+   Eina_Strbuf *buf;
+   int i;
+
+   buf = eina_strbuf_new();
+   eina_strbuf_append_char(buf, '[');
+   for (i = 0; i < 64; i++)
+     eina_strbuf_append_printf(buf, "%s{\"id\":%d,\"name\":\"user %d\",\"email\":\"user%d@example.com\","
+                               "\"bio\":\"Works on databases and likes long walks, it's said.\","
+                               "\"tags\":[\"sql\",\"efl\",\"c\"],\"score\":%d.%02d}",
+                               i ? "," : "", i, i, i, i * 37, i % 100);
+   eina_strbuf_append_char(buf, ']');
+   return eina_strbuf_string_steal(buf);
+}
+
+/* paragraphs of prose, with the odd apostrophe */
+static char *
+payload_text(void)
+{
+   Eina_Strbuf *buf;
+   int i;
+
+   buf = eina_strbuf_new();
+   for (i = 0; i < 24; i++)
+     eina_strbuf_append(buf, "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+                        "incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud "
+                        "exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure "
+                        "dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur, "
+                        "isn't it?\n\n");
+   return eina_strbuf_string_steal(buf);
+}
+
+/* base64, nothing to escape */
+static char *
+payload_base64(void)
+{
+   static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+   char *ret;
+   int i;
+
+   ret = malloc(8192 + 1);
+   if (!ret) return NULL;
+   for (i = 0; i < 8192; i++)
+     ret[i] = b64[(i * 7 + i / 64) % 64];
+   ret[8192] = 0;
+   return ret;
+}
+
+static double
+bench(char *(*escape)(Eina_Bool, const char *), Eina_Bool backslashes, const char *s, size_t len)
+{
+   double t;
+   size_t n;
+   char *ret;
+
+   t = ecore_time_get();
+   for (n = 0; n < BENCH_BYTES; n += len)
+     {
+        ret = escape(backslashes, s);
+        free(ret);
+     }
+   t = ecore_time_get() - t;
+   return (n / (1024.0 * 1024.0)) / t;
+}
+
+int
+main(void)
+{
+   static const char *names[] = { "json", "text", "base64" };
+   char *payloads[3];
+   char *a, *b;
+   int i, backslashes, ret = 0;
+   size_t len;
+
+   if (!esql_init()) return 1;
+   payloads[0] = payload_json();
+   payloads[1] = payload_text();
+   payloads[2] = payload_base64();
+
+   printf("%-8s %-11s %8s %12s %12s %8s\n", "payload", "escaping", "bytes", "bytewise", "esql", "speedup");
+   for (i = 0; i < 3; i++)
+     for (backslashes = 1; backslashes >= 0; backslashes--)
+       {
+          double old, cur;
+
+          len = strlen(payloads[i]);
+          a = escape_bytewise(backslashes, payloads[i]);
+          b = esql_string_escape(backslashes, payloads[i]);
+          if ((!a) || (!b) || strcmp(a, b))
+            {
+               fprintf(stderr, "%s: esql_string_escape() output differs!\n", names[i]);
+               ret = 1;
+            }
+          free(a);
+          free(b);
+
+          old = bench(escape_bytewise, backslashes, payloads[i], len);
+          cur = bench(esql_string_escape, backslashes, payloads[i], len);
+          printf("%-8s %-11s %8zu %9.0fMB/s %9.0fMB/s %7.2fx\n", names[i],
+                 backslashes ? "backslashes" : "quotes", len, old, cur, cur / old);
+       }
+
+   for (i = 0; i < 3; i++)
+     free(payloads[i]);
+   esql_shutdown();
+   return ret;
+}
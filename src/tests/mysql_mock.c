@@ -0,0 +1,986 @@
+/*
+ * Copyright 2011, 2012 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/*
+ * a fake mysql server for the mysql backend: it speaks the part of the protocol
+ * which mysac uses (handshake, COM_QUERY, COM_STMT_*), accepts any login, and
+ * answers every SELECT with the same canned result set. SELECTs with a WHERE
+ * clause get the "lookup" result set, the others the "scan" one; everything
+ * else is answered with an OK. the result sets are encoded once at startup, so
+ * the server costs next to nothing compared to the client being measured.
+ * it only depends on libc, and runs on its own.
+ */
+
+/* protocol constants, so that the mysql headers are not needed */
+#define MOCK_COM_QUIT         0x01
+#define MOCK_COM_INIT_DB      0x02
+#define MOCK_COM_QUERY        0x03
+#define MOCK_COM_PING         0x0e
+#define MOCK_COM_STMT_PREPARE 0x16
+#define MOCK_COM_STMT_EXECUTE 0x17
+#define MOCK_COM_STMT_CLOSE   0x19
+#define MOCK_COM_STMT_RESET   0x1a
+
+#define MOCK_TYPE_DOUBLE      0x05
+#define MOCK_TYPE_LONGLONG    0x08
+#define MOCK_TYPE_VAR_STRING  0xfd
+
+/* LONG_PASSWORD | LONG_FLAG | CONNECT_WITH_DB | PROTOCOL_41 | TRANSACTIONS | SECURE_CONNECTION */
+#define MOCK_CAPABILITIES     0xa20d
+#define MOCK_STATUS           0x0002 /* autocommit */
+#define MOCK_CHARSET_UTF8     33
+#define MOCK_CHARSET_BINARY   63
+#define MOCK_NOT_NULL_FLAG    0x0001
+
+#define MOCK_SALT "0123456789abcdefghij"
+#define MOCK_PORT 3307
+
+typedef struct
+{
+   unsigned char *data;
+   size_t         len;
+   size_t         size;
+} Mock_Buf;
+
+typedef struct Mock_Segment Mock_Segment;
+
+/* bytes to send once due, either owned or pointing to a canned result set */
+struct Mock_Segment
+{
+   Mock_Segment        *next;
+   const unsigned char *data;
+   size_t               len;
+   size_t               sent;
+   double               due;
+   unsigned char       *owned;
+};
+
+typedef struct
+{
+   unsigned int id;
+   unsigned int params;
+   int          result; /* index of the result set, -1 if there is none */
+} Mock_Stmt;
+
+typedef struct
+{
+   int           fd;
+   int           authed;
+   Mock_Buf      in;
+   Mock_Segment *head;
+   Mock_Segment *tail;
+   double        last_due;
+   Mock_Stmt    *stmts;
+   unsigned int  stmt_count;
+   unsigned int  stmt_id;
+   unsigned int  seed;
+} Mock_Conn;
+
+enum
+{
+   MOCK_RESULT_SCAN,
+   MOCK_RESULT_LOOKUP,
+   MOCK_RESULT_COUNT
+};
+
+static struct
+{
+   unsigned int rows[MOCK_RESULT_COUNT];
+   unsigned int columns;
+   unsigned int width;
+   unsigned int nulls;
+   double       delay;
+   double       jitter;
+   unsigned int errors;
+   unsigned int seed;
+   int          quiet;
+   Mock_Buf     text[MOCK_RESULT_COUNT];
+   Mock_Buf     binary[MOCK_RESULT_COUNT];
+} mock;
+
+static volatile sig_atomic_t mock_quit = 0;
+
+static double
+mock_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void
+mock_buf_reserve(Mock_Buf *b,
+                 size_t    len)
+{
+   unsigned char *tmp;
+   size_t size;
+
+   if (b->len + len <= b->size) return;
+   for (size = b->size ? b->size : 256; size < b->len + len; size *= 2) ;
+   tmp = realloc(b->data, size);
+   if (!tmp)
+     {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+     }
+   b->data = tmp;
+   b->size = size;
+}
+
+static void
+mock_buf_append(Mock_Buf   *b,
+                const void *data,
+                size_t      len)
+{
+   mock_buf_reserve(b, len);
+   memcpy(b->data + b->len, data, len);
+   b->len += len;
+}
+
+static void
+mock_buf_byte(Mock_Buf     *b,
+              unsigned char c)
+{
+   mock_buf_append(b, &c, 1);
+}
+
+static void
+mock_buf_int(Mock_Buf          *b,
+             unsigned long long v,
+             unsigned int       bytes)
+{
+   unsigned char tmp[8];
+   unsigned int i;
+
+   for (i = 0; i < bytes; i++, v >>= 8)
+     tmp[i] = v & 0xff;
+   mock_buf_append(b, tmp, bytes);
+}
+
+/* length coded binary */
+static void
+mock_buf_lcb(Mock_Buf          *b,
+             unsigned long long v)
+{
+   if (v < 251)
+     mock_buf_byte(b, v);
+   else if (v < 65536)
+     {
+        mock_buf_byte(b, 0xfc);
+        mock_buf_int(b, v, 2);
+     }
+   else if (v < 16777216)
+     {
+        mock_buf_byte(b, 0xfd);
+        mock_buf_int(b, v, 3);
+     }
+   else
+     {
+        mock_buf_byte(b, 0xfe);
+        mock_buf_int(b, v, 8);
+     }
+}
+
+/* length coded string */
+static void
+mock_buf_lcs(Mock_Buf   *b,
+             const char *s,
+             size_t      len)
+{
+   mock_buf_lcb(b, len);
+   mock_buf_append(b, s, len);
+}
+
+/* starts a packet, returns where its header is */
+static size_t
+mock_packet_begin(Mock_Buf     *b,
+                  unsigned int *seq)
+{
+   size_t off = b->len;
+
+   mock_buf_int(b, 0, 3);
+   mock_buf_byte(b, (*seq)++ & 0xff);
+   return off;
+}
+
+static void
+mock_packet_end(Mock_Buf *b,
+                size_t    off)
+{
+   size_t len = b->len - off - 4;
+
+   b->data[off] = len & 0xff;
+   b->data[off + 1] = (len >> 8) & 0xff;
+   b->data[off + 2] = (len >> 16) & 0xff;
+}
+
+static void
+mock_packet_ok(Mock_Buf          *b,
+               unsigned int      *seq,
+               unsigned long long affected)
+{
+   size_t off = mock_packet_begin(b, seq);
+
+   mock_buf_byte(b, 0);
+   mock_buf_lcb(b, affected);
+   mock_buf_lcb(b, 0); /* insert id */
+   mock_buf_int(b, MOCK_STATUS, 2);
+   mock_buf_int(b, 0, 2); /* warnings */
+   mock_packet_end(b, off);
+}
+
+static void
+mock_packet_eof(Mock_Buf     *b,
+                unsigned int *seq)
+{
+   size_t off = mock_packet_begin(b, seq);
+
+   mock_buf_byte(b, 0xfe);
+   mock_buf_int(b, 0, 2); /* warnings */
+   mock_buf_int(b, MOCK_STATUS, 2);
+   mock_packet_end(b, off);
+}
+
+static void
+mock_packet_error(Mock_Buf     *b,
+                  unsigned int *seq,
+                  unsigned int  code,
+                  const char   *state,
+                  const char   *msg)
+{
+   size_t off = mock_packet_begin(b, seq);
+
+   mock_buf_byte(b, 0xff);
+   mock_buf_int(b, code, 2);
+   mock_buf_byte(b, '#');
+   mock_buf_append(b, state, 5);
+   mock_buf_append(b, msg, strlen(msg));
+   mock_packet_end(b, off);
+}
+
+static unsigned char
+mock_column_type(unsigned int col)
+{
+   static const unsigned char types[] = { MOCK_TYPE_LONGLONG, MOCK_TYPE_VAR_STRING, MOCK_TYPE_DOUBLE };
+
+   return types[col % 3];
+}
+
+static void
+mock_packet_column(Mock_Buf     *b,
+                   unsigned int *seq,
+                   const char   *name,
+                   unsigned char type)
+{
+   size_t off = mock_packet_begin(b, seq);
+   int string = (type == MOCK_TYPE_VAR_STRING);
+
+   mock_buf_lcs(b, "def", 3);
+   mock_buf_lcs(b, "mock", 4);
+   mock_buf_lcs(b, "esql_bench", 10);
+   mock_buf_lcs(b, "esql_bench", 10);
+   mock_buf_lcs(b, name, strlen(name));
+   mock_buf_lcs(b, name, strlen(name));
+   mock_buf_byte(b, 0x0c);
+   mock_buf_int(b, string ? MOCK_CHARSET_UTF8 : MOCK_CHARSET_BINARY, 2);
+   mock_buf_int(b, string ? mock.width * 3 : 20, 4);
+   mock_buf_byte(b, type);
+   mock_buf_int(b, string ? 0 : MOCK_NOT_NULL_FLAG, 2);
+   mock_buf_byte(b, (type == MOCK_TYPE_DOUBLE) ? 31 : 0);
+   mock_buf_int(b, 0, 2);
+   mock_packet_end(b, off);
+}
+
+static void
+mock_columns(Mock_Buf     *b,
+             unsigned int *seq)
+{
+   static const char *names[] = { "id", "name", "value" };
+   char name[16];
+   unsigned int i;
+
+   for (i = 0; i < mock.columns; i++)
+     {
+        if (i < 3)
+          mock_packet_column(b, seq, names[i], mock_column_type(i));
+        else
+          {
+             snprintf(name, sizeof(name), "c%u", i);
+             mock_packet_column(b, seq, name, mock_column_type(i));
+          }
+     }
+}
+
+/* the value of a string column, NULL every mock.nulls rows */
+static const char *
+mock_value_string(unsigned int row,
+                  char        *buf)
+{
+   if (mock.nulls && (row % mock.nulls == mock.nulls - 1)) return NULL;
+   snprintf(buf, mock.width + 1, "name-%0*u", mock.width > 5 ? mock.width - 5 : 0, row);
+   return buf;
+}
+
+static void
+mock_row_text(Mock_Buf     *b,
+              unsigned int *seq,
+              unsigned int  row,
+              char         *buf)
+{
+   size_t off = mock_packet_begin(b, seq);
+   const char *s;
+   unsigned int i;
+   char num[64];
+
+   for (i = 0; i < mock.columns; i++)
+     {
+        switch (mock_column_type(i))
+          {
+           case MOCK_TYPE_LONGLONG:
+             mock_buf_lcs(b, num, snprintf(num, sizeof(num), "%u", row));
+             break;
+
+           case MOCK_TYPE_DOUBLE:
+             mock_buf_lcs(b, num, snprintf(num, sizeof(num), "%u.25", row));
+             break;
+
+           default:
+             s = mock_value_string(row, buf);
+             if (s)
+               mock_buf_lcs(b, s, strlen(s));
+             else
+               mock_buf_byte(b, 0xfb);
+          }
+     }
+   mock_packet_end(b, off);
+}
+
+static void
+mock_row_binary(Mock_Buf     *b,
+                unsigned int *seq,
+                unsigned int  row,
+                char         *buf)
+{
+   size_t off = mock_packet_begin(b, seq);
+   size_t bitmap;
+   const char *s;
+   unsigned int i;
+   double d;
+   unsigned long long u;
+
+   mock_buf_byte(b, 0);
+   /* the null bitmap starts at bit 2 */
+   bitmap = b->len;
+   mock_buf_reserve(b, (mock.columns + 9) / 8);
+   memset(b->data + bitmap, 0, (mock.columns + 9) / 8);
+   b->len += (mock.columns + 9) / 8;
+   for (i = 0; i < mock.columns; i++)
+     {
+        switch (mock_column_type(i))
+          {
+           case MOCK_TYPE_LONGLONG:
+             mock_buf_int(b, row, 8);
+             break;
+
+           case MOCK_TYPE_DOUBLE:
+             d = row + 0.25;
+             memcpy(&u, &d, 8);
+             mock_buf_int(b, u, 8);
+             break;
+
+           default:
+             s = mock_value_string(row, buf);
+             if (s)
+               mock_buf_lcs(b, s, strlen(s));
+             else
+               b->data[bitmap + (i + 2) / 8] |= 1 << ((i + 2) % 8);
+          }
+     }
+   mock_packet_end(b, off);
+}
+
+/* encodes a result set the way it follows a command */
+static void
+mock_result_build(Mock_Buf    *b,
+                  unsigned int rows,
+                  int          binary)
+{
+   unsigned int seq = 1, row;
+   size_t off;
+   char *buf;
+
+   buf = malloc(mock.width + 1);
+   if (!buf) exit(1);
+   off = mock_packet_begin(b, &seq);
+   mock_buf_lcb(b, mock.columns);
+   mock_packet_end(b, off);
+   mock_columns(b, &seq);
+   mock_packet_eof(b, &seq);
+   for (row = 0; row < rows; row++)
+     {
+        if (binary)
+          mock_row_binary(b, &seq, row, buf);
+        else
+          mock_row_text(b, &seq, row, buf);
+     }
+   mock_packet_eof(b, &seq);
+   free(buf);
+}
+
+/* which result set answers @p query, -1 if it is not a SELECT */
+static int
+mock_query_result(const char *query)
+{
+   while (isspace((unsigned char)*query)) query++;
+   if (strncasecmp(query, "SELECT", 6)) return -1;
+   return strcasestr(query, "WHERE") ? MOCK_RESULT_LOOKUP : MOCK_RESULT_SCAN;
+}
+
+/* rows of a multi-row INSERT, 1 for other statements */
+static unsigned long long
+mock_query_affected(const char *query)
+{
+   unsigned long long rows = 0;
+   const char *p;
+   char quote = 0;
+   int depth = 0;
+
+   p = strcasestr(query, "VALUES");
+   if (!p) return 1;
+   for (; *p; p++)
+     {
+        if (quote)
+          {
+             if (*p == '\\' && p[1]) p++;
+             else if (*p == quote) quote = 0;
+          }
+        else if ((*p == '\'') || (*p == '"')) quote = *p;
+        else if (*p == '(')
+          {
+             if (!depth++) rows++;
+          }
+        else if (*p == ')') depth--;
+     }
+   return rows ? rows : 1;
+}
+
+static unsigned int
+mock_query_params(const char *query)
+{
+   unsigned int n = 0;
+   char quote = 0;
+
+   for (; *query; query++)
+     {
+        if (quote)
+          {
+             if (*query == '\\' && query[1]) query++;
+             else if (*query == quote) quote = 0;
+          }
+        else if ((*query == '\'') || (*query == '"')) quote = *query;
+        else if (*query == '?') n++;
+     }
+   return n;
+}
+
+static void
+mock_queue(Mock_Conn           *c,
+           const unsigned char *data,
+           size_t               len,
+           unsigned char       *owned)
+{
+   Mock_Segment *s;
+   double due;
+
+   s = calloc(1, sizeof(Mock_Segment));
+   if (!s) exit(1);
+   /* responses go out in order, whatever their delay */
+   due = mock_time() + mock.delay;
+   if (mock.jitter > 0) due += mock.jitter * rand_r(&c->seed) / RAND_MAX;
+   if (due < c->last_due) due = c->last_due;
+   c->last_due = due;
+   s->data = data;
+   s->len = len;
+   s->due = due;
+   s->owned = owned;
+   if (c->tail)
+     c->tail->next = s;
+   else
+     c->head = s;
+   c->tail = s;
+}
+
+/* queues the response being built in @p b */
+static void
+mock_queue_buf(Mock_Conn *c,
+               Mock_Buf  *b)
+{
+   mock_queue(c, b->data, b->len, b->data);
+   memset(b, 0, sizeof(Mock_Buf));
+}
+
+static int
+mock_error_injected(Mock_Conn *c)
+{
+   return mock.errors && ((unsigned int)(rand_r(&c->seed) % 100) < mock.errors);
+}
+
+static Mock_Stmt *
+mock_stmt_find(Mock_Conn   *c,
+               unsigned int id)
+{
+   unsigned int i;
+
+   for (i = 0; i < c->stmt_count; i++)
+     if (c->stmts[i].id == id) return &c->stmts[i];
+   return NULL;
+}
+
+static void
+mock_stmt_prepare(Mock_Conn  *c,
+                  const char *query)
+{
+   Mock_Stmt *stmt;
+   Mock_Buf b = { NULL, 0, 0 };
+   unsigned int seq = 1, i;
+   size_t off;
+
+   stmt = realloc(c->stmts, (c->stmt_count + 1) * sizeof(Mock_Stmt));
+   if (!stmt) exit(1);
+   c->stmts = stmt;
+   stmt += c->stmt_count++;
+   stmt->id = ++c->stmt_id;
+   stmt->params = mock_query_params(query);
+   stmt->result = mock_query_result(query);
+
+   off = mock_packet_begin(&b, &seq);
+   mock_buf_byte(&b, 0);
+   mock_buf_int(&b, stmt->id, 4);
+   mock_buf_int(&b, (stmt->result < 0) ? 0 : mock.columns, 2);
+   mock_buf_int(&b, stmt->params, 2);
+   mock_buf_byte(&b, 0);
+   mock_buf_int(&b, 0, 2); /* warnings */
+   mock_packet_end(&b, off);
+   if (stmt->params)
+     {
+        for (i = 0; i < stmt->params; i++)
+          mock_packet_column(&b, &seq, "?", MOCK_TYPE_VAR_STRING);
+        mock_packet_eof(&b, &seq);
+     }
+   if (stmt->result >= 0)
+     {
+        mock_columns(&b, &seq);
+        mock_packet_eof(&b, &seq);
+     }
+   mock_queue_buf(c, &b);
+}
+
+static void
+mock_stmt_close(Mock_Conn   *c,
+                unsigned int id)
+{
+   Mock_Stmt *stmt = mock_stmt_find(c, id);
+
+   if (!stmt) return;
+   *stmt = c->stmts[--c->stmt_count];
+}
+
+/* answers one command packet */
+static int
+mock_command(Mock_Conn           *c,
+             const unsigned char *p,
+             size_t               len)
+{
+   Mock_Buf b = { NULL, 0, 0 };
+   Mock_Stmt *stmt;
+   unsigned int seq = 1;
+   char *query;
+   int result;
+
+   if (!c->authed)
+     {
+        /* any login will do */
+        c->authed = 1;
+        seq = 2;
+        mock_packet_ok(&b, &seq, 0);
+        mock_queue_buf(c, &b);
+        return 1;
+     }
+   if (!len) return 0;
+
+   switch (p[0])
+     {
+      case MOCK_COM_QUIT:
+        return 0;
+
+      case MOCK_COM_INIT_DB:
+      case MOCK_COM_PING:
+      case MOCK_COM_STMT_RESET:
+        mock_packet_ok(&b, &seq, 0);
+        break;
+
+      case MOCK_COM_QUERY:
+      case MOCK_COM_STMT_PREPARE:
+        query = strndup((const char *)p + 1, len - 1);
+        if (!query) exit(1);
+        if (mock_error_injected(c))
+          mock_packet_error(&b, &seq, 1064, "42000", "injected error");
+        else if (p[0] == MOCK_COM_STMT_PREPARE)
+          mock_stmt_prepare(c, query);
+        else if ((result = mock_query_result(query)) >= 0)
+          mock_queue(c, mock.text[result].data, mock.text[result].len, NULL);
+        else
+          mock_packet_ok(&b, &seq, mock_query_affected(query));
+        free(query);
+        break;
+
+      case MOCK_COM_STMT_EXECUTE:
+        stmt = (len >= 5) ? mock_stmt_find(c, p[1] | (p[2] << 8) | (p[3] << 16) | ((unsigned int)p[4] << 24)) : NULL;
+        if (!stmt)
+          mock_packet_error(&b, &seq, 1243, "HY000", "unknown prepared statement handler");
+        else if (mock_error_injected(c))
+          mock_packet_error(&b, &seq, 1064, "42000", "injected error");
+        else if (stmt->result >= 0)
+          mock_queue(c, mock.binary[stmt->result].data, mock.binary[stmt->result].len, NULL);
+        else
+          mock_packet_ok(&b, &seq, 1);
+        break;
+
+      case MOCK_COM_STMT_CLOSE:
+        /* no response */
+        if (len >= 5)
+          mock_stmt_close(c, p[1] | (p[2] << 8) | (p[3] << 16) | ((unsigned int)p[4] << 24));
+        break;
+
+      default:
+        mock_packet_error(&b, &seq, 1047, "08S01", "unknown command");
+     }
+   if (b.len)
+     mock_queue_buf(c, &b);
+   return 1;
+}
+
+static void
+mock_greeting(Mock_Conn   *c,
+              unsigned int thread_id)
+{
+   Mock_Buf b = { NULL, 0, 0 };
+   unsigned int seq = 0;
+   size_t off;
+
+   off = mock_packet_begin(&b, &seq);
+   mock_buf_byte(&b, 10); /* protocol version */
+   mock_buf_append(&b, "5.5.0-esql-mock", sizeof("5.5.0-esql-mock"));
+   mock_buf_int(&b, thread_id, 4);
+   mock_buf_append(&b, MOCK_SALT, 8);
+   mock_buf_byte(&b, 0);
+   mock_buf_int(&b, MOCK_CAPABILITIES, 2);
+   mock_buf_byte(&b, MOCK_CHARSET_UTF8);
+   mock_buf_int(&b, MOCK_STATUS, 2);
+   mock_buf_int(&b, 0, 2); /* capabilities, upper bytes */
+   mock_buf_byte(&b, 21); /* auth data length */
+   mock_buf_append(&b, "\0\0\0\0\0\0\0\0\0\0", 10);
+   mock_buf_append(&b, MOCK_SALT + 8, 13); /* with its nul */
+   mock_packet_end(&b, off);
+   mock_queue_buf(c, &b);
+}
+
+/* reads what the client sent, returns 0 once the connection should be closed */
+static int
+mock_conn_read(Mock_Conn *c)
+{
+   size_t off = 0, len;
+   ssize_t r;
+
+   mock_buf_reserve(&c->in, 65536);
+   r = read(c->fd, c->in.data + c->in.len, c->in.size - c->in.len);
+   if (r == 0) return 0;
+   if (r < 0) return (errno == EAGAIN) || (errno == EINTR);
+   c->in.len += r;
+
+   /* pipelined commands are answered in order */
+   while (c->in.len - off >= 4)
+     {
+        len = c->in.data[off] | (c->in.data[off + 1] << 8) | (c->in.data[off + 2] << 16);
+        if (c->in.len - off < len + 4)
+          {
+             mock_buf_reserve(&c->in, len + 4);
+             break;
+          }
+        if (!mock_command(c, c->in.data + off + 4, len)) return 0;
+        off += len + 4;
+     }
+   memmove(c->in.data, c->in.data + off, c->in.len - off);
+   c->in.len -= off;
+   return 1;
+}
+
+/* sends what is due, returns 0 if the connection broke */
+static int
+mock_conn_write(Mock_Conn *c,
+                double     now)
+{
+   Mock_Segment *s;
+   ssize_t r;
+
+   while ((s = c->head) && (s->due <= now))
+     {
+        r = write(c->fd, s->data + s->sent, s->len - s->sent);
+        if (r < 0) return (errno == EAGAIN) || (errno == EINTR);
+        s->sent += r;
+        if (s->sent < s->len) return 1;
+        c->head = s->next;
+        if (!c->head) c->tail = NULL;
+        free(s->owned);
+        free(s);
+     }
+   return 1;
+}
+
+static void
+mock_conn_free(Mock_Conn *c)
+{
+   Mock_Segment *s;
+
+   close(c->fd);
+   while ((s = c->head))
+     {
+        c->head = s->next;
+        free(s->owned);
+        free(s);
+     }
+   free(c->in.data);
+   free(c->stmts);
+   free(c);
+}
+
+static void
+mock_signal(int sig)
+{
+   (void)sig;
+   mock_quit = 1;
+}
+
+static int
+mock_listen(const char  *addr,
+            unsigned int port)
+{
+   struct sockaddr_in sin;
+   socklen_t len = sizeof(sin);
+   int fd, one = 1;
+
+   memset(&sin, 0, sizeof(sin));
+   sin.sin_family = AF_INET;
+   sin.sin_port = htons(port);
+   if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1)
+     {
+        fprintf(stderr, "invalid address: %s\n", addr);
+        return -1;
+     }
+   fd = socket(AF_INET, SOCK_STREAM, 0);
+   if (fd < 0) return -1;
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+   if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) || listen(fd, 256) ||
+       getsockname(fd, (struct sockaddr *)&sin, &len))
+     {
+        perror("mysql_mock");
+        close(fd);
+        return -1;
+     }
+   fcntl(fd, F_SETFL, O_NONBLOCK);
+   printf("listening on %s:%u\n", addr, ntohs(sin.sin_port));
+   fflush(stdout);
+   return fd;
+}
+
+static void
+usage(const char *prog)
+{
+   fprintf(stderr,
+           "usage: %s [options]\n"
+           "  -a ADDR       address to listen on (default: 127.0.0.1)\n"
+           "  -p PORT       port to listen on, 0 to pick one (default: %u)\n"
+           "  -r ROWS       rows returned by SELECTs without a WHERE clause (default: 100000)\n"
+           "  -k ROWS       rows returned by SELECTs with a WHERE clause (default: 1)\n"
+           "  -c COLUMNS    columns of the result sets: integer, string, double, integer... (default: 3)\n"
+           "  -w WIDTH      width of string values (default: 16)\n"
+           "  -z N          every Nth row has NULL strings, 0 for none (default: 0)\n"
+           "  -d MS         delay every response by MS milliseconds (default: 0)\n"
+           "  -j MS         add up to MS milliseconds of random delay to every response (default: 0)\n"
+           "  -e PERCENT    answer PERCENT of the queries with an error (default: 0)\n"
+           "  -s SEED       seed of the random delays and errors (default: 1)\n"
+           "  -q            do not log connections\n",
+           prog, MOCK_PORT);
+}
+
+int
+main(int    argc,
+     char **argv)
+{
+   struct pollfd *pfds = NULL;
+   Mock_Conn **conns = NULL;
+   const char *addr = "127.0.0.1";
+   unsigned int port = MOCK_PORT, count = 0, size = 0, threads = 0, i;
+   double now, next;
+   int opt, lfd, fd, timeout, one = 1;
+
+   mock.rows[MOCK_RESULT_SCAN] = 100000;
+   mock.rows[MOCK_RESULT_LOOKUP] = 1;
+   mock.columns = 3;
+   mock.width = 16;
+   mock.seed = 1;
+   while ((opt = getopt(argc, argv, "a:p:r:k:c:w:z:d:j:e:s:qh")) != -1)
+     {
+        switch (opt)
+          {
+           case 'a': addr = optarg; break;
+           case 'p': port = strtoul(optarg, NULL, 10); break;
+           case 'r': mock.rows[MOCK_RESULT_SCAN] = strtoul(optarg, NULL, 10); break;
+           case 'k': mock.rows[MOCK_RESULT_LOOKUP] = strtoul(optarg, NULL, 10); break;
+           case 'c': mock.columns = strtoul(optarg, NULL, 10); break;
+           case 'w': mock.width = strtoul(optarg, NULL, 10); break;
+           case 'z': mock.nulls = strtoul(optarg, NULL, 10); break;
+           case 'd': mock.delay = strtod(optarg, NULL) / 1000; break;
+           case 'j': mock.jitter = strtod(optarg, NULL) / 1000; break;
+           case 'e': mock.errors = strtoul(optarg, NULL, 10); break;
+           case 's': mock.seed = strtoul(optarg, NULL, 10); break;
+           case 'q': mock.quiet = 1; break;
+           default:
+             usage(argv[0]);
+             return opt != 'h';
+          }
+     }
+   /* mysac reads the column count as a single byte */
+   if ((!mock.columns) || (mock.columns > 250) || (mock.width > 250) || (mock.errors > 100) ||
+       (mock.delay < 0) || (mock.jitter < 0) || (port > 65535))
+     {
+        usage(argv[0]);
+        return 1;
+     }
+
+   for (i = 0; i < MOCK_RESULT_COUNT; i++)
+     {
+        mock_result_build(&mock.text[i], mock.rows[i], 0);
+        mock_result_build(&mock.binary[i], mock.rows[i], 1);
+     }
+
+   signal(SIGPIPE, SIG_IGN);
+   signal(SIGINT, mock_signal);
+   signal(SIGTERM, mock_signal);
+   lfd = mock_listen(addr, port);
+   if (lfd < 0) return 1;
+
+   while (!mock_quit)
+     {
+        if (count + 1 > size)
+          {
+             size = size ? size * 2 : 16;
+             pfds = realloc(pfds, size * sizeof(struct pollfd));
+             conns = realloc(conns, size * sizeof(Mock_Conn *));
+             if ((!pfds) || (!conns)) return 1;
+          }
+        /* wake up for the next delayed response */
+        now = mock_time();
+        next = -1;
+        pfds[0].fd = lfd;
+        pfds[0].events = POLLIN;
+        for (i = 0; i < count; i++)
+          {
+             pfds[i + 1].fd = conns[i]->fd;
+             pfds[i + 1].events = POLLIN;
+             if (!conns[i]->head) continue;
+             if (conns[i]->head->due <= now)
+               pfds[i + 1].events |= POLLOUT;
+             else if ((next < 0) || (conns[i]->head->due < next))
+               next = conns[i]->head->due;
+          }
+        timeout = (next < 0) ? -1 : (int)((next - now) * 1000) + 1;
+        if (poll(pfds, count + 1, timeout) < 0)
+          {
+             if (errno == EINTR) continue;
+             perror("poll");
+             break;
+          }
+
+        now = mock_time();
+        for (i = count; i > 0; i--)
+          {
+             Mock_Conn *c = conns[i - 1];
+             int ok = 1;
+
+             if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+               ok = mock_conn_read(c);
+             if (ok)
+               ok = mock_conn_write(c, now);
+             if (ok) continue;
+             if (!mock.quiet) fprintf(stderr, "connection %d closed\n", c->fd);
+             mock_conn_free(c);
+             conns[i - 1] = conns[--count];
+          }
+
+        if (!(pfds[0].revents & POLLIN)) continue;
+        while ((count + 1 <= size) && ((fd = accept(lfd, NULL, NULL)) >= 0))
+          {
+             Mock_Conn *c;
+
+             fcntl(fd, F_SETFL, O_NONBLOCK);
+             setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+             c = calloc(1, sizeof(Mock_Conn));
+             if (!c) return 1;
+             c->fd = fd;
+             c->seed = mock.seed + threads;
+             mock_greeting(c, ++threads);
+             mock_conn_write(c, mock_time());
+             conns[count++] = c;
+             if (!mock.quiet) fprintf(stderr, "connection %d opened\n", fd);
+             if (count + 1 > size) break;
+          }
+     }
+
+   for (i = 0; i < count; i++)
+     mock_conn_free(conns[i]);
+   free(conns);
+   free(pfds);
+   close(lfd);
+   for (i = 0; i < MOCK_RESULT_COUNT; i++)
+     {
+        free(mock.text[i].data);
+        free(mock.binary[i].data);
+     }
+   return 0;
+}
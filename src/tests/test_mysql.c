@@ -0,0 +1,252 @@
+/*
+ * Copyright 2011, 2012 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Esskyuehl.h"
+#include <Ecore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* runs prepared statements against src/tests/mysql_mock, which is looked up
+ * next to this program. the mock describes the placeholders of every
+ * statement as real servers do, so a client which leaves them unread fails
+ * the command after the preparation.
+ */
+
+#define SCAN_ROWS 3
+/* queries issued back to back once pipelining is enabled, more than its depth */
+#define PIPELINE_DEPTH 4
+#define PIPELINED (2 * PIPELINE_DEPTH)
+
+struct ctx {
+   unsigned int conns;
+   unsigned int errors;
+   unsigned int res;
+   unsigned int piped;
+   Esql_Stmt   *select;
+};
+
+static void
+_assert(Eina_Bool expr, const char* file, int line)
+{
+   if (!expr) EINA_LOG_ERR("%s:%d ds failed miserably", file, line);
+}
+#define assert(_expr) _assert(_expr, __FILE__, __LINE__);
+
+/* even queries insert, odd ones scan: the results must come back in that order */
+static void
+on_pipelined(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+
+   ctx->res++;
+   printf("pipelined %u: %s\n", ctx->piped, esql_res_error_get(res) ?: "ok");
+   assert(esql_res_error_get(res) == NULL);
+   assert(esql_res_rows_count(res) == ((ctx->piped % 2) ? SCAN_ROWS : 0));
+   if (++ctx->piped == PIPELINED) ecore_main_loop_quit();
+}
+
+static void
+on_select(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+   Esql *e = esql_res_esql_get(res);
+   int i;
+
+   ctx->res++;
+   printf("selected %u: %s\n", ctx->res, esql_res_error_get(res) ?: "ok");
+   assert(esql_res_error_get(res) == NULL);
+   assert(esql_res_rows_count(res) == 1);
+   assert(esql_res_cols_count(res) == 3);
+
+   esql_stmt_free(ctx->select);
+   ctx->select = NULL;
+
+   /* the mock answers commands in the order it reads them, however many come at once */
+   esql_pipeline_set(e, PIPELINE_DEPTH);
+   assert(esql_pipeline_get(e) == PIPELINE_DEPTH);
+   for (i = 0; i < PIPELINED; i++)
+     {
+        const char *query = (i % 2) ? "SELECT i, s, d FROM t" : "INSERT INTO t (i, s) VALUES (1, 'x')";
+
+        assert(esql_query_full(e, query, on_pipelined, ctx) > 0);
+     }
+}
+
+static void
+on_scan(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+
+   ctx->res++;
+   printf("scanned %u: %s\n", ctx->res, esql_res_error_get(res) ?: "ok");
+   assert(esql_res_error_get(res) == NULL);
+   assert(esql_res_rows_count(res) == SCAN_ROWS);
+   assert(esql_res_cols_count(res) == 3);
+
+   /* a statement which returns data, prepared after the others */
+   ctx->select = esql_prepare(esql_res_esql_get(res), "SELECT i, s, d FROM t WHERE i = %d");
+   assert(ctx->select != NULL);
+   assert(esql_execute(ctx->select, on_select, ctx, 1) > 0);
+}
+
+static void
+on_insert(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+
+   ctx->res++;
+   printf("inserted %u: %s\n", ctx->res, esql_res_error_get(res) ?: "ok");
+   assert(esql_res_error_get(res) == NULL);
+   assert(esql_res_rows_count(res) == 0);
+}
+
+static Eina_Bool
+on_connect(void *data, int type EINA_UNUSED, void *event_info)
+{
+   struct ctx *ctx = data;
+   Esql *e = event_info;
+   Esql_Stmt *stmt;
+   int i;
+
+   ctx->conns++;
+   printf("connected %u!\n", ctx->conns);
+
+   /* no columns come back, but the placeholders are described */
+   stmt = esql_prepare(e, "INSERT INTO t (i, s) VALUES (%d, '%s')");
+   assert(stmt != NULL);
+   for (i = 0; i < 2; i++)
+     assert(esql_execute(stmt, on_insert, ctx, i, "some-text") > 0);
+   esql_stmt_free(stmt);
+
+   /* a plain query right behind the preparation */
+   assert(esql_query_full(e, "SELECT i, s, d FROM t", on_scan, ctx) > 0);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+on_error(void *data, int type EINA_UNUSED, void *event_info)
+{
+   struct ctx *ctx = data;
+   Esql *e = event_info;
+
+   ctx->errors++;
+   printf("error %u: %s!\n", ctx->errors, esql_error_get(e));
+   ecore_main_loop_quit();
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+on_timeout(void *data EINA_UNUSED)
+{
+   EINA_LOG_ERR("timed out");
+   ecore_main_loop_quit();
+   return EINA_FALSE;
+}
+
+/* starts the mock on a port it picks, which it prints on its first line */
+static pid_t
+mock_start(const char *prog, unsigned int *port)
+{
+   char path[4096], line[256];
+   const char *slash;
+   FILE *out;
+   pid_t pid;
+   int fds[2];
+
+   slash = strrchr(prog, '/');
+   snprintf(path, sizeof(path), "%.*smysql_mock", slash ? (int)(slash - prog + 1) : 0, prog);
+   if (pipe(fds)) return -1;
+   pid = fork();
+   if (pid < 0) return -1;
+   if (!pid)
+     {
+        char rows[16];
+
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        snprintf(rows, sizeof(rows), "%u", SCAN_ROWS);
+        execl(path, path, "-q", "-p", "0", "-r", rows, (char *)NULL);
+        _exit(127);
+     }
+   close(fds[1]);
+   out = fdopen(fds[0], "r");
+   if ((!out) || (!fgets(line, sizeof(line), out)) ||
+       (!strchr(line, ':')) || (!(*port = strtoul(strrchr(line, ':') + 1, NULL, 10))))
+     {
+        fprintf(stderr, "could not start %s\n", path);
+        if (out) fclose(out);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return -1;
+     }
+   fclose(out);
+   return pid;
+}
+
+int
+main(int argc EINA_UNUSED, char **argv)
+{
+   Esql *e;
+   struct ctx ctx = {0, 0, 0, 0, NULL};
+   unsigned int port = 0;
+   char addr[64];
+   pid_t mock;
+
+   mock = mock_start(argv[0], &port);
+   if (mock < 0) return 1;
+   snprintf(addr, sizeof(addr), "127.0.0.1:%u", port);
+
+   ecore_init();
+   esql_init();
+
+   e = esql_new(ESQL_TYPE_MYSQL);
+   assert(e != NULL);
+
+   ecore_event_handler_add(ESQL_EVENT_CONNECT, on_connect, &ctx);
+   ecore_event_handler_add(ESQL_EVENT_ERROR, on_error, &ctx);
+   ecore_timer_add(10.0, on_timeout, NULL);
+
+   /* the mock takes any login */
+   esql_database_set(e, "test");
+   assert(esql_connect(e, addr, "test", "test"));
+
+   ecore_main_loop_begin();
+   esql_free(e);
+
+   esql_shutdown();
+   ecore_shutdown();
+
+   kill(mock, SIGTERM);
+   waitpid(mock, NULL, 0);
+
+   assert(ctx.conns == 1);
+   assert(ctx.errors == 0);
+   assert(ctx.piped == PIPELINED);
+   assert(ctx.res == 4 + PIPELINED);
+
+   return 0;
+}
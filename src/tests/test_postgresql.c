@@ -0,0 +1,183 @@
+/*
+ * Copyright 2011, 2012 Mike Blumenkrantz <michael.blumenkrantz@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Esskyuehl.h"
+#include <Ecore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* streams rows from the server given as ADDR,USER,PASSWORD,DATABASE in
+ * $ESQL_TEST_POSTGRESQL, and does nothing without it. libpq hands over one
+ * row per result in single-row mode, and ESQL_STREAM_BATCH rows per result
+ * in chunked mode: the batches must be the same either way.
+ */
+
+/* rows per batch handed to a stream callback */
+#define STREAM_BATCH 256
+/* enough for two full batches and a partial one */
+#define STREAMED_ROWS (2 * STREAM_BATCH + 88)
+
+struct ctx {
+   unsigned int conns;
+   unsigned int errors;
+   unsigned int res;
+   unsigned int streamed;
+   unsigned int batches;
+};
+
+static void
+_assert(Eina_Bool expr, const char* file, int line)
+{
+   if (!expr) EINA_LOG_ERR("%s:%d ds failed miserably", file, line);
+}
+#define assert(_expr) _assert(_expr, __FILE__, __LINE__);
+
+static void
+on_stream_rows(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+   const Esql_Row *row;
+   Eina_Iterator *itr;
+   int rows;
+
+   /* only the last batch may be short */
+   rows = esql_res_rows_count(res);
+   printf("batch %u: %d rows\n", ctx->batches, rows);
+   assert((rows == STREAM_BATCH) || ((rows > 0) && (ctx->streamed + rows == STREAMED_ROWS)));
+   ctx->batches++;
+
+   itr = esql_res_row_iterator_new(res);
+   EINA_ITERATOR_FOREACH(itr, row)
+     {
+        const Eina_Value *val = esql_row_value_struct_get(row);
+        int num;
+
+        assert(eina_value_struct_get(val, "i", &num));
+        assert(num == (int)ctx->streamed);
+        ctx->streamed++;
+        rows--;
+     }
+   eina_iterator_free(itr);
+   assert(rows == 0);
+}
+
+static void
+on_stream_done(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+
+   ctx->res++;
+   printf("streamed %u rows: %s\n", ctx->streamed, esql_res_error_get(res) ?: "ok");
+   assert(esql_res_error_get(res) == NULL);
+   assert(esql_res_rows_count(res) == STREAMED_ROWS);
+   assert(ctx->streamed == STREAMED_ROWS);
+   assert(ctx->batches == 3);
+   ecore_main_loop_quit();
+}
+
+static Eina_Bool
+on_connect(void *data, int type EINA_UNUSED, void *event_info)
+{
+   struct ctx *ctx = data;
+   Esql *e = event_info;
+   char query[128];
+
+   ctx->conns++;
+   printf("connected %u!\n", ctx->conns);
+
+   snprintf(query, sizeof(query), "SELECT i FROM generate_series(0, %d) AS i", STREAMED_ROWS - 1);
+   assert(esql_query_stream(e, query, on_stream_rows, on_stream_done, ctx) > 0);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+on_error(void *data, int type EINA_UNUSED, void *event_info)
+{
+   struct ctx *ctx = data;
+   Esql *e = event_info;
+
+   ctx->errors++;
+   printf("error %u: %s!\n", ctx->errors, esql_error_get(e));
+   ecore_main_loop_quit();
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+on_timeout(void *data EINA_UNUSED)
+{
+   EINA_LOG_ERR("timed out");
+   ecore_main_loop_quit();
+   return EINA_FALSE;
+}
+
+int
+main(void)
+{
+   Esql *e;
+   struct ctx ctx = {0, 0, 0, 0, 0};
+   char *spec, *addr, *user, *passwd, *database;
+
+   spec = getenv("ESQL_TEST_POSTGRESQL");
+   if ((!spec) || (!spec[0]))
+     {
+        printf("ESQL_TEST_POSTGRESQL is not set, nothing to test\n");
+        return 0;
+     }
+   spec = strdup(spec);
+   if (!spec) return 1;
+   addr = strsep(&spec, ",");
+   user = strsep(&spec, ",");
+   passwd = strsep(&spec, ",");
+   database = strsep(&spec, ",");
+   if ((!user) || (!database))
+     {
+        fprintf(stderr, "ESQL_TEST_POSTGRESQL: expected ADDR,USER,PASSWORD,DATABASE\n");
+        free(addr);
+        return 1;
+     }
+
+   ecore_init();
+   esql_init();
+
+   e = esql_new(ESQL_TYPE_POSTGRESQL);
+   assert(e != NULL);
+
+   ecore_event_handler_add(ESQL_EVENT_CONNECT, on_connect, &ctx);
+   ecore_event_handler_add(ESQL_EVENT_ERROR, on_error, &ctx);
+   ecore_timer_add(10.0, on_timeout, NULL);
+
+   esql_database_set(e, database);
+   assert(esql_connect(e, addr, user, passwd));
+
+   ecore_main_loop_begin();
+   esql_free(e);
+
+   esql_shutdown();
+   ecore_shutdown();
+   free(addr);
+
+   assert(ctx.conns == 1);
+   assert(ctx.errors == 0);
+   assert(ctx.res == 1);
+
+   return 0;
+}
@@ -26,8 +26,14 @@ struct ctx {
    unsigned int conns;
    unsigned int errors;
    unsigned int res;
+   unsigned int streamed;
+   unsigned int batches;
 };
 #define INSERTED_ROWS 10
+/* rows per batch handed to a stream callback */
+#define STREAM_BATCH 256
+/* enough for two full batches and a partial one */
+#define STREAMED_ROWS (2 * STREAM_BATCH + 88)
 
 static void
 _assert(Eina_Bool expr, const char* file, int line)
@@ -36,10 +42,129 @@ _assert(Eina_Bool expr, const char* file, int line)
 }
 #define assert(_expr) _assert(_expr, __FILE__, __LINE__);
 
+static void
+on_stream_rows(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+   const Esql_Row *row;
+   Eina_Iterator *itr;
+   int rows;
+
+   /* only the last batch may be short */
+   rows = esql_res_rows_count(res);
+   assert((rows == STREAM_BATCH) || ((rows > 0) && (ctx->streamed + rows == STREAMED_ROWS)));
+   ctx->batches++;
+
+   itr = esql_res_row_iterator_new(res);
+   EINA_ITERATOR_FOREACH(itr, row)
+     {
+        const Eina_Value *val = esql_row_value_struct_get(row);
+        int num;
+
+        assert(eina_value_struct_get(val, "i", &num));
+        assert(num == (int)ctx->streamed);
+        ctx->streamed++;
+        rows--;
+     }
+   eina_iterator_free(itr);
+   assert(rows == 0);
+}
+
+static void
+on_stream_done(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+   unsigned long long hits, misses;
+   Esql_Stats stats;
+   Esql_Slow_Query *sq, *last = NULL;
+   unsigned long long dropped;
+   unsigned int slow = 0;
+
+   ctx->res++;
+   assert(esql_res_error_get(res) == NULL);
+   assert(esql_res_row_iterator_new(res) == NULL);
+   assert(esql_res_rows_count(res) == STREAMED_ROWS);
+   assert(ctx->streamed == STREAMED_ROWS);
+   assert(ctx->batches == 3);
+
+   /* the SELECT ran twice, and the INSERT statement was executed repeatedly */
+   esql_stmt_cache_stats_get(esql_res_esql_get(res), &hits, &misses);
+   printf("statement cache: hits=%llu, misses=%llu\n", hits, misses);
+   assert(hits >= 2);
+   assert(misses > 0);
+
+   /* nothing is left in flight, this query included */
+   assert(esql_stats_get(esql_res_esql_get(res), &stats));
+   printf("queries: submitted=%llu, completed=%llu, failed=%llu, p99=%gs\n", stats.submitted,
+          stats.completed, stats.failed, esql_histogram_quantile(&stats.exec, 0.99));
+   assert(stats.submitted == stats.completed + stats.failed);
+   assert(stats.exec.count > 0);
+   assert(esql_histogram_quantile(&stats.exec, 0.99) <= stats.exec.max);
+
+   while ((sq = esql_slow_query_pop(esql_res_esql_get(res), &dropped)))
+     {
+        if (!slow) assert(dropped == stats.completed + stats.failed - 4);
+        slow++;
+        free(last);
+        last = sq;
+     }
+   assert(slow == 4);
+   assert(last && (last->id == esql_res_query_id_get(res)) && (last->rows == STREAMED_ROWS));
+   assert(last && (last->error == NULL));
+   free(last);
+
+   ecore_main_loop_quit();
+}
+
+static void
+on_query_columns(Esql_Res *res, void *data)
+{
+   struct ctx *ctx = data;
+   Esql *e;
+   const int64_t *nums;
+   const char *arena;
+   const unsigned int *offsets;
+   unsigned int i, count;
+   char query[128];
+
+   ctx->res++;
+   assert(esql_res_columnar_get(res));
+   assert(esql_res_row_iterator_new(res) == NULL);
+   assert(esql_res_rows_count(res) == INSERTED_ROWS);
+
+   assert(esql_res_column_type_get(res, 0) == ESQL_COLUMN_TYPE_INT64);
+   assert(esql_res_column_int64_get(res, 0, &nums, &count));
+   assert(count == INSERTED_ROWS);
+
+   assert(esql_res_column_type_get(res, 1) == ESQL_COLUMN_TYPE_STRING);
+   assert(esql_res_column_string_get(res, 1, &arena, &offsets, &count));
+   assert(count == INSERTED_ROWS);
+   assert(esql_res_column_nulls_get(res, 1) == NULL);
+
+   for (i = 0; i < count; i++)
+     {
+        char buf[100];
+
+        assert(nums[i] == i);
+        snprintf(buf, sizeof(buf), "some-text-%10d", i);
+        assert(strcmp(arena + offsets[i], buf) == 0);
+        assert(offsets[i + 1] - offsets[i] - 1 == strlen(buf));
+     }
+
+   /* and a longer sequence, delivered as a stream of row batches */
+   e = esql_res_esql_get(res);
+   esql_columnar_set(e, EINA_FALSE);
+   snprintf(query, sizeof(query),
+            "WITH RECURSIVE n(i) AS (SELECT 0 UNION ALL SELECT i + 1 FROM n WHERE i < %d) SELECT i FROM n",
+            STREAMED_ROWS - 1);
+   assert(esql_query_stream(e, query, on_stream_rows, on_stream_done, ctx) > 0);
+}
+
 static void
 on_query_results(Esql_Res *res, void *data)
 {
    struct ctx *ctx = data;
+   Esql *e;
    const Esql_Row *row;
    Eina_Iterator *itr;
    const char *cname;
@@ -84,7 +209,10 @@ on_query_results(Esql_Res *res, void *data)
      }
    eina_iterator_free(itr);
 
-   ecore_main_loop_quit();
+   /* same query again, stored by column this time */
+   e = esql_res_esql_get(res);
+   esql_columnar_set(e, EINA_TRUE);
+   assert(esql_query_full(e, "SELECT i, s FROM t", on_query_columns, ctx) > 0);
 }
 
 static void
@@ -111,6 +239,7 @@ on_connect(void *data, int type EINA_UNUSED, void *event_info)
 {
    struct ctx *ctx = data;
    Esql *e = event_info;
+   Esql_Stmt *stmt;
    Esql_Query_Id id;
    int i;
 
@@ -118,15 +247,33 @@ on_connect(void *data, int type EINA_UNUSED, void *event_info)
    assert(id > 0);
    esql_query_callback_set(id, on_query_populate);
 
+   /* same format string, odd rows go through a prepared statement,
+    * even ones alternate between setting the callback afterwards and with the query
+    */
+   stmt = esql_prepare(e, "INSERT INTO t (i, s) VALUES (%d, '%s')");
+   assert(stmt != NULL);
+   assert(strcmp(esql_stmt_query_get(stmt), "INSERT INTO t (i, s) VALUES (?, ?)") == 0);
+
    for (i = 0; i < INSERTED_ROWS; i++)
      {
         char buf[100];
         snprintf(buf, sizeof(buf), "some-text-%10d", i);
-        id = esql_query_args(e, ctx, "INSERT INTO t (i, s) VALUES (%d, '%s')",
-                             i, buf);
+        if (i % 2)
+          id = esql_execute(stmt, on_query_populate, ctx, i, buf);
+        else if (i % 4)
+          id = esql_query_args_full(e, on_query_populate, ctx, "INSERT INTO t (i, s) VALUES (%d, '%s')",
+                                    i, buf);
+        else
+          {
+             id = esql_query_args(e, ctx, "INSERT INTO t (i, s) VALUES (%d, '%s')",
+                                  i, buf);
+             assert(id > 0);
+             esql_query_callback_set(id, on_query_populate);
+          }
         assert(id > 0);
-        esql_query_callback_set(id, on_query_populate);
      }
+   /* queued executions do not need the statement anymore */
+   esql_stmt_free(stmt);
 
    ctx->conns++;
    printf("connected %u!\n", ctx->conns);
@@ -148,7 +295,7 @@ int
 main(void)
 {
    Esql *e;
-   struct ctx ctx = {0, 0, 0};
+   struct ctx ctx = {0, 0, 0, 0, 0};
 
    ecore_init();
    esql_init();
@@ -161,6 +308,9 @@ main(void)
    ecore_event_handler_add(ESQL_EVENT_CONNECT, on_connect, &ctx);
    ecore_event_handler_add(ESQL_EVENT_ERROR, on_error, &ctx);
 
+   /* every query is slow enough, the log keeps the most recent ones */
+   esql_slow_query_threshold_set(e, 1e-9);
+   esql_slow_query_log_size_set(e, 4);
    assert(esql_connect(e, ":memory:", NULL, NULL));
 
    ecore_main_loop_begin();
@@ -171,7 +321,7 @@ main(void)
 
    assert(ctx.conns == 1);
    assert(ctx.errors == 0);
-   assert(ctx.res == 2 + INSERTED_ROWS);
+   assert(ctx.res == 4 + INSERTED_ROWS);
 
    return 0;
 }